@@ -1 +1,15 @@
+import contextlib
+
 from .cpyphp import *
+
+@contextlib.contextmanager
+def request():
+	"""
+	Returns a context manager that runs its block within a persistent PHP
+	request (see ``begin_request()`` and ``end_request()``).
+	"""
+	begin_request()
+	try:
+		yield
+	finally:
+		end_request()
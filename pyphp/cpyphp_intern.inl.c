@@ -0,0 +1,204 @@
+/**
+This module contains a string table used to share identical Python strings
+(e.g., the repeated keys of PHP arrays of records) when converting PHP values
+to Python values. All of the functions defined within this module are meant to
+be local (static) to the including module so that the exported namespace is
+not poluted.
+
+:Authors: Caleb P. Burns <cpburnz@gmail.com>; Ben DeMott <ben_demott@hotmail.com>
+:Version: 0.5
+:Status: Development
+:Date: 2026-10-17
+*/
+
+#include <Python.h> // Py*
+#include <stdbool.h> // bool, false, true
+#include <stddef.h> // NULL, size_t
+#include <string.h> // memcmp, memset
+
+#include <Zend/zend_hash.h> // ulong, zend_inline_hash_func
+
+// The initial number of slots allocated by an intern table (must be a power
+// of 2).
+#define INTERN_INIT_SIZE 64
+
+// The maximum length of the strings that are interned. Longer strings are
+// rarely repeated so they are not worth looking up.
+#define INTERN_MAX_LENGTH 64
+
+/**
+The ``intern_entry_t`` struct is a slot in an intern table. An empty slot has
+a ``NULL`` string.
+*/
+struct intern_entry_t {
+	PyObject * str; // owned
+	ulong hash;
+};
+
+/**
+The ``intern_t`` struct maps byte strings to Python strings using open
+addressing with linear probing. The slots are not allocated until the first
+string is interned.
+*/
+struct intern_t {
+	struct intern_entry_t * slots; // owned
+	size_t size;
+	size_t used;
+
+	// The maximum number of strings to intern. Once reached, strings are no
+	// longer added.
+	size_t max;
+};
+
+/**
+Returns the hash for the specified string.
+
+.. NOTE: The hash is the same as the one PHP stores for string keys (*h*) so
+   that the hash of a key does not need to be computed.
+
+*str* (``const char *``) is the string. This must be terminated by a NULL byte
+as PHP strings are.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+Returns the hash (``ulong``).
+*/
+static ulong intern_hash(const char * str, Py_ssize_t len) {
+	return zend_inline_hash_func(str, (uint)len + 1);
+}
+
+/**
+Initializes the specified intern table.
+
+*interns* (``struct intern_t *``) is the intern table.
+
+*max* (``size_t``) is the maximum number of strings to intern.
+*/
+static void intern_init(struct intern_t * interns, size_t max) {
+	interns->slots = NULL;
+	interns->size = 0;
+	interns->used = 0;
+	interns->max = max;
+}
+
+/**
+Releases the strings and slots of the specified intern table. The table can
+be reused afterward.
+
+*interns* (``struct intern_t *``) is the intern table.
+*/
+static void intern_clear(struct intern_t * interns) {
+	size_t i;
+
+	if (interns->slots != NULL) {
+		for (i = 0; i < interns->size; ++i) {
+			Py_XDECREF(interns->slots[i].str);
+		}
+		PyMem_Free(interns->slots);
+	}
+	intern_init(interns, interns->max);
+}
+
+/**
+Grows the slots of the specified intern table.
+
+*interns* (``struct intern_t *``) is the intern table.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool intern_grow(struct intern_t * interns) {
+	struct intern_entry_t * old_slots = interns->slots; // owned
+	size_t old_size = interns->size;
+	size_t size;
+	size_t mask;
+	size_t i;
+	size_t j;
+
+	size = old_size ? old_size * 2 : INTERN_INIT_SIZE;
+	interns->slots = PyMem_New(struct intern_entry_t, size);
+	if (interns->slots == NULL) {
+		interns->slots = old_slots;
+		return false;
+	}
+	memset(interns->slots, 0, size * sizeof(struct intern_entry_t));
+	interns->size = size;
+	mask = size - 1;
+	for (j = 0; j < old_size; ++j) {
+		if (old_slots[j].str != NULL) {
+			i = (size_t)old_slots[j].hash & mask;
+			while (interns->slots[i].str != NULL) {
+				i = (i + 1) & mask;
+			}
+			interns->slots[i] = old_slots[j];
+		}
+	}
+	if (old_slots != NULL) {
+		PyMem_Free(old_slots);
+	}
+	return true;
+}
+
+/**
+Gets the Python string for the specified byte string, creating and interning
+it if it has not been interned.
+
+*interns* (``struct intern_t *``) is the intern table.
+
+*str* (``const char *``) is the string. This must be terminated by a NULL byte
+as PHP strings are.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+*hash* (``ulong``) is the hash of *str* (see ``intern_hash()``).
+
+Returns the new reference to the Python string (``PyObject *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * intern_get(struct intern_t * interns, const char * str, Py_ssize_t len, ulong hash) {
+	PyObject * pystr = NULL; // owned
+	size_t mask;
+	size_t i;
+
+	if (len > INTERN_MAX_LENGTH) {
+		return PyString_FromStringAndSize(str, len);
+	}
+
+	// Find interned string.
+	if (interns->used > 0) {
+		mask = interns->size - 1;
+		i = (size_t)hash & mask;
+		while (interns->slots[i].str != NULL) {
+			pystr = interns->slots[i].str;
+			if (interns->slots[i].hash == hash && PyString_GET_SIZE(pystr) == len && memcmp(PyString_AS_STRING(pystr), str, (size_t)len) == 0) {
+				Py_INCREF(pystr);
+				return pystr;
+			}
+			i = (i + 1) & mask;
+		}
+	}
+
+	// Create string.
+	pystr = PyString_FromStringAndSize(str, len);
+	if (pystr == NULL || interns->used >= interns->max) {
+		return pystr;
+	}
+
+	// Intern string. Failing to grow the table is not an error because the
+	// string does not need to be interned.
+	// .. NOTE: Slots are grown once they are half full to keep probe sequences
+	//    short.
+	if ((interns->used + 1) * 2 > interns->size && !intern_grow(interns)) {
+		return pystr;
+	}
+	mask = interns->size - 1;
+	i = (size_t)hash & mask;
+	while (interns->slots[i].str != NULL) {
+		i = (i + 1) & mask;
+	}
+	Py_INCREF(pystr);
+	interns->slots[i].str = pystr;
+	interns->slots[i].hash = hash;
+	interns->used += 1;
+	return pystr;
+}
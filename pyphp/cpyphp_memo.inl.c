@@ -0,0 +1,162 @@
+/**
+This module contains a pointer hash table used to memoize values that have
+already been converted between Python and PHP. All of the functions defined
+within this module are meant to be local (static) to the including module so
+that the exported namespace is not poluted.
+
+:Authors: Caleb P. Burns <cpburnz@gmail.com>; Ben DeMott <ben_demott@hotmail.com>
+:Version: 0.5
+:Status: Development
+:Date: 2026-10-17
+*/
+
+#include <stdbool.h> // bool, false, true
+#include <stddef.h> // NULL, size_t
+#include <stdlib.h> // calloc, free
+
+// The initial number of slots allocated by a memo (must be a power of 2).
+#define MEMO_INIT_SIZE 64
+
+/**
+The ``memo_entry_t`` struct is a slot in a memo. An empty slot has a ``NULL``
+key.
+*/
+struct memo_entry_t {
+	const void * key; // borrowed
+	void * value; // borrowed
+};
+
+/**
+The ``memo_t`` struct maps raw pointers to raw pointers using open addressing
+with linear probing. The slots are not allocated until the first value is set
+so a memo is free for conversions which never encounter a container.
+*/
+struct memo_t {
+	struct memo_entry_t * slots; // owned
+	size_t size;
+	size_t used;
+};
+
+/**
+Returns the hash for the specified pointer.
+
+*key* (``const void *``) is the pointer.
+
+Returns the hash (``size_t``).
+*/
+static size_t memo_hash(const void * key) {
+	size_t h = (size_t)key;
+	// Allocations are aligned so the low bits carry no information. Mix the
+	// high bits down so that neighboring allocations spread across the slots.
+	h ^= h >> 4;
+	h ^= h >> 16;
+	return h;
+}
+
+/**
+Initializes the specified memo.
+
+*memo* (``struct memo_t *``) is the memo.
+*/
+static void memo_init(struct memo_t * memo) {
+	memo->slots = NULL;
+	memo->size = 0;
+	memo->used = 0;
+}
+
+/**
+Releases the slots of the specified memo.
+
+*memo* (``struct memo_t *``) is the memo.
+*/
+static void memo_free(struct memo_t * memo) {
+	if (memo->slots != NULL) {
+		free(memo->slots);
+	}
+	memo_init(memo);
+}
+
+/**
+Gets the value mapped to the specified pointer.
+
+*memo* (``struct memo_t *``) is the memo.
+
+*key* (``const void *``) is the pointer.
+
+Returns the mapped value (``void *``) if found; otherwise, ``NULL``.
+*/
+static void * memo_get(struct memo_t * memo, const void * key) {
+	size_t mask;
+	size_t i;
+
+	if (memo->used == 0) {
+		return NULL;
+	}
+	mask = memo->size - 1;
+	i = memo_hash(key) & mask;
+	while (memo->slots[i].key != NULL) {
+		if (memo->slots[i].key == key) {
+			return memo->slots[i].value;
+		}
+		i = (i + 1) & mask;
+	}
+	return NULL;
+}
+
+/**
+Maps the specified pointer to the specified value.
+
+*memo* (``struct memo_t *``) is the memo.
+
+*key* (``const void *``) is the pointer. This cannot be ``NULL``.
+
+*value* (``void *``) is the value.
+
+Returns ``true`` on success; otherwise, ``false`` if the slots could not be
+allocated.
+*/
+static bool memo_set(struct memo_t * memo, const void * key, void * value) {
+	size_t mask;
+	size_t i;
+
+	// Grow the slots once they are half full to keep probe sequences short.
+	if ((memo->used + 1) * 2 > memo->size) {
+		struct memo_entry_t * old_slots = memo->slots; // owned
+		size_t old_size = memo->size;
+		size_t j;
+
+		memo->size = old_size ? old_size * 2 : MEMO_INIT_SIZE;
+		memo->slots = calloc(memo->size, sizeof(struct memo_entry_t));
+		if (memo->slots == NULL) {
+			memo->slots = old_slots;
+			memo->size = old_size;
+			return false;
+		}
+		mask = memo->size - 1;
+		for (j = 0; j < old_size; ++j) {
+			if (old_slots[j].key != NULL) {
+				i = memo_hash(old_slots[j].key) & mask;
+				while (memo->slots[i].key != NULL) {
+					i = (i + 1) & mask;
+				}
+				memo->slots[i] = old_slots[j];
+			}
+		}
+		if (old_slots != NULL) {
+			free(old_slots);
+		}
+	}
+
+	// Find either the existing slot for the key or the first empty one.
+	mask = memo->size - 1;
+	i = memo_hash(key) & mask;
+	while (memo->slots[i].key != NULL && memo->slots[i].key != key) {
+		i = (i + 1) & mask;
+	}
+	if (memo->slots[i].key == NULL) {
+		memo->slots[i].key = key;
+		memo->used += 1;
+	}
+	memo->slots[i].value = value;
+	return true;
+}
@@ -6,17 +6,16 @@ PyPHP is a python module written in C that embeds the PHP interpreter.
 :Status: Development
 :Date: 2012-06-11 
 
-.. TODO: IMPLEMENT THIS TONIGHT. Both zend_execute_scripts() and
-   zend_eval_stringl() accept an argument for getting the return value.
-
-.. TODO: In the next verion (0.6?) release python GIL while PHP API calls are
-   being made. ``PyEval_SaveThread()`` can be used to save the thread state
-   and release the GIL. The GIL can be re-acquired and thread state restored
-   with ``PyEval_RestoreThread()``. By intermixing these calls the GIL can be
-   released right before a PHP API call starts, acquired when Python code is
+.. NOTE: The python GIL is released while PHP API calls are being made.
+   ``PyEval_SaveThread()`` is used to save the thread state and release the
+   GIL. The GIL is re-acquired and thread state restored with
+   ``PyEval_RestoreThread()``. By intermixing these calls the GIL is released
+   right before a PHP API call starts, acquired when Python code is
    encountered during the call (i.e., output, logging, errors, etc.), released
    when returning to PHP, and finally re-acquired after the end of the PHP
-   call.
+   call. Access to each interpreter is serialized between Python threads by
+   the interpreter lock. When PHP is thread-safe (ZTS), separate interpreters
+   each have their own TSRM context so they can execute PHP at the same time.
 */
 
 // TODO: Where are FAILURE and SUCCESS defined?
@@ -25,31 +24,82 @@ PyPHP is a python module written in C that embeds the PHP interpreter.
 #define PY_SSIZE_T_CLEAN
 
 #include <Python.h> // Py*, PY*
+#include <pythread.h> // PyThread_*
+#include <structmember.h> // PyMemberDef, READONLY, T_OBJECT
 
-#include <limits.h> // INT_MAX
+#include <limits.h> // INT_MAX, LONG_MAX, *_MAX, *_MIN
 #include <stdarg.h> // va_list
 #include <stdbool.h> // bool, false, true
 #include <stddef.h> // NULL
 #include <stdio.h> // FILE, fdopen, fflush, fopen, fputc, fputs, stdout
+#include <string.h> // memcmp, memcpy, memset, strlen
+#include <sys/stat.h> // fstat, S_ISREG
 
 #include <sapi/embed/php_embed.h> // sapi_module_struct, php*
 #include <main/spprintf.h> // spprintf, vspprintf
 #include <Zend/zend_API.h> // array_init, array_init_size
+#include <Zend/zend_compile.h> // destroy_op_array, zend_op_array
 #include <Zend/zend_globals_macros.h> // EG
 #include <Zend/zend_hash.h> // zend_hash_*, zend_symtable_*
 #include <Zend/zend_errors.h> // E_*
+#include <Zend/zend_exceptions.h> // zend_exception_error
+#include <Zend/zend_execute.h> // zend_execute, zend_rebuild_symbol_table
 #include <Zend/zend_ini.h> // zend_alter_ini_entry, zend_ini_*
 #include <Zend/zend_modules.h> // zend_module_entry
 
+#ifdef HAVE_MMAP
+# include <fcntl.h> // O_RDONLY, open
+# include <sys/mman.h> // MAP_*, PROT_READ, mmap, munmap
+# include <unistd.h> // _SC_PAGESIZE, close, sysconf
+#endif
+
+#include "cpyphp_intern.inl.c" // INTERN_MAX_LENGTH, intern_clear, intern_get, intern_hash, intern_init, intern_t
+#include "cpyphp_memo.inl.c" // memo_free, memo_get, memo_init, memo_set, memo_t
+#include "cpyphp_serialize.inl.c" // serialize_to_string, unserialize_from_string
 #include "cpyphp_zval.inl.c" // zval_copy, zval_del, zval_from_*, zval_is_list, zval_to_*
 
 // Shorten print format macros.
 #define PY_Z PY_FORMAT_SIZE_T
 
-static struct pyphp_t {
-	bool is_inited;
+// The number of frames the work stack of a conversion starts with before it
+// is moved to the heap.
+#define PYPHP_STACK_INIT 32
+
+// The default maximum nesting depth of a conversion.
+#define PYPHP_MAX_DEPTH 100000
+
+// Thread-local storage class.
+#ifdef ZTS
+# ifdef _MSC_VER
+#  define PYPHP_TLS __declspec(thread)
+# else
+#  define PYPHP_TLS __thread
+# endif
+#else
+# define PYPHP_TLS
+#endif
+
+// The state of a PHP interpreter.
+struct pyphp_interp_t {
 	bool is_started;
 	
+	// Persistent request depth. While this is greater than 0, PHP is not
+	// restarted after each execution.
+	unsigned int request_depth;
+	
+	// The current request ID. This is incremented whenever PHP is shutdown so
+	// that values allocated within a request can be identified as stale.
+	unsigned long request_id;
+	
+	// The number of buffers exported by ``PhpBytes`` views which point into the
+	// memory of the current request. The request cannot end while this is
+	// greater than 0.
+	unsigned long bytes_exports;
+	
+	// Whether PHP must be restarted before it is used again because a restart
+	// was refused while buffers were exported.
+	bool restart_pending;
+	
 	// Output file pointers.
 	FILE * err_fp;
 	FILE * log_fp;
@@ -60,14 +110,218 @@ static struct pyphp_t {
 	PyObject * pylog_cb;
 	PyObject * pyout_cb;
 	
-	// Python thread state.
-	// .. NOTE: This not implemented.
-	//PyThreadSafe * pysave;
+	// Python thread state saved while the GIL is released during PHP calls.
+	PyThreadState * pysave;
+	
+	// The lock serializing access to PHP between Python threads, the thread
+	// that owns it, and how many times the owner has acquired it.
+	PyThread_type_lock lock;
+	long lock_owner;
+	unsigned int lock_depth;
+	
+	// Function call cache mapping function name (``char *``) to resolved
+	// function (``struct pyphp_fcall_entry_t``).
+	// .. NOTE: The resolved functions are only valid within the PHP request so
+	//    the cache is cleared whenever PHP is restarted.
+	HashTable * fcall_cache;
+	
+	// The strings interned across conversions from PHP to Python. This is
+	// disabled while its maximum size is 0.
+	struct intern_t interns;
+	
+	// The maximum nesting depth of a conversion between Python and PHP. This is
+	// unlimited while it is 0.
+	unsigned long max_depth;
+	
+	#ifdef ZTS
+	// The TSRM interpreter context which holds the PHP globals of the
+	// interpreter.
+	void * ctx;
+	#endif
+};
+
+static struct pyphp_t {
+	bool is_inited;
+	
+	// The main interpreter. PHP is initialized with this interpreter and it is
+	// the only interpreter when PHP is not thread-safe (ZTS).
+	struct pyphp_interp_t main;
 	
 	// Interal PHP error handler.
 	void (* php_internal_error_cb)(int type, const char * file, const unsigned int line, const char * format, va_list args) ZEND_ATTRIBUTE_PTR_FORMAT(printf, 4, 0);
 } pyphp;
 
+// A property of the shape of a PHP class.
+struct pyphp_shape_prop_t {
+	// The hash and length (including the NULL byte) of the property name.
+	ulong h;
+	uint nKeyLength;
+	
+	// The python key (owned), or NULL if the property is not public.
+	PyObject * pykey;
+};
+
+// The shape of a PHP class: the properties of its objects in order.
+struct pyphp_shape_t {
+	// The next shape of the conversion (owned).
+	struct pyphp_shape_t * next;
+	
+	// The properties (owned).
+	struct pyphp_shape_prop_t * props;
+	size_t count;
+};
+
+// The state shared by the values of one conversion from PHP to Python.
+struct pyphp_conv_t {
+	// The memo mapping the hash tables of php arrays and objects
+	// (``HashTable *``) to python values (``PyObject *``).
+	struct memo_t memo;
+	
+	// The memo mapping php classes (``zend_class_entry *``) to their shapes
+	// (``struct pyphp_shape_t *``), and the list owning the shapes.
+	struct memo_t shapes;
+	struct pyphp_shape_t * shape_list;
+	
+	// The strings interned by this conversion. This either points to the
+	// interpreter's intern table or to *interns_tmp*.
+	struct intern_t * interns;
+	struct intern_t interns_tmp;
+};
+
+// A frame of the work stack converting a Python container to a PHP array.
+struct pyphp_p2z_frame_t {
+	// The python container (borrowed).
+	PyObject * pyobj;
+	
+	// The python container as a list or tuple (owned), or NULL.
+	PyObject * pyfast;
+	
+	// The iterator over the python container (owned), or NULL. Neither this
+	// nor *pyfast* is set for a dict.
+	PyObject * pyiter;
+	
+	// Whether the items of the container may be freed before the conversion
+	// finishes (i.e., they are streamed from *pyiter*).
+	bool transient;
+	
+	// The php array being filled (borrowed).
+	zval * zarray;
+	
+	// The position of the next item.
+	Py_ssize_t pos;
+};
+
+// A frame of the work stack converting a PHP array to a Python list or dict,
+// or a PHP object to a Python dict.
+struct pyphp_z2p_frame_t {
+	// The php array or object (borrowed).
+	zval * zarray;
+	
+	// The elements of the php array, or the properties of the php object
+	// (borrowed).
+	HashTable * ht;
+	
+	// The next element of the php array and its position (borrowed).
+	Bucket * p;
+	ulong index;
+	
+	// The number of elements in the php array.
+	ulong len;
+	
+	// The shape of the class of the php object (borrowed), or NULL.
+	struct pyphp_shape_t * shape;
+	
+	// The python list (owned) while the keys are list indices; otherwise, NULL.
+	PyObject * pylist;
+	
+	// The python dict (owned) once a key is not a list index; otherwise, NULL.
+	PyObject * pydict;
+};
+
+// A frame of the work stack encoding a PHP array or object as JSON.
+struct pyphp_json_frame_t {
+	// The elements of the php array, or the properties of the php object
+	// (borrowed).
+	HashTable * ht;
+	
+	// The next element of the php array and its position (borrowed).
+	Bucket * p;
+	ulong index;
+	
+	// The number of elements in the php array.
+	ulong len;
+	
+	// Whether the php array is encoded as a JSON array.
+	bool is_list;
+	
+	// Whether the php value is an object.
+	bool is_object;
+};
+
+// The interpreter entered by the current thread (see ``pyphp_enter()``).
+static PYPHP_TLS struct pyphp_interp_t * pyphp_interp = NULL;
+
+// The Python interpreter object.
+typedef struct {
+	PyObject_HEAD
+	
+	// The interpreter state.
+	struct pyphp_interp_t * interp;
+} InterpreterObject;
+
+// A function call cache entry.
+struct pyphp_fcall_entry_t {
+	// The function name.
+	zval * zname;
+	
+	// The resolved function.
+	zend_fcall_info_cache fcc;
+};
+
+// The fingerprint of a global variable taken before a script is executed.
+// This is a shallow snapshot: the value is not referenced (which would make
+// PHP separate it before every change), so the pointers are only compared
+// and never followed.
+struct pyphp_global_fp_t {
+	// The value of the variable (borrowed, may be freed by the script).
+	zval * zv;
+	zend_uint refcount;
+	zend_uchar type;
+	zend_bool is_ref;
+	
+	// The contents of the value: the long (null, boolean, long and resource),
+	// the double, the string pointer and length, the array pointer and element
+	// count, or the object handle and handlers.
+	long lval;
+	double dval;
+	char * str;
+	int len;
+	HashTable * ht;
+	uint count;
+	zend_object_handle handle;
+	zend_object_handlers * handlers;
+};
+
+// A global variable got or set in a batch.
+struct pyphp_global_t {
+	// The name of the variable (borrowed).
+	const char * key;
+	int keylen;
+	
+	// The value of the variable: borrowed when got, and owned until it is set.
+	zval * zv;
+};
+
+// A key of a path through nested global arrays.
+struct pyphp_path_key_t {
+	// The string key (borrowed), or NULL if the key is an index.
+	const char * key;
+	int keylen;
+	
+	// The index when *key* is NULL.
+	long index;
+};
+
 
 /**************************** Python Exceptions *****************************/
 
@@ -97,21 +351,212 @@ static PyObject * PhpFatalErrorType = NULL;
 /***************************** Utility Methods ******************************/
 
 /**
-Converts a Python value to a PHP value.
+Determines whether the specified unicode string only contains ASCII
+characters.
 
-*pyobj* (``PyObject *``) is the python value.
+*str* (``const Py_UNICODE *``) is the unicode string.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+Returns ``true`` if *str* is ASCII; otherwise, ``false``.
+*/
+static bool unicode_is_ascii(const Py_UNICODE * str, Py_ssize_t len) {
+	Py_ssize_t i = 0;
+	Py_ssize_t j = 0;
+	Py_ssize_t end = 0;
+	Py_UNICODE bits = 0;
+	
+	// The characters are OR'ed together in blocks without branching so that the
+	// compiler can vectorize the inner loop, while still stopping early at the
+	// first block with a non-ASCII character.
+	for (i = 0; i < len; i = end) {
+		end = len - i > 64 ? i + 64 : len;
+		for (j = i; j < end; ++j) {
+			bits |= str[j];
+		}
+		if (bits >= 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+Encodes the specified unicode string as UTF-8.
+
+*str* (``const Py_UNICODE *``) is the unicode string.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+*buf* (``char *``) optionally is the buffer to encode into if it is large
+enough. This can be ``NULL``.
+
+*bufsize* (``size_t``) is the size of *buf*.
+
+*utf8_len* (``int *``) will be set to the length of the encoded string.
+
+Returns the encoded string (``char *``) terminated by a NULL byte. This is
+*buf* if it was large enough; otherwise, this is allocated with ``emalloc()``
+and must be freed with ``efree()``.
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static char * unicode_to_utf8(const Py_UNICODE * str, Py_ssize_t len, char * buf, size_t bufsize, int * utf8_len) {
+	/*
+	.. NOTE: This function is derived from ``PyUnicode_EncodeUTF8()`` in
+	   ``Python-2.7/Objects/unicodeobject.c`` so that surrogates are encoded
+	   the same way.
+	*/
+	Py_ssize_t i = 0;
+	Py_ssize_t size = 0;
+	Py_UCS4 ch = 0;
+	char * utf8 = NULL; // owned
+	char * p = NULL; // borrowed
+	
+	// Count the encoded length.
+	if (unicode_is_ascii(str, len)) {
+		size = len;
+	} else {
+		for (i = 0; i < len; ++i) {
+			ch = str[i];
+			if (ch < 0x80) {
+				size += 1;
+			} else if (ch < 0x800) {
+				size += 2;
+			} else if (ch < 0x10000) {
+				// Encode a surrogate pair as one 4-byte character.
+				if (0xD800 <= ch && ch <= 0xDBFF && i + 1 < len && 0xDC00 <= str[i + 1] && str[i + 1] <= 0xDFFF) {
+					size += 4;
+					++i;
+				} else {
+					size += 3;
+				}
+			} else {
+				size += 4;
+			}
+		}
+	}
+	if (INT_MAX < size) {
+		PyErr_Format(PyExc_ValueError, "UTF-8 length:%" PY_Z "i must be between 0 and %i inclusive.", size, INT_MAX);
+		return NULL;
+	}
+	
+	// Allocate the encoded string unless it fits in the buffer.
+	if (buf != NULL && (size_t)size < bufsize) {
+		utf8 = buf;
+	} else {
+		utf8 = emalloc((size_t)size + 1);
+		if (utf8 == NULL) {
+			PyErr_NoMemory();
+			return NULL;
+		}
+	}
+	
+	// Encode the string.
+	p = utf8;
+	if (size == len) {
+		// Every character is ASCII so only narrow them.
+		for (i = 0; i < len; ++i) {
+			p[i] = (char)str[i];
+		}
+		p += len;
+	} else {
+		for (i = 0; i < len; ++i) {
+			ch = str[i];
+			if (ch < 0x80) {
+				*p++ = (char)ch;
+			} else if (ch < 0x800) {
+				*p++ = (char)(0xC0 | (ch >> 6));
+				*p++ = (char)(0x80 | (ch & 0x3F));
+			} else {
+				if (0xD800 <= ch && ch <= 0xDBFF && i + 1 < len && 0xDC00 <= str[i + 1] && str[i + 1] <= 0xDFFF) {
+					ch = (((ch & 0x3FF) << 10) | (str[i + 1] & 0x3FF)) + 0x10000;
+					++i;
+				}
+				if (ch < 0x10000) {
+					*p++ = (char)(0xE0 | (ch >> 12));
+					*p++ = (char)(0x80 | ((ch >> 6) & 0x3F));
+					*p++ = (char)(0x80 | (ch & 0x3F));
+				} else {
+					*p++ = (char)(0xF0 | (ch >> 18));
+					*p++ = (char)(0x80 | ((ch >> 12) & 0x3F));
+					*p++ = (char)(0x80 | ((ch >> 6) & 0x3F));
+					*p++ = (char)(0x80 | (ch & 0x3F));
+				}
+			}
+		}
+	}
+	*p = '\0';
+	*utf8_len = (int)size;
+	return utf8;
+}
+
+/**
+Grows the work stack of a conversion.
+
+*frames* (``void **``) is the stack. This is updated to the grown stack.
+
+*local* (``void *``) is the initial stack which is not allocated on the heap.
+
+*size* (``size_t *``) is the number of frames in the stack. This is updated to
+the grown size.
+
+*itemsize* (``size_t``) is the size of a frame.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool pyphp_stack_grow(void ** frames, void * local, size_t * size, size_t itemsize) {
+	void * grown = NULL; // owned
+	
+	if (*size > (size_t)PY_SSIZE_T_MAX / 2 / itemsize) {
+		PyErr_NoMemory();
+		return false;
+	}
+	grown = PyMem_Malloc(*size * 2 * itemsize);
+	if (grown == NULL) {
+		PyErr_NoMemory();
+		return false;
+	}
+	memcpy(grown, *frames, *size * itemsize);
+	if (*frames != local) {
+		PyMem_Free(*frames);
+	}
+	*frames = grown;
+	*size *= 2;
+	return true;
+}
+
+/**
+Checks whether another level of nesting can be converted.
+
+*depth* (``size_t``) is the current nesting depth.
+
+Returns ``true`` if it can; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool pyphp_depth_check(size_t depth) {
+	if (pyphp_interp->max_depth > 0 && depth >= pyphp_interp->max_depth) {
+		PyErr_Format(PyExc_ValueError, "Maximum nesting depth:%lu exceeded.", pyphp_interp->max_depth);
+		return false;
+	}
+	return true;
+}
+
+/**
+Converts a Python scalar value to a PHP value.
+
+*pyobj* (``PyObject *``) is the python value. This cannot be a container (see
+``PyObject_is_container()``).
 
 .. NOTE: If this is a ``PyUnicodeObject``, the resulting PHP value will
    contain a UTF-8 encoded string.
 
-*pymemo* (``PyObject *``) is a memo dictionary of objects already copied. This
-is used internally by this method so it should be set to ``NULL``.
-
 Returns the new PHP value (``zval *``).
 
 .. NOTE: If the return value is ``NULL``, a Python exception has been raised.
 */
-static zval * PyObject_to_zval(PyObject * pyobj, PyObject * pymemo) {
+static zval * PyObject_to_zval_scalar(PyObject * pyobj) {
 	if (pyobj == NULL) {
 		PyErr_Format(InternalErrorType, "Python object:%p is NULL.", (void *)pyobj);
 		return NULL;
@@ -206,74 +651,213 @@ static zval * PyObject_to_zval(PyObject * pyobj, PyObject * pymemo) {
 		
 	} else if (PyUnicode_Check(pyobj)) {
 		zval * zv = NULL; // owned
-		PyObject * pystr = NULL; // owned
-		Py_ssize_t pylen;
+		char * str = NULL; // owned
+		int len = 0;
 		// Convert python unicode string to php string encoded as utf-8.
-		pystr = PyUnicode_AsUTF8String(pyobj);
-		if (pystr != NULL) {
-			pylen = PyString_GET_SIZE(pystr);
-			if (pylen < 0 || INT_MAX < pylen) {
-				PyErr_Format(PyExc_ValueError, "Python object:%s length:%" PY_Z "i must be between 0 and %i.", Py_TYPE(pyobj)->tp_name, pylen, INT_MAX);
-			} else {
-				zv = zval_from_string(PyString_AS_STRING(pystr), (int)pylen);
-				if (zv == NULL) {
-					PyObject * repr = PyObject_Repr(pyobj);
-					if (repr != NULL) {
-						PyErr_Format(InternalErrorType, "Failed to convert Python object:%s to PHP string.", PyString_AS_STRING(repr));
-						Py_DECREF(repr);
-					}
+		// .. NOTE: The string is encoded directly into the memory owned by the
+		//    php string.
+		str = unicode_to_utf8(PyUnicode_AS_UNICODE(pyobj), PyUnicode_GET_SIZE(pyobj), NULL, 0, &len);
+		if (str != NULL) {
+			zv = zval_from_estring(str, len);
+			if (zv == NULL) {
+				PyObject * repr = PyObject_Repr(pyobj);
+				efree(str);
+				if (repr != NULL) {
+					PyErr_Format(InternalErrorType, "Failed to convert Python object:%s to PHP string.", PyString_AS_STRING(repr));
+					Py_DECREF(repr);
 				}
 			}
-			Py_DECREF(pystr);
 		}
 		return zv;
 		
-	} else if (PyDict_Check(pyobj)) {
-		bool pymemo_is_tmp = false;
-		Py_ssize_t pylen = 0;
-		Py_ssize_t pypos = 0;
-		Py_ssize_t keylen = 0;
-		const char * key = NULL; // borrowed
-		zval * zdict = NULL; // owned
-		zval * zv = NULL; // owned
-		PyObject * pyptr = NULL; // borrowed
-		PyObject * pykey = NULL; // borrowed
-		PyObject * pyval = NULL; // borrowed
-		PyObject * pyptr_tmp = NULL; // owned
-		PyObject * pykey_tmp = NULL; // owned
-		PyObject * pyval_tmp = NULL; // owned
-	
-		// Make sure the dict is small enough.
+	}
+	
+	// Python object not supported.
+	PyErr_Format(PyExc_TypeError, "Python type:%s cannot be converted to a PHP value.", Py_TYPE(pyobj)->tp_name);
+	return NULL;
+}
+
+/**
+Determines whether the specified Python value is a container (``dict``,
+sequence, or iterator) which is converted to a PHP array.
+
+*pyobj* (``PyObject *``) is the python value.
+
+Returns ``true`` if *pyobj* is a container; otherwise, ``false``.
+*/
+static bool PyObject_is_container(PyObject * pyobj) {
+	return PyDict_Check(pyobj) || (!PyString_Check(pyobj) && !PyUnicode_Check(pyobj) && PySequence_Check(pyobj)) || PyIter_Check(pyobj);
+}
+
+/**
+Initializes the frame for converting a Python container to a PHP array.
+
+*f* (``struct pyphp_p2z_frame_t *``) is the frame.
+
+*pyobj* (``PyObject *``) is the python container.
+
+*memo* (``struct memo_t *``) is the memo.
+
+Returns the new, empty PHP array (``zval *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static zval * pyphp_p2z_frame_init(struct pyphp_p2z_frame_t * f, PyObject * pyobj, struct memo_t * memo) {
+	Py_ssize_t pylen = 0;
+	zval * zarray = NULL; // owned
+	
+	f->pyobj = pyobj;
+	f->pyfast = NULL;
+	f->pyiter = NULL;
+	f->pos = 0;
+	
+	if (PyDict_Check(pyobj)) {
 		pylen = PyDict_Size(pyobj);
-		if (pylen < 0 || INT_MAX < pylen) {
-			PyErr_Format(PyExc_ValueError, "Python object:%s length:%" PY_Z "i must be between 0 and %i inclusive.", Py_TYPE(pyobj)->tp_name, pylen, INT_MAX);
+	} else if (PyList_Check(pyobj) || PyTuple_Check(pyobj)) {
+		// Access the items of lists and tuples directly.
+		f->pyfast = PySequence_Fast(pyobj, "");
+		if (f->pyfast == NULL) {
 			return NULL;
 		}
-	
-		// Initialize PHP array.
-		MAKE_STD_ZVAL(zdict);
-		if (zdict == NULL) {
-			PyErr_Format(InternalErrorType, "Failed to create zval.");
+		pylen = PySequence_Fast_GET_SIZE(f->pyfast);
+	} else {
+		// Stream the items of other sequences, iterators and generators
+		// instead of copying them into a temporary list.
+		f->pyiter = PyObject_GetIter(pyobj);
+		if (f->pyiter == NULL) {
+			// Override exception.
+			PyObject * repr = PyObject_Repr(pyobj);
+			if (repr != NULL) {
+				PyErr_Format(PyExc_TypeError, "Failed to convert Python object:%s to list.", PyString_AS_STRING(repr));
+				Py_DECREF(repr);
+			}
 			return NULL;
 		}
-		if (array_init(zdict) != SUCCESS) {
-			PyErr_Format(InternalErrorType, "Failed to initialize zval array.");
-			goto dict_error;
-		}
 		
-		// Create memo dict if we don't have one.
-		if (pymemo == NULL) {
-			pymemo = PyDict_New();
-			if (pymemo == NULL) {
-				goto dict_error;
-			}
-			pymemo_is_tmp = true;
+		// Size the PHP array using the length hint. The array grows as needed
+		// if the hint is wrong.
+		pylen = _PyObject_LengthHint(pyobj, 0);
+		if (pylen < 0) {
+			goto frame_error;
+		} else if (INT_MAX < pylen) {
+			pylen = 0;
 		}
+	}
+	
+	// Make sure the container is small enough.
+	if (pylen < 0 || INT_MAX < pylen) {
+		PyErr_Format(PyExc_ValueError, "Python object:%s length:%" PY_Z "i must be between 0 and %i inclusive.", Py_TYPE(pyobj)->tp_name, pylen, INT_MAX);
+		goto frame_error;
+	}
+	
+	// Initialize PHP array.
+	MAKE_STD_ZVAL(zarray);
+	if (zarray == NULL) {
+		PyErr_Format(InternalErrorType, "Failed to create zval.");
+		goto frame_error;
+	}
+	if (array_init_size(zarray, (unsigned int)pylen) != SUCCESS) {
+		PyErr_Format(InternalErrorType, "Failed to initialize zval array.");
+		goto frame_error;
+	}
+	
+	// Map python container pointer to php array pointer before converting the
+	// values to support recursion.
+	if (!memo_set(memo, pyobj, zarray)) {
+		PyErr_NoMemory();
+		goto frame_error;
+	}
+	
+	// The items of an iterator may be freed as soon as they are converted,
+	// before the top-level conversion finishes.
+	f->transient = f->pyiter != NULL;
+	f->zarray = zarray;
+	return zarray;
+	
+	frame_error: {
+		if (zarray != NULL) {
+			zval_del(&zarray);
+		}
+		Py_CLEAR(f->pyfast);
+		Py_CLEAR(f->pyiter);
+	}
+	return NULL;
+}
+
+/**
+Converts a Python value to a PHP value.
+
+*pyobj* (``PyObject *``) is the python value.
+
+.. NOTE: If this is a ``PyUnicodeObject``, the resulting PHP value will
+   contain a UTF-8 encoded string.
+
+*memo* (``struct memo_t *``) optionally is the memo of containers already
+copied to share between conversions. This can be ``NULL``.
+
+Returns the new PHP value (``zval *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static zval * PyObject_to_zval(PyObject * pyobj, struct memo_t * memo) {
+	/*
+	.. NOTE: Containers are converted iteratively with an explicit stack of
+	   frames instead of recursively so that deeply nested values cannot
+	   overflow the C stack. The stack starts out local and is moved to the
+	   heap when it is outgrown.
+	*/
+	bool memo_is_tmp = false;
+	struct memo_t memo_tmp;
+	struct pyphp_p2z_frame_t frames_local[PYPHP_STACK_INIT];
+	struct pyphp_p2z_frame_t * frames = frames_local; // owned
+	struct pyphp_p2z_frame_t * f = NULL; // borrowed
+	size_t frames_size = PYPHP_STACK_INIT;
+	size_t depth = 0;
+	size_t i = 0;
+	Py_ssize_t keylen = 0;
+	const char * key = NULL; // borrowed
+	int utf8len = 0;
+	char * utf8 = NULL; // owned
+	char utf8buf[256];
+	zval * zresult = NULL; // owned
+	zval * zv = NULL; // owned
+	PyObject * pykey = NULL; // borrowed
+	PyObject * pyval = NULL; // borrowed
+	PyObject * pyitem = NULL; // owned
+	PyObject * pykey_tmp = NULL; // owned
+	PyObject * pykeep = NULL; // owned
+	
+	// Convert scalar directly.
+	if (pyobj == NULL || !PyObject_is_container(pyobj)) {
+		return PyObject_to_zval_scalar(pyobj);
+	}
+	
+	// Create memo if we don't have one.
+	if (memo == NULL) {
+		memo_init(&memo_tmp);
+		memo = &memo_tmp;
+		memo_is_tmp = true;
+	}
+	
+	// Start with the top-level container.
+	zresult = pyphp_p2z_frame_init(&frames[0], pyobj, memo);
+	if (zresult == NULL) {
+		goto convert_error;
+	}
+	depth = 1;
+	
+	// Iterate over the python containers, convert python values into PHP
+	// values and add them to the PHP arrays.
+	while (depth > 0) {
+		f = &frames[depth - 1];
 		
-		// Iterate over python dict, convert python key-value pairs into PHP key
-		// value pairs and append them to the PHP array.
-		while (PyDict_Next(pyobj, &pypos, &pykey, &pyval)) {
-		
+		// Get next python value, or finish the container.
+		if (PyDict_Check(f->pyobj)) {
+			if (!PyDict_Next(f->pyobj, &f->pos, &pykey, &pyval)) {
+				--depth;
+				continue;
+			}
+			
 			// Get python key string.
 			if (pykey == Py_None || pykey == Py_False) {
 				// In PHP both `null` and `false` become empty strings when casted.
@@ -283,265 +867,409 @@ static zval * PyObject_to_zval(PyObject * pyobj, PyObject * pymemo) {
 				if (PyString_Check(pykey)) {
 					key = PyString_AS_STRING(pykey);
 					keylen = PyString_GET_SIZE(pykey);
-				} else {
-					if (PyUnicode_Check(pykey)) {
-						pykey_tmp = PyUnicode_AsUTF8String(pykey);
-					} else {
-						pykey_tmp = PyObject_Str(pykey);
+				} else if (PyUnicode_Check(pykey)) {
+					// Encode unicode key as utf-8 on the stack when it fits.
+					utf8 = unicode_to_utf8(PyUnicode_AS_UNICODE(pykey), PyUnicode_GET_SIZE(pykey), utf8buf, sizeof(utf8buf), &utf8len);
+					if (utf8 == NULL) {
+						goto convert_error; // Clean up.
 					}
+					key = utf8;
+					keylen = utf8len;
+				} else {
+					pykey_tmp = PyObject_Str(pykey);
 					if (pykey_tmp == NULL) {
-						goto dict_error; // Clean up.
+						goto convert_error; // Clean up.
 					}
 					key = PyString_AS_STRING(pykey_tmp);
 					keylen = PyString_GET_SIZE(pykey_tmp);
 				}
 				if (keylen < 0 || INT_MAX < keylen) {
-					PyErr_Format(InternalErrorType, "Python key:%s length:%" PY_Z "i must be between 0 and %i inclusive.", Py_TYPE(pykey)->tp_name, keylen, INT_MAX);
-					goto dict_error; // Clean up.
+					PyErr_Format(PyExc_ValueError, "Python key:%s length:%" PY_Z "i must be between 0 and %i inclusive.", Py_TYPE(pykey)->tp_name, keylen, INT_MAX);
+					goto convert_error; // Clean up.
 				}
 			}
-			
-			// Convert python value to php value.
-			// - The memo dict maps python value pointer to php value pointer.
-			pyval_tmp = PyLong_FromVoidPtr(pyval);
-			if (pyval_tmp == NULL) {
-				goto dict_error; // Clean up.
-			}
-			pyptr = PyDict_GetItem(pymemo, pyval_tmp);
-			if (pyptr != NULL) {
-				// Get mapped php value pointer from python value pointer.
-				zv = PyLong_AsVoidPtr(pyptr);
-				if (zv == NULL) {
-					goto dict_error; // Clean up.
+		} else if (f->pyfast != NULL) {
+			if (f->pos >= PySequence_Fast_GET_SIZE(f->pyfast)) {
+				Py_CLEAR(f->pyfast);
+				--depth;
+				continue;
+			}
+			pyval = PySequence_Fast_ITEMS(f->pyfast)[f->pos];
+			f->pos += 1;
+		} else {
+			pyitem = PyIter_Next(f->pyiter);
+			if (pyitem == NULL) {
+				if (PyErr_Occurred() != NULL) {
+					goto convert_error; // Clean up.
 				}
-			} else {
-				zv = PyObject_to_zval(pyval, pymemo);
-				if (zv == NULL) {
-					goto dict_error; // Clean up.
+				Py_CLEAR(f->pyiter);
+				--depth;
+				continue;
+			}
+			pyval = pyitem;
+			f->pos += 1;
+		}
+		
+		// Convert python value to php value.
+		// - The memo maps python container pointers to php value pointers.
+		zv = memo_get(memo, pyval);
+		if (zv != NULL) {
+			Z_ADDREF_P(zv);
+		} else if (PyObject_is_container(pyval)) {
+			// Start converting the container after its php array is set.
+			if (!pyphp_depth_check(depth)) {
+				goto convert_error; // Clean up.
+			}
+			if (depth == frames_size) {
+				if (!pyphp_stack_grow((void **)&frames, frames_local, &frames_size, sizeof(*frames))) {
+					goto convert_error; // Clean up.
 				}
-				// Map python value pointer to php value pointer to support recursion.
-				pyptr_tmp = PyLong_FromVoidPtr(zv);
-				if (pyptr_tmp == NULL) {
-					goto dict_error; // Clean up.
+				f = &frames[depth - 1];
+			}
+			// Keep the containers streamed from an iterator alive until the
+			// conversion finishes because their pointers are recorded in the
+			// memo and could otherwise be reused by other objects.
+			if (f->transient) {
+				if (pykeep == NULL && (pykeep = PyList_New(0)) == NULL) {
+					goto convert_error; // Clean up.
 				}
-				if (PyDict_SetItem(pymemo, pyval_tmp, pyptr_tmp) != 0) {
-					goto dict_error; // Clean up.
+				if (PyList_Append(pykeep, pyval) != 0) {
+					goto convert_error; // Clean up.
 				}
 			}
-			
-			// Set new php value in array.
-			// .. NOTE: Hash key length MUST include NULL byte.
-			if (zend_symtable_update(Z_ARRVAL_P(zdict), key, (unsigned int)keylen + 1, &zv, sizeof(zv), NULL) != SUCCESS) {
-				PyErr_Format(InternalErrorType, "Failed to set key in php array.");
-				goto dict_error;
+			zv = pyphp_p2z_frame_init(&frames[depth], pyval, memo);
+			if (zv == NULL) {
+				goto convert_error; // Clean up.
 			}
-			zv = NULL; // PHP dict steals reference to php value.
-			
-			// Destroy temporary python values.
-			if (pyptr_tmp != NULL) {
-				Py_DECREF(pyptr_tmp);
-				pyptr_tmp = NULL;
+			++depth;
+		} else {
+			zv = PyObject_to_zval_scalar(pyval);
+			if (zv == NULL) {
+				goto convert_error; // Clean up.
 			}
-			if (pyval_tmp != NULL) {
-				Py_DECREF(pyval_tmp);
-				pyval_tmp = NULL;
+		}
+		
+		// Set new php value in array.
+		if (PyDict_Check(f->pyobj)) {
+			// .. NOTE: Hash key length MUST include NULL byte.
+			if (zend_symtable_update(Z_ARRVAL_P(f->zarray), key, (unsigned int)keylen + 1, &zv, sizeof(zv), NULL) != SUCCESS) {
+				PyErr_Format(InternalErrorType, "Failed to set key in php array.");
+				goto convert_error; // Clean up.
 			}
-			if (pykey_tmp != NULL) {
-				Py_DECREF(pykey_tmp);
-				pykey_tmp = NULL;
+		} else {
+			if (zend_hash_next_index_insert(Z_ARRVAL_P(f->zarray), &zv, sizeof(zv), NULL) != SUCCESS) {
+				PyErr_Format(InternalErrorType, "Failed to set index:%" PY_Z "i in php array.", f->pos - 1);
+				goto convert_error; // Clean up.
 			}
 		}
+		zv = NULL; // PHP array steals reference to php value.
 		
-		// Clean up remaining python temporary values.
-		if (pymemo_is_tmp) {
-			Py_DECREF(pymemo);
+		// Destroy temporary values.
+		if (pykey_tmp != NULL) {
+			Py_DECREF(pykey_tmp);
+			pykey_tmp = NULL;
 		}
-		
-		// Return new PHP array.
-		return zdict;
-		
-		// Failed to convert python dict to php array.
-		dict_error: {
-			// Clean up temporary python values.
-			if (pyptr_tmp != NULL) {
-				Py_DECREF(pyptr_tmp);
-			}
-			if (pyval_tmp != NULL) {
-				Py_DECREF(pyval_tmp);
-			}
-			if (pykey_tmp != NULL) {
-				Py_DECREF(pykey_tmp);
-			}
-			if (pymemo_is_tmp) {
-				Py_DECREF(pymemo);
-			}
-			// Destory orphaned php value.
-			if (zv != NULL) {
-				zval_del(&zv);
-			}
-			// Destory php array.
-			zval_del(&zdict);
+		if (utf8 != NULL && utf8 != utf8buf) {
+			efree(utf8);
 		}
-		return NULL;
-		
-	} else if (PySequence_Check(pyobj)) {
-		bool pymemo_is_tmp = false;
-		Py_ssize_t i = 0;
-		Py_ssize_t pylen = 0;
-		zval * zlist = NULL; // owned
-		zval * zv = NULL; // owned
-		PyObject * pyfast = NULL; // owned
-		PyObject * pyptr = NULL; // borrowed
-		PyObject * pyval = NULL; // borrowed
-		PyObject * pyptr_tmp = NULL; // owned
-		PyObject * pyval_tmp = NULL; // owned
-		PyObject ** pyitems = NULL; // borrowed
-		
-		// Make sure sequence is either a tuple or list.
-		pyfast = PySequence_Fast(pyobj, "");
-		if (pyfast == NULL) {
-			// Override exception.
-			PyObject * repr = PyObject_Repr(pyobj);
-			if (repr != NULL) {
-				PyErr_Format(PyExc_TypeError, "Failed to convert Python object:%s to list.", PyString_AS_STRING(repr));
-				Py_DECREF(repr);
-			}
-			return NULL;
+		utf8 = NULL;
+		Py_CLEAR(pyitem);
+	}
+	
+	// Clean up remaining temporary values.
+	Py_XDECREF(pykeep);
+	if (memo_is_tmp) {
+		memo_free(memo);
+	}
+	if (frames != frames_local) {
+		PyMem_Free(frames);
+	}
+	
+	// Return new PHP array.
+	return zresult;
+	
+	// Failed to convert python container to php array.
+	convert_error: {
+		// Clean up temporary values.
+		if (pykey_tmp != NULL) {
+			Py_DECREF(pykey_tmp);
 		}
-		
-		// Make sure the sequence is small enough
-		pylen = PySequence_Fast_GET_SIZE(pyfast);
-		if (pylen < 0 || INT_MAX < pylen) {
-			PyErr_Format(PyExc_ValueError, "Python object:%s length:%" PY_Z "i must be between 0 and %i inclusive.", Py_TYPE(pyobj)->tp_name, pylen, INT_MAX);
-			goto list_error;
+		if (utf8 != NULL && utf8 != utf8buf) {
+			efree(utf8);
 		}
-		
-		// Initialize PHP array.
-		MAKE_STD_ZVAL(zlist);
-		if (zlist == NULL) {
-			PyErr_Format(InternalErrorType, "Failed to create zval.");
-			goto list_error;
+		Py_XDECREF(pyitem);
+		for (i = 0; i < depth; ++i) {
+			Py_XDECREF(frames[i].pyfast);
+			Py_XDECREF(frames[i].pyiter);
 		}
-		if (array_init_size(zlist, (unsigned int)pylen) != SUCCESS) {
-			PyErr_Format(InternalErrorType, "Failed to initialize zval array.");
-			goto list_error;
+		Py_XDECREF(pykeep);
+		if (memo_is_tmp) {
+			memo_free(memo);
 		}
-		
-		// Create memo dict if we don't have one.
-		if (pymemo == NULL) {
-			pymemo = PyDict_New();
-			if (pymemo == NULL) {
-				goto list_error;
-			}
-			pymemo_is_tmp = true;
+		if (frames != frames_local) {
+			PyMem_Free(frames);
 		}
-		
-		// Iterate over python sequence, convert python values into PHP key values
-		// and append them to the PHP array.
-		pyitems = PySequence_Fast_ITEMS(pyfast);
-		for (i = 0; i < pylen; ++i) {
-			// Convert python value to php value.
-			// - The memo dict maps python value pointer to php value pointer.
-			pyval = pyitems[i];
-			pyval_tmp = PyLong_FromVoidPtr(pyval);
-			if (pyval_tmp == NULL) {
-				goto list_error; // Clean up.
-			}
-			pyptr = PyDict_GetItem(pymemo, pyval_tmp);
-			if (pyptr != NULL) {
-				// Get mapped php value pointer from python value pointer.
-				zv = PyLong_AsVoidPtr(pyptr);
-				if (zv == NULL) {
-					goto list_error; // Clean up.
-				}
-			} else {
-				zv = PyObject_to_zval(pyval, pymemo);
-				if (zv == NULL) {
-					goto list_error; // Clean up.
-				}
-				// Map python value pointer to php value pointer to support recursion.
-				pyptr_tmp = PyLong_FromVoidPtr(zv);
-				if (pyptr_tmp == NULL) {
-					goto list_error; // Clean up.
-				}
-				if (PyDict_SetItem(pymemo, pyval_tmp, pyptr_tmp) != 0) {
-					goto list_error; // Clean up.
-				}
-			}
-			
-			// Set new php value in array.
-			if (zend_hash_next_index_insert(Z_ARRVAL_P(zlist), &zv, sizeof(zv), NULL) != SUCCESS) {
-				PyErr_Format(InternalErrorType, "Failed to set index:%" PY_Z "i in php array.", i);
-				goto list_error;
-			}
-			zv = NULL; // PHP array steals reference to php value.
-			
-			// Destroy temporary python values.
-			if (pyptr_tmp != NULL) {
-				Py_DECREF(pyptr_tmp);
-				pyptr_tmp = NULL;
-			}
-			if (pyval_tmp != NULL) {
-				Py_DECREF(pyval_tmp);
-				pyval_tmp = NULL;
-			}
+		// Destroy orphaned php value.
+		if (zv != NULL) {
+			zval_del(&zv);
 		}
-		
-		// Clean up remaining python temporary values.
-		if (pymemo_is_tmp) {
-			Py_DECREF(pymemo);
+		// Destroy php array, along with the arrays it contains.
+		if (zresult != NULL) {
+			zval_del(&zresult);
 		}
-		Py_DECREF(pyfast);
-		
-		// Return new PHP array.
-		return zlist;
-		
-		// Failed to convert python sequence to php array.
-		list_error: {
-			// Clean up temporary python values.
-			if (pyptr_tmp != NULL) {
-				Py_DECREF(pyptr_tmp);
-			}
-			if (pyval_tmp != NULL) {
-				Py_DECREF(pyval_tmp);
-			}
-			if (pymemo_is_tmp) {
-				Py_DECREF(pymemo);
-			}
-			// Destroy orphaned php value.
-			if (zv != NULL) {
-				zval_del(&zv);
-			}
-			// Destory php array.
-			if (zlist != NULL) {
-				zval_del(&zlist);
-			}
-			// Clean up sequence.
-			Py_DECREF(pyfast);
+	}
+	return NULL;
+}
+
+
+
+/**
+Returns the intern table of the current interpreter.
+
+Returns the intern table (``struct intern_t *``) if strings are interned
+across conversions; otherwise, ``NULL``.
+*/
+static struct intern_t * pyphp_interns() {
+	return pyphp_interp->interns.max > 0 ? &pyphp_interp->interns : NULL;
+}
+
+/**
+Initializes the state of a conversion from PHP to Python.
+
+*conv* (``struct pyphp_conv_t *``) is the state.
+*/
+static void pyphp_conv_init(struct pyphp_conv_t * conv) {
+	memo_init(&conv->memo);
+	memo_init(&conv->shapes);
+	conv->shape_list = NULL;
+	// Strings are interned for the conversion unless they are interned across
+	// conversions.
+	intern_init(&conv->interns_tmp, (size_t)-1);
+	conv->interns = pyphp_interns();
+	if (conv->interns == NULL) {
+		conv->interns = &conv->interns_tmp;
+	}
+}
+
+/**
+Releases the state of a conversion from PHP to Python.
+
+*conv* (``struct pyphp_conv_t *``) is the state.
+*/
+static void pyphp_conv_free(struct pyphp_conv_t * conv) {
+	struct pyphp_shape_t * shape = NULL; // owned
+	size_t i;
+	
+	memo_free(&conv->memo);
+	memo_free(&conv->shapes);
+	while (conv->shape_list != NULL) {
+		shape = conv->shape_list;
+		conv->shape_list = shape->next;
+		for (i = 0; i < shape->count; ++i) {
+			Py_XDECREF(shape->props[i].pykey);
 		}
+		PyMem_Free(shape->props);
+		PyMem_Free(shape);
+	}
+	intern_clear(&conv->interns_tmp);
+}
+
+/**
+Converts the key of a PHP array element to a Python value.
+
+*p* (``Bucket *``) is the PHP array element.
+
+*interns* (``struct intern_t *``) optionally is the intern table for string
+keys. This can be ``NULL``.
+
+Returns the new Python key (``int`` or ``str``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * bucket_key_to_PyObject(Bucket * p, struct intern_t * interns) {
+	// Numeric keys are marked by nKeyLength == 0 and stored in h. The length of
+	// string keys includes the NULL byte.
+	if (p->nKeyLength == 0) {
+		return PyInt_FromLong((long)p->h);
+	}
+	if (p->nKeyLength - 1 > PY_SSIZE_T_MAX) {
+		PyErr_Format(PyExc_ValueError, "PHP key length:%u is not between 0 and %" PY_Z "i inclusive.", p->nKeyLength - 1, PY_SSIZE_T_MAX);
 		return NULL;
 	}
+	if (interns != NULL) {
+		// The hash of string keys is stored in h.
+		return intern_get(interns, p->arKey, (Py_ssize_t)p->nKeyLength - 1, p->h);
+	}
+	return PyString_FromStringAndSize(p->arKey, (Py_ssize_t)p->nKeyLength - 1);
+}
+
+/**
+Determines whether the specified PHP object property is public.
+
+*p* (``Bucket *``) is the property.
+
+Returns ``true`` if the property is public; otherwise, ``false``.
+*/
+static bool bucket_is_public(Bucket * p) {
+	// The names of protected and private properties are mangled with a leading
+	// NULL byte (e.g., "\0*\0name" and "\0Class\0name").
+	return p->nKeyLength == 0 || p->arKey[0] != '\0';
+}
+
+/**
+Gets the properties of the specified PHP object.
+
+*zobj* (``zval *``) is the php object.
+
+Returns the properties (``HashTable *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static HashTable * zval_object_properties(zval * zobj) {
+	HashTable * props = NULL; // borrowed
+	TSRMLS_FETCH();
+	
+	if (Z_OBJ_HT_P(zobj)->get_properties != NULL) {
+		props = Z_OBJPROP_P(zobj);
+	}
+	if (props == NULL) {
+		PyErr_Format(PyExc_TypeError, "PHP object:%u does not have properties to convert to a Python dict.", Z_OBJ_HANDLE_P(zobj));
+	}
+	return props;
+}
+
+/**
+Gets the shape of the class of the specified PHP object. The shape is built
+from the object's properties the first time an object of the class is
+converted.
+
+*conv* (``struct pyphp_conv_t *``) is the state of the conversion.
+
+*zobj* (``zval *``) is the php object.
+
+*props* (``HashTable *``) is the properties of *zobj*.
+
+*shape* (``struct pyphp_shape_t **``) will be set to the shape, or ``NULL`` if
+the object does not have a class.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool pyphp_shape_get(struct pyphp_conv_t * conv, zval * zobj, HashTable * props, struct pyphp_shape_t ** shape) {
+	zend_class_entry * ce = NULL; // borrowed
+	struct pyphp_shape_t * result = NULL; // owned
+	Bucket * p = NULL; // borrowed
+	size_t i;
+	TSRMLS_FETCH();
 	
-	// Python object not supported.
-	PyErr_Format(PyExc_TypeError, "Python type:%s cannot be converted to a PHP value.", Py_TYPE(pyobj)->tp_name);
-	return NULL;
+	// Find the cached shape of the class.
+	*shape = NULL;
+	if (Z_OBJ_HT_P(zobj)->get_class_entry == NULL) {
+		return true;
+	}
+	ce = Z_OBJCE_P(zobj);
+	if (ce == NULL) {
+		return true;
+	}
+	*shape = memo_get(&conv->shapes, ce);
+	if (*shape != NULL) {
+		return true;
+	}
+	
+	// Build the shape from the properties of the object. The keys are created
+	// once so they can be reused for every object of the class.
+	result = PyMem_New(struct pyphp_shape_t, 1);
+	if (result == NULL) {
+		PyErr_NoMemory();
+		return false;
+	}
+	result->count = (size_t)zend_hash_num_elements(props);
+	result->props = PyMem_New(struct pyphp_shape_prop_t, result->count ? result->count : 1);
+	if (result->props == NULL) {
+		PyMem_Free(result);
+		PyErr_NoMemory();
+		return false;
+	}
+	for (i = 0, p = props->pListHead; i < result->count && p != NULL; ++i, p = p->pListNext) {
+		result->props[i].h = p->h;
+		result->props[i].nKeyLength = p->nKeyLength;
+		result->props[i].pykey = NULL;
+		if (bucket_is_public(p)) {
+			result->props[i].pykey = bucket_key_to_PyObject(p, conv->interns);
+			if (result->props[i].pykey == NULL) {
+				goto shape_error; // Clean up.
+			}
+		}
+	}
+	result->count = i;
+	
+	// Cache the shape.
+	if (!memo_set(&conv->shapes, ce, result)) {
+		PyErr_NoMemory();
+		goto shape_error; // Clean up.
+	}
+	result->next = conv->shape_list;
+	conv->shape_list = result;
+	*shape = result;
+	return true;
+	
+	shape_error: {
+		while (i > 0) {
+			--i;
+			Py_XDECREF(result->props[i].pykey);
+		}
+		PyMem_Free(result->props);
+		PyMem_Free(result);
+	}
+	return false;
 }
 
+/**
+Converts the key of a PHP array element or public object property to a Python
+value, reusing the key of the class shape when the property matches it.
+
+*shape* (``struct pyphp_shape_t *``) optionally is the shape of the class of
+the object. This can be ``NULL``.
+
+*index* (``ulong``) is the position of the property.
+
+*p* (``Bucket *``) is the element or property.
 
+*interns* (``struct intern_t *``) optionally is the intern table for string
+keys. This can be ``NULL``.
+
+Returns the new Python key (``int`` or ``str``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * pyphp_shape_key(struct pyphp_shape_t * shape, ulong index, Bucket * p, struct intern_t * interns) {
+	struct pyphp_shape_prop_t * prop = NULL; // borrowed
+	
+	// Objects of a class almost always have their properties in the same order
+	// so the property is compared with the one at the same position.
+	if (shape != NULL && index < shape->count) {
+		prop = &shape->props[index];
+		if (prop->pykey != NULL && prop->h == p->h && prop->nKeyLength == p->nKeyLength && (p->nKeyLength == 0 || memcmp(PyString_AS_STRING(prop->pykey), p->arKey, p->nKeyLength - 1) == 0)) {
+			Py_INCREF(prop->pykey);
+			return prop->pykey;
+		}
+	}
+	return bucket_key_to_PyObject(p, interns);
+}
 
 /**
-Converts a PHP value to a Python value.
+Converts a PHP scalar value to a Python value.
 
-*zobj* (``zval *``) is the php value.
+*zobj* (``zval *``) is the php value. This cannot be an array or object.
 
-*pymemo* (``PyObject *``) is a memo dictionary of objects already copied. This
-is used internally by this method so it should be set to ``NULL``.
+*conv* (``struct pyphp_conv_t *``) optionally is the state of the conversion.
+This can be ``NULL``.
 
 Returns the new Python value (``PyObject *``).
 
 .. NOTE: If the return value is ``NULL``, a Python exception has been raised.
 */
-static PyObject * zval_to_PyObject(zval * zobj, PyObject * pymemo) {
+static PyObject * zval_to_PyObject_scalar(zval * zobj, struct pyphp_conv_t * conv) {
 	if (zobj == NULL) {
 		PyErr_Format(InternalErrorType, "PHP value:%p is NULL.", (void *)zobj);
 		return NULL;
@@ -563,198 +1291,15 @@ static PyObject * zval_to_PyObject(zval * zobj, PyObject * pymemo) {
 			}
 			Py_RETURN_FALSE;
 			
-		case IS_ARRAY:
-		case IS_CONSTANT_ARRAY:
-			if (zval_is_list(zobj)) {
-				// Convert to list.
-				bool pymemo_is_tmp = false;
-				PyObject * pylist = NULL; // owned
-				PyObject * pyval = NULL; // owned
-				PyObject * pyzv = NULL; // owned
-				Bucket * p = NULL; // borrowed
-				zval * zv = NULL; // borrowed
-				
-				// Create python list.
-				pylist = PyList_New(zend_hash_num_elements(Z_ARRVAL_P(zobj)));
-				if (pylist == NULL) {
-					return NULL;
-				}
-		
-				// Create memo dict if we don't have one.
-				if (pymemo == NULL) {
-					pymemo = PyDict_New();
-					if (pymemo == NULL) {
-						goto list_error; // Clean up.
-					}
-					pymemo_is_tmp = true;
-				}
-				
-				// Iterate over php list, convert php values into python values, and
-				// append them to the python list.
-				p = Z_ARRVAL_P(zobj)->pListHead;
-				while (p != NULL) {
-					// Convert php value to python value.
-					// .. NOTE: The memo dict maps php value pointer to python value.
-					zv = p->pData;
-					pyzv = PyLong_FromVoidPtr(zv);
-					if (pyzv == NULL) {
-						goto list_error; // Clean up.
-					}
-					pyval = PyDict_GetItem(pymemo, pyzv);
-					if (pyval != NULL) {
-						Py_INCREF(pyval);
-					} else {
-						pyval = zval_to_PyObject(zv, pymemo);
-						if (pyval == NULL) {
-							goto list_error; // Clean up.
-						}
-						// Map php value pointer to python value to support recursion.
-						if (PyDict_SetItem(pymemo, pyzv, pyval) != 0) {
-							goto list_error; // Clean up.
-						}
-					}
-					
-					// Set new python value in list.
-					// .. NOTE: Numeric indices stored in h, and zend_is_list() ensured
-					//    that all keys were numeric and within 0 and 2**32-1 inclusive.
-					PyList_SET_ITEM(pylist, (Py_ssize_t)p->h, pyval);
-					pyval = NULL; // Python list steals reference to python value.
-					
-					// Clean-up temporary values.
-					Py_DECREF(pyzv);
-					pyzv = NULL;
-					
-					p = p->pListNext;
-				}
-				
-				// Clean-up temporary values.
-				if (pymemo_is_tmp) {
-					Py_DECREF(pymemo);
-				}
-				
-				// Return new python list.
-				return pylist;
-				
-				// Failed to convert php list to python list.
-				list_error: {
-					// Clean-up temporary values.
-					Py_XDECREF(pyval);
-					Py_XDECREF(pyzv);
-					if (pymemo_is_tmp) {
-						Py_DECREF(pymemo);
-					}
-					// Destroy python list.
-					Py_DECREF(pylist);
-				}
-				return NULL;
-				
-			} else {
-				// Convert to dict.
-				bool pymemo_is_tmp = false;
-				PyObject * pydict = NULL; // owned
-				PyObject * pykey = NULL; // owned
-				PyObject * pyval = NULL; // owned
-				PyObject * pyzv = NULL; // owned
-				Bucket * p = NULL; // borrowed
-				zval * zv = NULL; // borrowed
-				
-				// Create python dict.
-				pydict = PyDict_New();
-				if (pydict == NULL) {
-					return NULL;
-				}
-				
-				// Create memo dict if we don't have one.
-				if (pymemo == NULL) {
-					pymemo = PyDict_New();
-					if (pymemo == NULL) {
-						goto dict_error; // Clean up.
-					}
-					pymemo_is_tmp = true;
-				}
-				
-				// Iterate over php dict, convert php keys and values into python keys
-				// and values, and add them to the python dict.
-				p = Z_ARRVAL_P(zobj)->pListHead;
-				while (p != NULL) {
-					// Convert php key to python key.
-					if (p->nKeyLength > PY_SSIZE_T_MAX) {
-						PyErr_Format(PyExc_ValueError, "PHP key length:%u is not between 0 and %" PY_Z "i inclusive.", p->nKeyLength, PY_SSIZE_T_MAX);
-						goto dict_error; // Clean up.
-					}
-					pykey = PyString_FromStringAndSize(p->arKey, (Py_ssize_t)p->nKeyLength);
-					if (pykey == NULL) {
-						goto dict_error; // Clean up.
-					}
-					
-					// Convert php value to python value.
-					// .. NOTE: The memo dict maps php value pointer to python value.
-					zv = p->pData;
-					pyzv = PyLong_FromVoidPtr(zv);
-					if (pyzv == NULL) {
-						goto dict_error; // Clean up.
-					}
-					pyval = PyDict_GetItem(pymemo, pyzv);
-					if (pyval != NULL) {
-						Py_INCREF(pyval);
-					} else {
-						pyval = zval_to_PyObject(zv, pymemo);
-						if (pyval == NULL) {
-							goto dict_error; // Clean up.
-						}
-						// Map php value pointer to python value to support recursion.
-						if (PyDict_SetItem(pymemo, pyzv, pyval) != 0) {
-							goto dict_error; // Clean up.
-						}
-					}
-					
-					// Set new python value in dict.
-					if (PyDict_SetItem(pydict, pykey, pyval) != 0) {
-						goto dict_error; // Clean up.
-					}
-					
-					// Clean-up temporary values.
-					Py_DECREF(pykey);
-					pykey = NULL;
-					Py_DECREF(pyzv);
-					pyzv = NULL;
-					Py_DECREF(pyval);
-					pyval = NULL;
-					
-					p = p->pListNext;
-				}
-				
-				// Clean-up temporary values.
-				if (pymemo_is_tmp) {
-					Py_DECREF(pymemo);
-				}
-				
-				// Return new python dict.
-				return pydict;
-				
-				// Failed to convert php dict to python dict.
-				dict_error: {
-					// Clean-up temporary values.
-					Py_XDECREF(pyval);
-					Py_XDECREF(pyzv);
-					Py_XDECREF(pykey);
-					if (pymemo_is_tmp) {
-						Py_DECREF(pymemo);
-					}					
-					// Destory python dict.
-					Py_DECREF(pydict);
-				}
-				return NULL;
-			}
-			break;
-			
-		case IS_OBJECT:
-			// .. TODO: Support converting an object to a dict.
-			PyErr_Format(PyExc_NotImplementedError, "Converting PHP object type to Python dict is not yet implemented.");
-			return NULL;
-			
 		case IS_STRING:
 		case IS_CONSTANT:
+			if (Z_STRLEN_P(zobj) <= INTERN_MAX_LENGTH) {
+				// Share short strings which are likely to be repeated.
+				struct intern_t * interns = conv != NULL ? conv->interns : pyphp_interns(); // borrowed
+				if (interns != NULL) {
+					return intern_get(interns, Z_STRVAL_P(zobj), Z_STRLEN_P(zobj), intern_hash(Z_STRVAL_P(zobj), Z_STRLEN_P(zobj)));
+				}
+			}
 			return PyString_FromStringAndSize(Z_STRVAL_P(zobj), Z_STRLEN_P(zobj));
 			
 		case IS_RESOURCE:
@@ -770,1011 +1315,5304 @@ static PyObject * zval_to_PyObject(zval * zobj, PyObject * pymemo) {
 	return NULL;
 }
 
-
-
-/******************************* PHP Methods ********************************/
-
-static bool pyphp_php_restart();
-static void pyphp_php_log_cb(char * message);
-static int pyphp_php_output_cb(const char * str, unsigned int str_length TSRMLS_DC);
-static void pyphp_php_output_flush_cb(void * server_ctx);
-static int pyphp_php_startup_cb(sapi_module_struct * sapi);
-
 /**
-Executes the specified PHP script.
+Initializes the frame for converting a PHP array to a Python list or dict, or
+a PHP object to a Python dict.
 
-*name* (``const char *``) is the name of the script.
+*f* (``struct pyphp_z2p_frame_t *``) is the frame.
 
-*name_len* (``Py_ssize_t``) is the length of name.
+*zarray* (``zval *``) is the php array or object.
 
-*fp* (``FILE *``) is the file pointer to the script.
+*ht* (``HashTable *``) is the elements of the php array, or the properties of
+the php object.
 
-.. NOTE: This reference is stolen.
+*conv* (``struct pyphp_conv_t *``) is the state of the conversion.
 
-Returns ``true`` on success; otherwise, ``false``.
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
 */
-static bool pyphp_php_exec_file(const char * name, Py_ssize_t name_len, FILE * fp) {
-	zend_file_handle zfile;
-	bool result = false;
-
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
-	}
-	
-	if (name_len < 0 || INT_MAX < name_len) {
-		PyErr_Format(PyExc_ValueError, "name_len:%" PY_Z "i must be between 0 and %i inclusive.", name_len, INT_MAX);
-		return false;
-	}
-	
-	// Setup zend file handle.
-	zfile.type = ZEND_HANDLE_FP;
-	zfile.filename = (char *)name; // NOTE: I think this cast is safe.
-	zfile.opened_path = NULL;
-	zfile.handle.fp = fp;
-	zfile.free_filename = 0;
-	
-	// Execute script.
-	// .. TODO: Properly send php errors to python.
-	{
-		TSRMLS_FETCH();
-		result = true;
-		zend_first_try {
-			if (zend_execute_scripts(ZEND_REQUIRE TSRMLS_CC, NULL, 1, &zfile) != SUCCESS) {
-				result = false;
-			}
-		} zend_catch {
-			result = false;
-		} zend_end_try();
-	}
+static bool pyphp_z2p_frame_init(struct pyphp_z2p_frame_t * f, zval * zarray, HashTable * ht, struct pyphp_conv_t * conv) {
+	f->zarray = zarray;
+	f->ht = ht;
+	f->p = ht->pListHead;
+	f->index = 0;
+	f->len = (ulong)zend_hash_num_elements(ht);
+	f->shape = NULL;
+	f->pylist = NULL;
+	f->pydict = NULL;
 	
-	// Reset php.
-	if (!pyphp_php_restart()) {
-		return false;
+	if (Z_TYPE_P(zarray) == IS_OBJECT) {
+		// Create python dict of the public properties, keyed by the shape of
+		// the class.
+		if (!pyphp_shape_get(conv, zarray, ht, &f->shape)) {
+			return false;
+		}
+		f->pydict = _PyDict_NewPresized((Py_ssize_t)f->len);
+		if (f->pydict == NULL) {
+			return false;
+		}
+	} else {
+		// Speculatively create python list.
+		f->pylist = PyList_New((Py_ssize_t)f->len);
+		if (f->pylist == NULL) {
+			return false;
+		}
 	}
 	
-	// Check for python exception.
-	if (PyErr_Occurred() != NULL) {
-		return false;
-	} else if (!result) {
-		PyErr_SetString(InternalErrorType, "Failed to execute script.");
+	// Map php hash table pointer to python value before converting the values
+	// to support recursion.
+	if (!memo_set(&conv->memo, ht, f->pydict != NULL ? f->pydict : f->pylist)) {
+		PyErr_NoMemory();
+		Py_CLEAR(f->pylist);
+		Py_CLEAR(f->pydict);
 		return false;
 	}
-	
 	return true;
 }
 
 /**
-Executes the specified PHP inline string/script.
+Changes the frame for converting a PHP array from a Python list to a Python
+dict. The values already converted are moved from the list into the dict.
 
-*name* (``const char *``) is the name of the inline string/script.
+*f* (``struct pyphp_z2p_frame_t *``) is the frame.
 
-*str* (``const char *``) is the string to execute.
+*conv* (``struct pyphp_conv_t *``) is the state of the conversion.
 
-*str_len* (``int``) is the length of *str*.
- 
-Returns ``true`` on success; otherwise, ``false``.
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
 */
-static bool pyphp_php_exec_inline(const char * name, const char * str, int str_len) {
-	bool result = false;
-
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
-	}
+static bool pyphp_z2p_frame_to_dict(struct pyphp_z2p_frame_t * f, struct pyphp_conv_t * conv) {
+	PyObject * pykey = NULL; // owned
+	Bucket * q = NULL; // borrowed
+	Py_ssize_t i = 0;
 	
-	// Execute string.
-	// .. TODO: Properly send php errors to python.
-	{
-		TSRMLS_FETCH();
-		result = true;
-		zend_first_try {
-			// NOTE: I think casting these to `char *` is safe.
-			if (zend_eval_stringl((char *)str, str_len, NULL, (char *)name TSRMLS_CC) != SUCCESS) {
-				result = false;
-			}
-		} zend_catch {
-			result = false;
-		} zend_end_try();
+	// Create python dict large enough for all of the elements.
+	f->pydict = _PyDict_NewPresized((Py_ssize_t)f->len);
+	if (f->pydict == NULL) {
+		return false;
 	}
-	
-	// Reset php.
-	if (!pyphp_php_restart()) {
+	if (!memo_set(&conv->memo, f->ht, f->pydict)) {
+		PyErr_NoMemory();
 		return false;
 	}
 	
-	// Check for python exception.
-	if (PyErr_Occurred() != NULL) {
-		return false;
-	} else if (!result) {
-		PyErr_SetString(InternalErrorType, "Failed to execute string.");
-		return false;
+	// Move the values already converted from the python list into the python
+	// dict.
+	for (q = f->ht->pListHead; q != f->p; q = q->pListNext) {
+		pykey = PyInt_FromLong((long)q->h);
+		if (pykey == NULL) {
+			return false;
+		}
+		if (PyDict_SetItem(f->pydict, pykey, PyList_GET_ITEM(f->pylist, (Py_ssize_t)q->h)) != 0) {
+			Py_DECREF(pykey);
+			return false;
+		}
+		Py_DECREF(pykey);
 	}
 	
-	return result;
+	// Release the python list.
+	// .. NOTE: A recursive php array could have referenced the python list
+	//    before it became a dict. In that case the unset indices are filled
+	//    with None so that the list remains valid.
+	if (Py_REFCNT(f->pylist) > 1) {
+		for (i = 0; i < (Py_ssize_t)f->len; ++i) {
+			if (PyList_GET_ITEM(f->pylist, i) == NULL) {
+				Py_INCREF(Py_None);
+				PyList_SET_ITEM(f->pylist, i, Py_None);
+			}
+		}
+	}
+	Py_CLEAR(f->pylist);
+	return true;
 }
 
 /**
-Gets the value of the specified global variable.
+Sets the value of the current element of the frame for converting a PHP array,
+and advances to the next element.
 
-*key* (``const char *``) is the name of the variable to get.
+*f* (``struct pyphp_z2p_frame_t *``) is the frame.
 
-*keylen* (``int``) is the length of *key*.
+*pyval* (``PyObject *``) is the python value.
 
-*var* (``const char *``) optionally gets the keyed value from the specified
-global variable instead of from the global symbol table.
+.. NOTE: This reference is stolen.
 
-*varlen* (``int``) is the length of *var*.
+*conv* (``struct pyphp_conv_t *``) is the state of the conversion.
 
-Returns a borrowed reference to value (``zval *``) of the global variable.
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
 */
-static zval * pyphp_php_global_get(const char * key, int keylen, const char * var, int varlen) {
-	HashTable * ht = NULL; // borrowed
-	zval * zv = NULL; // borrowed
-	
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return NULL;
-	}
+static bool pyphp_z2p_frame_set(struct pyphp_z2p_frame_t * f, PyObject * pyval, struct pyphp_conv_t * conv) {
+	PyObject * pykey = NULL; // owned
+	int result = 0;
 	
-	{
-		TSRMLS_FETCH();
-		if (var != NULL) {
-			zval * zdict = NULL; // borrowed
-			// Get hash table for specified var.
-			// .. NOTE: Hash key length must include NULL byte.
-			if (zend_symtable_find(&EG(symbol_table), var, (unsigned int)varlen + 1, &zdict) != SUCCESS) {
-				PyErr_SetString(PyExc_KeyError, "var is not set.");
-				return NULL;
-			}
-			ht = Z_ARRVAL_P(zdict);
-		} else {
-			// Get global symbol table.
-			ht = &EG(symbol_table);
+	if (f->pydict == NULL) {
+		// .. NOTE: Numeric indices are stored in h, and were checked to be
+		//    within the list.
+		PyList_SET_ITEM(f->pylist, (Py_ssize_t)f->p->h, pyval);
+	} else {
+		pykey = pyphp_shape_key(f->shape, f->index, f->p, conv->interns);
+		if (pykey == NULL) {
+			Py_DECREF(pyval);
+			return false;
+		}
+		result = PyDict_SetItem(f->pydict, pykey, pyval);
+		Py_DECREF(pykey);
+		Py_DECREF(pyval);
+		if (result != 0) {
+			return false;
 		}
 	}
-	
-	// Get php variable.
-	// .. NOTE: Hash key length MUST include NULL byte.
-	if (zend_symtable_find(ht, key, (unsigned int)keylen + 1, &zv) != SUCCESS) {
-		PyErr_SetString(PyExc_KeyError, "key is not set.");
-		return NULL;
-	}
-	return zv;
+	f->p = f->p->pListNext;
+	f->index += 1;
+	return true;
 }
 
 /**
-Sets the value of the specified global variable.
-
-*key* (``const char *``) is the name of the variable to set.
-
-*keylen* (``int``) is the length of *key*.
-
-*var* (``cosnt char *``) optionally sets the keyed value in the specified
-global variable instead of in the global symbol table.
+Converts a PHP value to a Python value.
 
-*varlen* (``int``) is the length of *var*.
+*zobj* (``zval *``) is the php value.
 
-*zv* (``zval *``) is the value of the variable to set.
+*conv* (``struct pyphp_conv_t *``) optionally is the state of the conversion
+to share between conversions. This can be ``NULL``.
 
-.. NOTE: This reference is stolen.
+Returns the new Python value (``PyObject *``).
 
-Returns ``true`` on success; otherwise, ``false``.
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
 */
-static bool pyphp_php_global_set(const char * key, int keylen, const char * var, int varlen, zval * zv) {
+static PyObject * zval_to_PyObject(zval * zobj, struct pyphp_conv_t * conv) {
+	/*
+	.. NOTE: Arrays are converted iteratively with an explicit stack of frames
+	   instead of recursively so that deeply nested values cannot overflow the
+	   C stack. The stack starts out local and is moved to the heap when it is
+	   outgrown.
+	
+	.. NOTE: An array is converted to a list if its keys are exactly the
+	   indices 0 through n-1 (see ``zval_is_list()``); otherwise, to a dict.
+	   Each array is speculatively converted to a list in a single pass over
+	   its elements, and changed to a dict at the first key that is not a list
+	   index.
+	
+	.. NOTE: An object is converted to a dict of its public properties.
+	*/
+	bool conv_is_tmp = false;
+	struct pyphp_conv_t conv_tmp;
+	struct pyphp_z2p_frame_t frames_local[PYPHP_STACK_INIT];
+	struct pyphp_z2p_frame_t * frames = frames_local; // owned
+	struct pyphp_z2p_frame_t * f = NULL; // borrowed
+	size_t frames_size = PYPHP_STACK_INIT;
+	size_t depth = 0;
+	size_t i = 0;
+	zval * zv = NULL; // borrowed
 	HashTable * ht = NULL; // borrowed
+	PyObject * pyresult = NULL; // owned
+	PyObject * pyval = NULL; // owned
 	
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+	// Convert scalar directly.
+	if (zobj == NULL) {
+		return zval_to_PyObject_scalar(zobj, conv);
+	} else if (Z_TYPE_P(zobj) == IS_ARRAY || Z_TYPE_P(zobj) == IS_CONSTANT_ARRAY) {
+		ht = Z_ARRVAL_P(zobj);
+	} else if (Z_TYPE_P(zobj) == IS_OBJECT) {
+		ht = zval_object_properties(zobj);
+		if (ht == NULL) {
+			return NULL;
+		}
+	} else {
+		return zval_to_PyObject_scalar(zobj, conv);
 	}
 	
-	{
-		TSRMLS_FETCH();
-		if (var != NULL) {
-			zval * zdict = NULL; // borrowed
-			// Get hash table for specified var.
-			// .. NOTE: Hash key length must include NULL byte.
-			if (zend_symtable_find(&EG(symbol_table), var, (unsigned int)varlen + 1, &zdict) != SUCCESS) {
-				PyErr_SetString(PyExc_KeyError, "var is not set.");
-				return false;
+	// Reuse the python value of an array already converted by a shared
+	// conversion.
+	if (conv != NULL && (pyresult = memo_get(&conv->memo, ht)) != NULL) {
+		Py_INCREF(pyresult);
+		return pyresult;
+	}
+	
+	// Create conversion state if we don't have one.
+	if (conv == NULL) {
+		pyphp_conv_init(&conv_tmp);
+		conv = &conv_tmp;
+		conv_is_tmp = true;
+	}
+	
+	// Start with the top-level array or object.
+	if (!pyphp_z2p_frame_init(&frames[0], zobj, ht, conv)) {
+		goto convert_error;
+	}
+	depth = 1;
+	
+	// Iterate over the php arrays, convert php values into python values, and
+	// set them in the python lists and dicts.
+	while (depth > 0) {
+		f = &frames[depth - 1];
+		
+		// Finish the array or object and set it in its parent.
+		if (f->p == NULL) {
+			pyval = f->pydict != NULL ? f->pydict : f->pylist;
+			f->pydict = NULL;
+			f->pylist = NULL;
+			--depth;
+			if (depth == 0) {
+				pyresult = pyval;
+				break;
+			}
+			if (!pyphp_z2p_frame_set(&frames[depth - 1], pyval, conv)) {
+				goto convert_error; // Clean up.
+			}
+			continue;
+		}
+		
+		// Skip protected and private properties.
+		if (Z_TYPE_P(f->zarray) == IS_OBJECT && !bucket_is_public(f->p)) {
+			f->p = f->p->pListNext;
+			f->index += 1;
+			continue;
+		}
+		
+		// Change to a dict at the first key that is not a list index.
+		// .. NOTE: Numeric keys are marked by nKeyLength == 0 and stored in h.
+		//    Keys are unique so if all of them are less than the number of
+		//    elements, every index is set exactly once.
+		if (f->pydict == NULL && (f->p->nKeyLength != 0 || f->p->h >= f->len)) {
+			if (!pyphp_z2p_frame_to_dict(f, conv)) {
+				goto convert_error; // Clean up.
+			}
+		}
+		
+		// Get the hash table of php arrays and objects.
+		zv = *(zval **)f->p->pData;
+		ht = NULL;
+		if (Z_TYPE_P(zv) == IS_ARRAY || Z_TYPE_P(zv) == IS_CONSTANT_ARRAY) {
+			ht = Z_ARRVAL_P(zv);
+		} else if (Z_TYPE_P(zv) == IS_OBJECT) {
+			ht = zval_object_properties(zv);
+			if (ht == NULL) {
+				goto convert_error; // Clean up.
+			}
+		}
+		
+		// Convert php value to python value.
+		// .. NOTE: The memo maps php hash table pointers to python values.
+		if (ht != NULL && (pyval = memo_get(&conv->memo, ht)) != NULL) {
+			Py_INCREF(pyval);
+		} else if (ht != NULL) {
+			// Convert the array or object before it is set in its parent.
+			if (!pyphp_depth_check(depth)) {
+				goto convert_error; // Clean up.
+			}
+			if (depth == frames_size && !pyphp_stack_grow((void **)&frames, frames_local, &frames_size, sizeof(*frames))) {
+				goto convert_error; // Clean up.
+			}
+			if (!pyphp_z2p_frame_init(&frames[depth], zv, ht, conv)) {
+				goto convert_error; // Clean up.
 			}
-			ht = Z_ARRVAL_P(zdict);
+			++depth;
+			continue;
 		} else {
-			// Get global symbol table.
-			ht = &EG(symbol_table);
+			pyval = zval_to_PyObject_scalar(zv, conv);
+			if (pyval == NULL) {
+				goto convert_error; // Clean up.
+			}
+		}
+		
+		// Set new python value in list or dict.
+		// .. NOTE: The python value reference is stolen.
+		if (!pyphp_z2p_frame_set(f, pyval, conv)) {
+			goto convert_error; // Clean up.
 		}
 	}
 	
-	// Set php value.
-	// .. NOTE: Hash key length MUST include NULL byte.
-	// .. NOTE: The zv reference is stolen.
-	if (zend_symtable_update(ht, key, (unsigned int)keylen + 1, &zv, sizeof(zv), NULL) != SUCCESS) {
-		PyErr_SetString(InternalErrorType, "Failed to set key/value.");
-		return false;
+	// Clean-up temporary values.
+	if (conv_is_tmp) {
+		pyphp_conv_free(conv);
 	}
-	return true;
-}
-
-/**
-Gets the value of the specified configuration option.
-
-*key* (``const char *``) is the name of the option to get.
-
-*keylen* (``int``) is the length of *key*.
-
-*orig* (``bool``) is whether the original configuration option should be
-returned (``true``), or the current value (``false``).
-
-Returns a borrowed reference to the option value (``const char *``).
-*/
-static const char * pyphp_php_ini_get(const char * key, int keylen, bool orig) {
-	/*
-	.. NOTE: This function is derived from ``ini_get()`` from
-	   ``php-5.3.13/ext/standard/basic_functions.c``.
-	*/
-	char * val = NULL; // borrowed
-	
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return NULL;
+	if (frames != frames_local) {
+		PyMem_Free(frames);
 	}
 	
-	// Get INI value.
-	// .. NOTE: I think it is safe to cast to `char *`.
-	// .. NOTE: INI key length must include NULL byte.
-	val = zend_ini_string((char *)key, (unsigned int)keylen + 1, (int)orig);
-	if (val == NULL) {
-		PyErr_SetString(PyExc_KeyError, "key is not set.");
-		return NULL;
+	// Return new python list or dict.
+	return pyresult;
+	
+	// Failed to convert php array or object to python list or dict.
+	convert_error: {
+		// Destroy python lists and dicts, along with the values they contain.
+		for (i = 0; i < depth; ++i) {
+			Py_XDECREF(frames[i].pylist);
+			Py_XDECREF(frames[i].pydict);
+		}
+		if (conv_is_tmp) {
+			pyphp_conv_free(conv);
+		}
+		if (frames != frames_local) {
+			PyMem_Free(frames);
+		}
 	}
-	return val;
+	return NULL;
 }
 
-/*
-NOTE: This function is copied from ``php_ini_get_option()`` from
-``php-5.3.13/ext/standard/basic_functions.c``.
-*/
-static int php_ini_get_option(zend_ini_entry * ini_entry TSRMLS_DC, int num_args, va_list args, zend_hash_key * hash_key) {
-	zval *ini_array = va_arg(args, zval *);
-	int module_number = va_arg(args, int);
-	int details = va_arg(args, int);
-	zval *option;
-
-	if (module_number != 0 && ini_entry->module_number != module_number) {
-		return 0;
-	}
-
-	if (hash_key->nKeyLength == 0 ||
-		hash_key->arKey[0] != 0
-	) {
-		if (details) {
-			MAKE_STD_ZVAL(option);
-			array_init(option);
-
-			if (ini_entry->orig_value) {
-				add_assoc_stringl(option, "global_value", ini_entry->orig_value, ini_entry->orig_value_length, 1);
-			} else if (ini_entry->value) {
-				add_assoc_stringl(option, "global_value", ini_entry->value, ini_entry->value_length, 1);
-			} else {
-				add_assoc_null(option, "global_value");
-			}
+/**
+Returns the length of the UTF-8 encoded character at the start of the
+specified string.
 
-			if (ini_entry->value) {
-				add_assoc_stringl(option, "local_value", ini_entry->value, ini_entry->value_length, 1);
-			} else {
-				add_assoc_null(option, "local_value");
-			}
+*str* (``const unsigned char *``) is the string.
 
-			add_assoc_long(option, "access", ini_entry->modifiable);
+*len* (``size_t``) is the length of *str*.
 
-			add_assoc_zval_ex(ini_array, ini_entry->name, ini_entry->name_length, option);
-		} else {
-			if (ini_entry->value) {
-				add_assoc_stringl(ini_array, ini_entry->name, ini_entry->value, ini_entry->value_length, 1);
-			} else {
-				add_assoc_null(ini_array, ini_entry->name);
-			}
+Returns the length of the character (``size_t``) if it is valid; otherwise,
+``0``.
+*/
+static size_t utf8_char_length(const unsigned char * str, size_t len) {
+	// Overlong encodings, surrogates and code points above U+10FFFF are
+	// invalid.
+	if (str[0] < 0xC2) {
+		return 0;
+	} else if (str[0] < 0xE0) {
+		return len >= 2 && (str[1] & 0xC0) == 0x80 ? 2 : 0;
+	} else if (str[0] < 0xF0) {
+		if (len < 3 || (str[2] & 0xC0) != 0x80) {
+			return 0;
+		}
+		if (str[0] == 0xE0) {
+			return 0xA0 <= str[1] && str[1] <= 0xBF ? 3 : 0;
+		} else if (str[0] == 0xED) {
+			return 0x80 <= str[1] && str[1] <= 0x9F ? 3 : 0;
 		}
+		return (str[1] & 0xC0) == 0x80 ? 3 : 0;
+	} else if (str[0] < 0xF5) {
+		if (len < 4 || (str[2] & 0xC0) != 0x80 || (str[3] & 0xC0) != 0x80) {
+			return 0;
+		}
+		if (str[0] == 0xF0) {
+			return 0x90 <= str[1] && str[1] <= 0xBF ? 4 : 0;
+		} else if (str[0] == 0xF4) {
+			return 0x80 <= str[1] && str[1] <= 0x8F ? 4 : 0;
+		}
+		return (str[1] & 0xC0) == 0x80 ? 4 : 0;
 	}
 	return 0;
 }
 
 /**
-Gets all configuration options.
+Appends a JSON string to the string being written.
 
-*ext* (``const char *``) optionally is the name of the specific extension to
-get the configuration options for. If ``NULL`, all options will be returned.
+*buf* (``struct serialize_buf_t *``) is the string.
 
-*extlen* (``int``) is the length of *ext*.
+*str* (``const char *``) is the UTF-8 encoded string.
 
-*details* (``bool``) is whether detailed settings should be returned
-(``true``), or not (``false``).
+*len* (``size_t``) is the length of *str*.
 
-Returns a dict (``zval *``) mapping option key (``char *``) to value
-(``char *``).
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
 */
-static zval * pyphp_php_ini_get_all(const char * ext, int extlen, bool details) {
-	/*
-	.. NOTE: This function is derived from ``ini_get_all()`` and
-	   ``php_ini_get_option()`` from
-	   ``php-5.3.13/ext/standard/basic_functions.c``.
-	*/
-	zval * zdict = NULL; // owned
+static bool json_write_string(struct serialize_buf_t * buf, const char * str, size_t len) {
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char * s = (const unsigned char *)str; // borrowed
+	size_t start = 0;
+	size_t i = 0;
+	size_t n = 0;
+	char esc[6];
 	
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return NULL;
+	if (!serialize_write(buf, "\"", 1)) {
+		return false;
 	}
-	
-	{
-		int zmodnum = 0;
-		TSRMLS_FETCH();
-		
-		// Get php module extension ID.
-		zend_ini_sort_entries(TSRMLS_C);
-		if (ext != NULL) {
-			zend_module_entry * zmod = NULL;
-			if (zend_symtable_find(&module_registry, ext, extlen + 1, &zmod) != SUCCESS) {
-				PyErr_SetString(PyExc_KeyError, "extension is not set.");
-				return NULL;
+	while (i < len) {
+		// Copy runs of characters which do not need to be escaped.
+		if (s[i] >= 0x20 && s[i] < 0x80 && s[i] != '"' && s[i] != '\\') {
+			++i;
+			continue;
+		} else if (s[i] >= 0x80) {
+			n = utf8_char_length(s + i, len - i);
+			if (n == 0) {
+				PyErr_Format(PyExc_ValueError, "PHP string is not valid UTF-8 at offset:%" PY_Z "i.", (Py_ssize_t)i);
+				return false;
 			}
-			zmodnum = zmod->module_number;
+			i += n;
+			continue;
 		}
 		
-		// Copy ini options to php dict.
-		MAKE_STD_ZVAL(zdict);
-		zend_hash_apply_with_arguments(EG(ini_directives) TSRMLS_CC, (apply_func_args_t)php_ini_get_option, 3, zdict, zmodnum, (int)details);
+		// Escape the character the same way as ``json.dumps()``.
+		if (!serialize_write(buf, str + start, (Py_ssize_t)(i - start))) {
+			return false;
+		}
+		esc[0] = '\\';
+		n = 2;
+		switch (s[i]) {
+			case '"': esc[1] = '"'; break;
+			case '\\': esc[1] = '\\'; break;
+			case '\b': esc[1] = 'b'; break;
+			case '\f': esc[1] = 'f'; break;
+			case '\n': esc[1] = 'n'; break;
+			case '\r': esc[1] = 'r'; break;
+			case '\t': esc[1] = 't'; break;
+			default:
+				esc[1] = 'u';
+				esc[2] = '0';
+				esc[3] = '0';
+				esc[4] = hex[s[i] >> 4];
+				esc[5] = hex[s[i] & 0xF];
+				n = 6;
+				break;
+		}
+		if (!serialize_write(buf, esc, (Py_ssize_t)n)) {
+			return false;
+		}
+		start = ++i;
 	}
-	return zdict;
+	return serialize_write(buf, str + start, (Py_ssize_t)(i - start)) && serialize_write(buf, "\"", 1);
 }
 
 /**
-Sets the value of the specified configuration option.
-
-*key* (``const char *``) is the name of the option to set.
-
-*keylen* (``int``) is the length of *key*.
+Appends a JSON number for the specified double to the string being written.
 
-*val* (``const char *``) is the value of the option to set.
+*buf* (``struct serialize_buf_t *``) is the string.
 
-*vallen (``int``) is the length of *val*.
+*value* (``double``) is the value.
 
-Returns ``true`` on success; otherwise, ``false``.
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
 */
-static bool pyphp_php_ini_set(const char * key, int keylen, const char * val, int vallen) {
-	/*
-	.. NOTE: This function is derived from ``ini_set()`` from
-	   ``php-5.3.13/ext/standard/basic_functions.c``.
-	*/
+static bool json_write_double(struct serialize_buf_t * buf, double value) {
+	char * repr = NULL; // owned
+	bool result;
 	
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+	// Write special values the same way as ``json.dumps()``.
+	if (Py_IS_NAN(value)) {
+		return serialize_write(buf, "NaN", 3);
+	} else if (Py_IS_INFINITY(value)) {
+		return value > 0 ? serialize_write(buf, "Infinity", 8) : serialize_write(buf, "-Infinity", 9);
 	}
-	
-	// Set INI value.
-	// .. NOTE: INI key length must include NULL byte but value length MUST NOT.
-	if (zend_alter_ini_entry((char *)key, (unsigned int)keylen + 1, (char *)val, (unsigned int)vallen, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME) != SUCCESS) {
-		PyErr_SetString(InternalErrorType, "Failed to set option key/value.");
+	repr = PyOS_double_to_string(value, 'r', 0, Py_DTSF_ADD_DOT_0, NULL);
+	if (repr == NULL) {
 		return false;
 	}
-	return true;
+	result = serialize_write(buf, repr, (Py_ssize_t)strlen(repr));
+	PyMem_Free(repr);
+	return result;
 }
 
 /**
-Sets the PHP output callback function.
+Encodes a PHP value as JSON without converting it to a Python value first.
 
-*pyout* (``PyObject *``) is the output callback.
+*zobj* (``zval *``) is the php value.
 
-Returns ``true`` on success; otherwise, ``false``. 
+.. NOTE: Arrays are encoded as JSON arrays if their keys are exactly the
+   indices 0 through n-1 (see ``zval_is_list()``); otherwise, as JSON
+   objects. Objects are encoded as JSON objects of their public properties.
+   The result is the same as ``json.dumps()`` with compact separators of
+   the value returned by ``zval_to_PyObject()``.
+
+Returns the UTF-8 encoded JSON (``str``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
 */
-static bool pyphp_php_output_callback_set(PyObject * pyout) {
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+static PyObject * zval_to_json(zval * zobj) {
+	/*
+	.. NOTE: Arrays are encoded iteratively with an explicit stack of frames the
+	   same way as they are converted by ``zval_to_PyObject()``.
+	
+	.. NOTE: Recursive arrays are detected using the apply count of their hash
+	   tables the same way as they are by PHP's ``json_encode()``.
+	*/
+	struct serialize_buf_t buf;
+	struct pyphp_json_frame_t frames_local[PYPHP_STACK_INIT];
+	struct pyphp_json_frame_t * frames = frames_local; // owned
+	struct pyphp_json_frame_t * f = NULL; // borrowed
+	size_t frames_size = PYPHP_STACK_INIT;
+	size_t depth = 0;
+	size_t i = 0;
+	zval * zv = zobj; // borrowed
+	zval ** zdata = NULL; // borrowed
+	HashTable * ht = NULL; // borrowed
+	
+	if (zobj == NULL) {
+		PyErr_Format(InternalErrorType, "PHP value:%p is NULL.", (void *)zobj);
+		return NULL;
+	}
+	buf.len = 0;
+	buf.str = PyString_FromStringAndSize(NULL, SERIALIZE_INIT_SIZE);
+	if (buf.str == NULL) {
+		return NULL;
 	}
 	
-	// Set callback.
-	Py_INCREF(pyout);
-	Py_XDECREF(pyphp.pyout_cb);
-	pyphp.pyout_cb = pyout;
+	for (;;) {
+		// Encode php value.
+		ht = NULL;
+		switch (Z_TYPE_P(zv)) {
+			case IS_NULL:
+				if (!serialize_write(&buf, "null", 4)) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			case IS_BOOL:
+				if (!(Z_LVAL_P(zv) ? serialize_write(&buf, "true", 4) : serialize_write(&buf, "false", 5))) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			case IS_LONG:
+				if (!serialize_writef(&buf, "%ld", Z_LVAL_P(zv))) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			case IS_DOUBLE:
+				if (!json_write_double(&buf, Z_DVAL_P(zv))) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			case IS_STRING:
+			case IS_CONSTANT:
+				if (!json_write_string(&buf, Z_STRVAL_P(zv), (size_t)Z_STRLEN_P(zv))) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			case IS_RESOURCE:
+				if (!serialize_writef(&buf, "\"<Resource %li>\"", Z_RESVAL_P(zv))) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			case IS_ARRAY:
+			case IS_CONSTANT_ARRAY:
+				ht = Z_ARRVAL_P(zv);
+				break;
+				
+			case IS_OBJECT:
+				ht = zval_object_properties(zv);
+				if (ht == NULL) {
+					goto json_error; // Clean up.
+				}
+				break;
+				
+			default:
+				PyErr_Format(PyExc_TypeError, "PHP type:%hhu cannot be encoded as JSON.", Z_TYPE_P(zv));
+				goto json_error; // Clean up.
+		}
+		
+		// Start encoding the array or object.
+		if (ht != NULL) {
+			if (ht->nApplyCount > 0) {
+				PyErr_SetString(PyExc_ValueError, "Recursive PHP value cannot be encoded as JSON.");
+				goto json_error; // Clean up.
+			}
+			if (!pyphp_depth_check(depth)) {
+				goto json_error; // Clean up.
+			}
+			if (depth == frames_size && !pyphp_stack_grow((void **)&frames, frames_local, &frames_size, sizeof(*frames))) {
+				goto json_error; // Clean up.
+			}
+			f = &frames[depth];
+			f->ht = ht;
+			f->p = ht->pListHead;
+			f->index = 0;
+			f->len = (ulong)zend_hash_num_elements(ht);
+			f->is_object = Z_TYPE_P(zv) == IS_OBJECT;
+			f->is_list = !f->is_object && zval_is_list(zv);
+			if (!serialize_write(&buf, f->is_list ? "[" : "{", 1)) {
+				goto json_error; // Clean up.
+			}
+			ht->nApplyCount += 1;
+			++depth;
+		}
+		
+		// Find the next value, finishing the arrays and objects which are done.
+		zv = NULL;
+		while (depth > 0 && zv == NULL) {
+			f = &frames[depth - 1];
+			if (f->is_list) {
+				if (f->index < f->len) {
+					// Get the element at the next index.
+					// .. NOTE: The elements are usually in index order so the next
+					//    bucket is checked before the index is looked up.
+					if (f->p != NULL && f->p->h == f->index) {
+						zv = *(zval **)f->p->pData;
+						f->p = f->p->pListNext;
+					} else if (zend_hash_index_find(f->ht, f->index, (void **)&zdata) == SUCCESS) {
+						zv = *zdata;
+					} else {
+						PyErr_Format(InternalErrorType, "Failed to find index:%lu in php array.", f->index);
+						goto json_error; // Clean up.
+					}
+					if (f->index > 0 && !serialize_write(&buf, ",", 1)) {
+						goto json_error; // Clean up.
+					}
+					f->index += 1;
+					continue;
+				}
+			} else {
+				// Skip protected and private properties.
+				while (f->is_object && f->p != NULL && !bucket_is_public(f->p)) {
+					f->p = f->p->pListNext;
+				}
+				if (f->p != NULL) {
+					// Write the key of the element.
+					// .. NOTE: Numeric keys are marked by nKeyLength == 0 and stored
+					//    in h.
+					if (f->index > 0 && !serialize_write(&buf, ",", 1)) {
+						goto json_error; // Clean up.
+					}
+					if (f->p->nKeyLength == 0) {
+						if (!serialize_writef(&buf, "\"%ld\":", (long)f->p->h)) {
+							goto json_error; // Clean up.
+						}
+					} else {
+						if (!json_write_string(&buf, f->p->arKey, f->p->nKeyLength - 1) || !serialize_write(&buf, ":", 1)) {
+							goto json_error; // Clean up.
+						}
+					}
+					zv = *(zval **)f->p->pData;
+					f->p = f->p->pListNext;
+					f->index += 1;
+					continue;
+				}
+			}
+			if (!serialize_write(&buf, f->is_list ? "]" : "}", 1)) {
+				goto json_error; // Clean up.
+			}
+			f->ht->nApplyCount -= 1;
+			--depth;
+		}
+		if (zv == NULL) {
+			break;
+		}
+	}
 	
-	return true;
+	// Clean up temporary values.
+	if (frames != frames_local) {
+		PyMem_Free(frames);
+	}
+	
+	// Return JSON string.
+	if (_PyString_Resize(&buf.str, buf.len) != 0) {
+		return NULL;
+	}
+	return buf.str;
+	
+	// Failed to encode php value.
+	json_error: {
+		for (i = 0; i < depth; ++i) {
+			frames[i].ht->nApplyCount -= 1;
+		}
+		if (frames != frames_local) {
+			PyMem_Free(frames);
+		}
+		Py_XDECREF(buf.str);
+	}
+	return NULL;
 }
 
+
+
 /**
-Sets the PHP output file pointer.
+Returns the size of the items of a packed numeric buffer.
 
-*out_fp* (``int``) is the output file pointer.
+*typecode* (``char``) is the ``array`` module type code of the items: ``b``,
+``B``, ``h``, ``H``, ``i``, ``I``, ``l``, ``L``, ``q``, ``Q``, ``f`` or ``d``.
 
-Returns ``true`` on success; otherwise, ``false``.
+Returns the item size (``size_t``) if *typecode* is supported; otherwise,
+``0``.
 */
-static bool pyphp_php_output_fp_set(FILE * out_fp) {
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+static size_t buffer_itemsize(char typecode) {
+	switch (typecode) {
+		case 'b': return sizeof(signed char);
+		case 'B': return sizeof(unsigned char);
+		case 'h': return sizeof(short);
+		case 'H': return sizeof(unsigned short);
+		case 'i': return sizeof(int);
+		case 'I': return sizeof(unsigned int);
+		case 'l': return sizeof(long);
+		case 'L': return sizeof(unsigned long);
+		case 'q': return sizeof(PY_LONG_LONG);
+		case 'Q': return sizeof(unsigned PY_LONG_LONG);
+		case 'f': return sizeof(float);
+		case 'd': return sizeof(double);
 	}
-	
-	// Set file pointer.
-	pyphp.out_fp = out_fp;
-	
-	return true;
+	return 0;
 }
 
 /**
-Sets the PHP error callback function.
+Converts a packed numeric buffer to a PHP array.
 
-*pyerr* (``PyObject *``) is the error callback.
+*buf* (``const char *``) is the buffer. It does not need to be aligned.
 
-Returns ``true`` on success; otherwise, ``false``. 
+*len* (``Py_ssize_t``) is the length of *buf* in bytes.
+
+*typecode* (``char``) is the type code of the items (see
+``buffer_itemsize()``). Integers become PHP longs, except unsigned integers
+larger than a PHP long which become PHP doubles as they do in PHP. Floats
+become PHP doubles.
+
+Returns the new PHP array (``zval *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
 */
-static bool pyphp_php_error_callback_set(PyObject * pyerr) {
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+static zval * buffer_to_zval(const char * buf, Py_ssize_t len, char typecode) {
+	size_t itemsize = 0;
+	Py_ssize_t count = 0;
+	Py_ssize_t i = 0;
+	HashTable * ht = NULL; // borrowed
+	zval * zarray = NULL; // owned
+	zval * zv = NULL; // owned
+	
+	itemsize = buffer_itemsize(typecode);
+	if (itemsize == 0) {
+		PyErr_Format(PyExc_ValueError, "typecode:%c is not supported.", typecode);
+		return NULL;
+	}
+	if (len % (Py_ssize_t)itemsize != 0) {
+		PyErr_Format(PyExc_ValueError, "Buffer length:%" PY_Z "i is not a multiple of typecode:%c item size:%" PY_Z "u.", len, typecode, itemsize);
+		return NULL;
+	}
+	count = len / (Py_ssize_t)itemsize;
+	if (INT_MAX < count) {
+		PyErr_Format(PyExc_ValueError, "Buffer length:%" PY_Z "i must be between 0 and %i items inclusive.", count, INT_MAX);
+		return NULL;
 	}
 	
-	// Set callback.
-	Py_INCREF(pyerr);
-	Py_XDECREF(pyphp.pyerr_cb);
-	pyphp.pyerr_cb = pyerr;
+	// Initialize PHP array large enough for all of the items.
+	MAKE_STD_ZVAL(zarray);
+	if (zarray == NULL) {
+		PyErr_Format(InternalErrorType, "Failed to create zval.");
+		return NULL;
+	}
+	if (array_init_size(zarray, (unsigned int)count) != SUCCESS) {
+		PyErr_Format(InternalErrorType, "Failed to initialize zval array.");
+		goto buffer_error;
+	}
+	ht = Z_ARRVAL_P(zarray);
 	
-	return true;
+	// Append each item as a PHP value. There is one loop per type so that the
+	// conversion of each item is a single load.
+	// .. NOTE: Items are copied out with memcpy() because the buffer may not be
+	//    aligned (e.g., a slice of a str).
+	#define BUFFER_TO_ZVAL_LOOP(ctype, set) { \
+		ctype item; \
+		for (i = 0; i < count; ++i) { \
+			memcpy(&item, buf + i * (Py_ssize_t)sizeof(ctype), sizeof(ctype)); \
+			MAKE_STD_ZVAL(zv); \
+			set; \
+			if (zend_hash_next_index_insert(ht, &zv, sizeof(zv), NULL) != SUCCESS) { \
+				PyErr_Format(InternalErrorType, "Failed to set index:%" PY_Z "i in php array.", i); \
+				goto buffer_error; \
+			} \
+			zv = NULL; \
+		} \
+	}
+	#define BUFFER_TO_ZVAL_ULONG(value) \
+		if ((value) > (unsigned PY_LONG_LONG)LONG_MAX) { \
+			ZVAL_DOUBLE(zv, (double)(value)); \
+		} else { \
+			ZVAL_LONG(zv, (long)(value)); \
+		}
+	#define BUFFER_TO_ZVAL_LLONG(value) \
+		if ((value) < LONG_MIN || (value) > LONG_MAX) { \
+			ZVAL_DOUBLE(zv, (double)(value)); \
+		} else { \
+			ZVAL_LONG(zv, (long)(value)); \
+		}
+	switch (typecode) {
+		case 'b': BUFFER_TO_ZVAL_LOOP(signed char, ZVAL_LONG(zv, item)); break;
+		case 'B': BUFFER_TO_ZVAL_LOOP(unsigned char, ZVAL_LONG(zv, item)); break;
+		case 'h': BUFFER_TO_ZVAL_LOOP(short, ZVAL_LONG(zv, item)); break;
+		case 'H': BUFFER_TO_ZVAL_LOOP(unsigned short, ZVAL_LONG(zv, item)); break;
+		case 'i': BUFFER_TO_ZVAL_LOOP(int, ZVAL_LONG(zv, item)); break;
+		case 'I': BUFFER_TO_ZVAL_LOOP(unsigned int, BUFFER_TO_ZVAL_ULONG(item)); break;
+		case 'l': BUFFER_TO_ZVAL_LOOP(long, ZVAL_LONG(zv, item)); break;
+		case 'L': BUFFER_TO_ZVAL_LOOP(unsigned long, BUFFER_TO_ZVAL_ULONG(item)); break;
+		case 'q': BUFFER_TO_ZVAL_LOOP(PY_LONG_LONG, BUFFER_TO_ZVAL_LLONG(item)); break;
+		case 'Q': BUFFER_TO_ZVAL_LOOP(unsigned PY_LONG_LONG, BUFFER_TO_ZVAL_ULONG(item)); break;
+		case 'f': BUFFER_TO_ZVAL_LOOP(float, ZVAL_DOUBLE(zv, item)); break;
+		case 'd': BUFFER_TO_ZVAL_LOOP(double, ZVAL_DOUBLE(zv, item)); break;
+	}
+	#undef BUFFER_TO_ZVAL_LLONG
+	#undef BUFFER_TO_ZVAL_ULONG
+	#undef BUFFER_TO_ZVAL_LOOP
+	
+	// Return new PHP array.
+	return zarray;
+	
+	// Failed to convert buffer to php array.
+	buffer_error: {
+		// Destroy orphaned php value.
+		if (zv != NULL) {
+			zval_del(&zv);
+		}
+		// Destroy php array.
+		zval_del(&zarray);
+	}
+	return NULL;
 }
 
 /**
-Sets the PHP error file pointer.
+Converts a PHP list of numbers to a packed numeric buffer.
 
-*err_fp* (``int``) is the error file pointer.
+*zarray* (``zval *``) is the PHP array. It must be a list (see
+``zval_is_list()``) of PHP longs, doubles, bools or nulls.
+
+*typecode* (``char``) is the type code of the items (see
+``buffer_itemsize()``).
+
+*buf* (``char *``) is where to store the items. It must be aligned for, and
+large enough to hold, all of the items.
+
+*error* (``const char **``) is set to the error message on failure.
 
 Returns ``true`` on success; otherwise, ``false``.
+
+.. NOTE: This does not use the Python API so it can be called while the GIL
+   is released.
 */
-static bool pyphp_php_error_fp_set(FILE * err_fp) {
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+static bool zval_to_buffer(zval * zarray, char typecode, char * buf, const char ** error) {
+	Bucket * p = NULL; // borrowed
+	zval * zv = NULL; // borrowed
+	
+	// Store each item. There is one loop per type so that each item is a
+	// single store.
+	// .. NOTE: Numeric indices are stored in h, and zval_is_list() ensured that
+	//    they are all within the list.
+	// .. NOTE: A double is truncated so it must be greater than lo - 1 and less
+	//    than hi + 1. Both bounds are compared as exact doubles: lo is a power
+	//    of two (or 0), and hi + 1 is computed as the power of two hi / 2 + 1
+	//    doubled because (double)hi rounds up for 64-bit types. For 64-bit
+	//    types, lo - 1 rounds to lo, which is why lo itself is also accepted.
+	#define ZVAL_TO_BUFFER_LOOP(ctype, lo, hi, checked) { \
+		ctype * items = (ctype *)buf; \
+		for (p = Z_ARRVAL_P(zarray)->pListHead; p != NULL; p = p->pListNext) { \
+			zv = *(zval **)p->pData; \
+			if (Z_TYPE_P(zv) == IS_DOUBLE) { \
+				if (checked && !(((double)(lo) - 1.0 < Z_DVAL_P(zv) || Z_DVAL_P(zv) == (double)(lo)) && Z_DVAL_P(zv) < (double)((hi) / 2 + 1) * 2.0)) { \
+					goto range_error; \
+				} \
+				items[p->h] = (ctype)Z_DVAL_P(zv); \
+			} else if (Z_TYPE_P(zv) == IS_LONG || Z_TYPE_P(zv) == IS_BOOL) { \
+				if (checked && !((lo) <= Z_LVAL_P(zv) && Z_LVAL_P(zv) <= (hi))) { \
+					goto range_error; \
+				} \
+				items[p->h] = (ctype)Z_LVAL_P(zv); \
+			} else if (Z_TYPE_P(zv) == IS_NULL) { \
+				items[p->h] = 0; \
+			} else { \
+				goto type_error; \
+			} \
+		} \
 	}
+	switch (typecode) {
+		case 'b': ZVAL_TO_BUFFER_LOOP(signed char, SCHAR_MIN, SCHAR_MAX, true); break;
+		case 'B': ZVAL_TO_BUFFER_LOOP(unsigned char, 0, UCHAR_MAX, true); break;
+		case 'h': ZVAL_TO_BUFFER_LOOP(short, SHRT_MIN, SHRT_MAX, true); break;
+		case 'H': ZVAL_TO_BUFFER_LOOP(unsigned short, 0, USHRT_MAX, true); break;
+		case 'i': ZVAL_TO_BUFFER_LOOP(int, INT_MIN, INT_MAX, true); break;
+		case 'I': ZVAL_TO_BUFFER_LOOP(unsigned int, 0, UINT_MAX, true); break;
+		case 'l': ZVAL_TO_BUFFER_LOOP(long, LONG_MIN, LONG_MAX, true); break;
+		case 'L': ZVAL_TO_BUFFER_LOOP(unsigned long, 0, ULONG_MAX, true); break;
+		case 'q': ZVAL_TO_BUFFER_LOOP(PY_LONG_LONG, PY_LLONG_MIN, PY_LLONG_MAX, true); break;
+		case 'Q': ZVAL_TO_BUFFER_LOOP(unsigned PY_LONG_LONG, 0, PY_ULLONG_MAX, true); break;
+		case 'f': ZVAL_TO_BUFFER_LOOP(float, 0, 0, false); break;
+		case 'd': ZVAL_TO_BUFFER_LOOP(double, 0, 0, false); break;
+		default:
+			*error = "typecode is not supported.";
+			return false;
+	}
+	#undef ZVAL_TO_BUFFER_LOOP
+	return true;
 	
-	// Set file pointer.
-	pyphp.err_fp = err_fp;
+	range_error: {
+		*error = "Array item is out of range for typecode.";
+	}
+	return false;
 	
-	return true;
+	type_error: {
+		*error = "Array item is not a number.";
+	}
+	return false;
+}
+
+
+
+/******************************* PHP Methods ********************************/
+
+static bool pyphp_php_exec_end(bool bailout);
+static bool pyphp_php_request_can_end();
+static void pyphp_php_fcall_cache_clear();
+static bool pyphp_php_restart();
+static void pyphp_php_log_cb(char * message);
+static int pyphp_php_output_cb(const char * str, unsigned int str_length TSRMLS_DC);
+static void pyphp_php_output_flush_cb(void * server_ctx);
+static int pyphp_php_startup_cb(sapi_module_struct * sapi);
+
+/**
+Acquires the lock of the specified interpreter which gives the calling thread
+exclusive access to it. The lock is reentrant for the thread that owns it so
+that Python code called back from PHP (e.g., output, logging, errors, etc.)
+can use PyPHP.
+
+.. NOTE: The GIL must be held. It is released while waiting for the lock.
+
+*interp* (``struct pyphp_interp_t *``) is the interpreter.
+*/
+static void pyphp_lock_acquire(struct pyphp_interp_t * interp) {
+	long ident = PyThread_get_thread_ident();
+	
+	if (interp->lock_depth > 0 && interp->lock_owner == ident) {
+		// This thread already owns the lock.
+		++interp->lock_depth;
+		return;
+	}
+	if (!PyThread_acquire_lock(interp->lock, NOWAIT_LOCK)) {
+		Py_BEGIN_ALLOW_THREADS
+		PyThread_acquire_lock(interp->lock, WAIT_LOCK);
+		Py_END_ALLOW_THREADS
+	}
+	interp->lock_owner = ident;
+	interp->lock_depth = 1;
 }
 
 /**
-Sets the PHP log callback function.
+Releases the lock acquired by ``pyphp_lock_acquire()``.
 
-*pylog* (``PyObject *``) is the log callback.
+.. NOTE: The GIL must be held.
 
-Returns ``true`` on success; otherwise, ``false``. 
+*interp* (``struct pyphp_interp_t *``) is the interpreter.
 */
-static bool pyphp_php_log_callback_set(PyObject * pylog) {
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return false;
+static void pyphp_lock_release(struct pyphp_interp_t * interp) {
+	if (--interp->lock_depth == 0) {
+		interp->lock_owner = 0;
+		PyThread_release_lock(interp->lock);
 	}
+}
+
+/**
+Enters the specified interpreter: acquires its lock, makes it the current
+interpreter of the calling thread and, when PHP is thread-safe (ZTS),
+switches to its TSRM context. Interpreters can be entered recursively.
+
+*pyinterp* (``PyObject *``) is the interpreter (``InterpreterObject *``).
+
+Returns the previous interpreter (``struct pyphp_interp_t *``) of the calling
+thread which must be passed to ``pyphp_leave()``.
+*/
+static struct pyphp_interp_t * pyphp_enter(PyObject * pyinterp) {
+	struct pyphp_interp_t * interp = ((InterpreterObject *)pyinterp)->interp; // borrowed
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	
-	// Set callback.
-	Py_INCREF(pylog);
-	Py_XDECREF(pyphp.pylog_cb);
-	pyphp.pylog_cb = pylog;
+	pyphp_lock_acquire(interp);
+	prev = pyphp_interp;
+	pyphp_interp = interp;
+	#ifdef ZTS
+	if (interp->ctx != NULL) {
+		tsrm_set_interpreter_context(interp->ctx);
+	}
+	#endif
+	return prev;
+}
+
+/**
+Leaves the specified interpreter entered by ``pyphp_enter()``.
+
+*pyinterp* (``PyObject *``) is the interpreter (``InterpreterObject *``).
+
+*prev* (``struct pyphp_interp_t *``) is the previous interpreter returned by
+``pyphp_enter()``.
+*/
+static void pyphp_leave(PyObject * pyinterp, struct pyphp_interp_t * prev) {
+	struct pyphp_interp_t * interp = ((InterpreterObject *)pyinterp)->interp; // borrowed
 	
-	return true;
+	#ifdef ZTS
+	tsrm_set_interpreter_context(prev != NULL ? prev->ctx : NULL);
+	#endif
+	pyphp_interp = prev;
+	pyphp_lock_release(interp);
 }
 
 /**
-Sets the PHP log file pointer.
+Releases the GIL right before a PHP API call starts.
 
-*log_fp* (``int``) is the log file pointer.
+.. NOTE: The PyPHP lock must be held.
 
-Returns ``true`` on success; otherwise, ``false``.
+Returns whether the GIL was released (``true``), or whether it was already
+released (``false``). This must be passed to ``pyphp_end_php()``.
 */
-static bool pyphp_php_log_fp_set(FILE * log_fp) {
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+static bool pyphp_begin_php() {
+	if (pyphp_interp->pysave != NULL) {
 		return false;
 	}
-	
-	// Set file pointer.
-	pyphp.log_fp = log_fp;
-	
+	pyphp_interp->pysave = PyEval_SaveThread();
 	return true;
 }
 
-
 /**
-Shuts-down PHP. PHP can be re-started after being shutdown.
+Re-acquires the GIL after the end of a PHP API call.
+
+*released* (``bool``) is the value returned by ``pyphp_begin_php()``.
 */
-static void pyphp_php_shutdown() {
-	if (!pyphp.is_started) {
-		// Since PHP is not started, do nothing.
-		return;
+static void pyphp_end_php(bool released) {
+	PyThreadState * save = pyphp_interp->pysave; // borrowed
+	
+	if (released) {
+		pyphp_interp->pysave = NULL;
+		PyEval_RestoreThread(save);
 	}
-	pyphp.is_started = false;
+}
+
+/**
+Re-acquires the GIL when Python code is encountered during a PHP API call
+(i.e., output, logging, errors, etc.).
+
+Returns whether the GIL was re-acquired (``true``), or whether it was already
+held (``false``). This must be passed to ``pyphp_end_py()``.
+*/
+static bool pyphp_begin_py() {
+	PyThreadState * save = NULL; // borrowed
 	
-	php_request_shutdown(NULL);
+	if (pyphp_interp == NULL || pyphp_interp->pysave == NULL) {
+		return false;
+	}
+	save = pyphp_interp->pysave;
+	pyphp_interp->pysave = NULL;
+	PyEval_RestoreThread(save);
+	return true;
 }
 
 /**
-Called when PHP encounters an error.
+Releases the GIL when returning to PHP.
 
-.. TODO: Test to see if Python catches a fatal error raised by PHP.
+*acquired* (``bool``) is the value returned by ``pyphp_begin_py()``.
+*/
+static void pyphp_end_py(bool acquired) {
+	if (acquired) {
+		pyphp_interp->pysave = PyEval_SaveThread();
+	}
+}
 
-*type* (``int``) is the error type.
+#ifdef HAVE_MMAP
+/**
+Maps the specified PHP script into memory so that the Zend scanner reads it
+directly instead of through stdio.
 
-*file* (``const char *``) is the file the error occured in.
+*path* (``const char *``) is the path of the script.
 
-*line* (``const unsigned int``) is the line the error occured on.
+*zfile* (``zend_file_handle *``) is the file handle to setup as a mapped
+handle (``ZEND_HANDLE_MAPPED``).
 
-*format* (``const char *``) is the error message format.
+.. NOTE: This does not use any Python or PHP APIs so that it can be called
+   while the GIL is released.
 
-*args* (``va_list``) is the error message arguments.
+Returns ``true`` on success; otherwise, ``false`` in which case the script
+should be read through a file pointer instead.
 */
-static void pyphp_php_error_cb(int type, const char * file, const unsigned int line, const char * format, va_list args) {
-	char * error = NULL;
-	bool is_fatal = false;
+static bool pyphp_php_file_handle_map(const char * path, zend_file_handle * zfile) {
+	struct stat st;
+	size_t size;
+	size_t pagesize;
+	char * base = NULL; // owned
+	long sc;
+	int fd;
 	
-	switch (type) {
-		case E_ERROR:
-			is_fatal = true;
-			error = "Fatal Error";
-			break;
-		
-		case E_CORE_ERROR:
-			is_fatal = true;
-			error = "Fatal Core Error";
-			break;
-		
-		case E_COMPILE_ERROR:
-			is_fatal = true;
-			error = "Fatal Compile Error";
-			break;
-			
-		case E_USER_ERROR:
-			is_fatal = true;
-			error = "Fatal User Error";
-			break;
-			
-		case E_RECOVERABLE_ERROR:
-			error = "Recoverable Error";
-			break;
-			
-		case E_WARNING:
-			error = "Warning";
-			break;
-		
-		case E_CORE_WARNING:
-			error = "Core Warning";
-			break;
-			
-		case E_COMPILE_WARNING:
-			error = "Compile Warning";
-			break;
-			
-		case E_USER_WARNING:
-			error = "User Warning";
-			break;
-			
-		case E_PARSE:
-			error = "Parse Error";
-			break;
-			
-		case E_NOTICE:
-			error = "Notice";
+	sc = sysconf(_SC_PAGESIZE);
+	if (sc <= 0) {
+		return false;
+	}
+	pagesize = (size_t)sc;
+	
+	fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return false;
+	}
+	if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_size <= 0 || st.st_size > INT_MAX - ZEND_MMAP_AHEAD) {
+		close(fd);
+		return false;
+	}
+	size = (size_t)st.st_size;
+	
+	// The scanner reads up to ZEND_MMAP_AHEAD bytes past the end of the script
+	// which must be zeros. The kernel zero fills the rest of the last page of
+	// the mapping, so only scripts which leave at least ZEND_MMAP_AHEAD bytes
+	// free in their last page are mapped. The others are read through stdio.
+	// .. NOTE: This also keeps the whole mapping within the pages of the
+	//    script so that it is released whether PHP unmaps *len* or *len* plus
+	//    ZEND_MMAP_AHEAD bytes (munmap() releases whole pages).
+	if (size % pagesize == 0 || pagesize - size % pagesize < ZEND_MMAP_AHEAD) {
+		close(fd);
+		return false;
+	}
+	base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (base == MAP_FAILED) {
+		return false;
+	}
+	
+	// Setup zend file handle.
+	// .. NOTE: PHP unmaps *map* when it destroys the file handle. The stream
+	//    handle is not used except to identify the file handle so it is set
+	//    to the (unique) mapping.
+	memset(zfile, 0, sizeof(*zfile));
+	zfile->type = ZEND_HANDLE_MAPPED;
+	zfile->filename = (char *)path; // NOTE: I think this cast is safe.
+	zfile->opened_path = NULL;
+	zfile->free_filename = 0;
+	zfile->handle.stream.handle = base;
+	zfile->handle.stream.mmap.map = base;
+	zfile->handle.stream.mmap.buf = base;
+	zfile->handle.stream.mmap.len = size;
+	return true;
+}
+#endif
+
+/**
+Closes the specified file handle which was not passed to PHP.
+
+*zfile* (``zend_file_handle *``) is the file handle.
+*/
+static void pyphp_php_file_handle_close(zend_file_handle * zfile) {
+	#ifdef HAVE_MMAP
+	if (zfile->type == ZEND_HANDLE_MAPPED) {
+		munmap(zfile->handle.stream.mmap.map, zfile->handle.stream.mmap.len);
+		return;
+	}
+	#endif
+	if (zfile->type == ZEND_HANDLE_FP) {
+		fclose(zfile->handle.fp);
+	}
+}
+
+/**
+Takes the shallow snapshot of a global variable.
+
+*zv* (``zval *``) is the value of the variable.
+
+*entry* (``struct pyphp_global_fp_t *``) will be set to the snapshot.
+*/
+static void pyphp_php_global_snapshot(zval * zv, struct pyphp_global_fp_t * entry) {
+	memset(entry, 0, sizeof(*entry));
+	entry->zv = zv;
+	entry->refcount = Z_REFCOUNT_P(zv);
+	entry->type = Z_TYPE_P(zv);
+	entry->is_ref = Z_ISREF_P(zv);
+	switch (Z_TYPE_P(zv)) {
+		case IS_NULL:
+		case IS_BOOL:
+		case IS_LONG:
+		case IS_RESOURCE:
+			entry->lval = Z_LVAL_P(zv);
 			break;
-		
-		case E_USER_NOTICE:
-			error = "User Notice";
+		case IS_DOUBLE:
+			entry->dval = Z_DVAL_P(zv);
 			break;
-			
-		case E_STRICT:
-			error = "Strict Standards";
+		case IS_STRING:
+			entry->str = Z_STRVAL_P(zv);
+			entry->len = Z_STRLEN_P(zv);
 			break;
-			
-		case E_DEPRECATED:
-			error = "Deprecated";
+		case IS_ARRAY:
+			entry->ht = Z_ARRVAL_P(zv);
+			entry->count = zend_hash_num_elements(Z_ARRVAL_P(zv));
 			break;
-			
-		case E_USER_DEPRECATED:
-			error = "User Deprecated";
+		case IS_OBJECT:
+			entry->handle = Z_OBJ_HANDLE_P(zv);
+			entry->handlers = Z_OBJ_HT_P(zv);
 			break;
-			
 		default:
-			error = "Unknown error";
+			// Constants are never stored in variables.
 			break;
 	}
-	
-	// If the error is fatal, raise a python exception.
-	if (is_fatal) {
-		char * message = NULL;
-		int msglen;
-		va_list vars;
-		
-		// Copy args so that the arguments are not consumed before being passed to
-		// internal PHP error handler.
-		va_copy(vars, args);
-		msglen = vspprintf(&message, PG(log_errors_max_len), format, vars);
-		va_end(vars);
-		if (message == NULL) {
-			PyErr_SetString(InternalErrorType, "Failed to format PHP fatal error message.");
-		} else {
-			// Raise fatal error.
-			PyObject * pyval = Py_BuildValue("(ss#sI)", error, message, (Py_ssize_t)msglen, file, line);
-			if (pyval != NULL) {
-				PyErr_SetObject(PhpFatalErrorType, pyval);
-				Py_DECREF(pyval);
-			}
-			// Clean up.
-			efree(message);
-		}
-	}
-	
-	// Call the internal PHP error handler.
-	pyphp.php_internal_error_cb(type, file, line, format, args);
 }
 
 /**
-Starts-up PHP.
+Takes the fingerprints of the global variables before a script is executed
+so that the ones the script adds or changes can be found afterward (see
+``pyphp_php_global_changes()``).
 
-*argc* (``int``) is the number of arguments.
+.. NOTE: This must be called between ``pyphp_begin_php()`` and
+   ``pyphp_end_php()``.
 
-*argv* (``char **``) is the arguments.
+.. NOTE: The values are not referenced so that taking the fingerprints does
+   not change how PHP separates them.
 
-Returns ``true`` on success; otherwise, ``false`` and raises a Python
-Exception.
+*fp* (``HashTable *``) will be initialized to the fingerprints mapped by the
+names of the variables. This must be destroyed with ``zend_hash_destroy()``
+unless PHP bails out.
 */
-static bool pyphp_php_startup(int argc, char ** argv) {
-	char * all_errors = NULL;
-	int all_errors_len;
+static void pyphp_php_global_fingerprint(HashTable * fp) {
+	struct pyphp_global_fp_t entry;
+	Bucket * p = NULL; // borrowed
+	TSRMLS_FETCH();
 	
-	if (pyphp.is_started) {
-		// Since PHP is already started, do nothing.
-		return true;
+	zend_hash_init(fp, zend_hash_num_elements(&EG(symbol_table)), NULL, NULL, 0);
+	for (p = EG(symbol_table).pListHead; p != NULL; p = p->pListNext) {
+		pyphp_php_global_snapshot(*(zval **)p->pData, &entry);
+		// .. NOTE: Numeric keys are marked by nKeyLength == 0 and stored in h,
+		//    which the quick functions handle.
+		zend_hash_quick_update(fp, p->arKey, p->nKeyLength, p->h, &entry, sizeof(entry), NULL);
 	}
-	
-	if (!pyphp.is_inited) {
-		// Initialize the PHP embed SAPI.
-		
-		pyphp.out_fp = stdout;
-		pyphp.err_fp = stdout;
-		pyphp.log_fp = stdout;
-	
-		// Override PHP embed log handler.
-		php_embed_module.log_message = pyphp_php_log_cb;
+}
 
-		// Override PHP embed output handler.
-		php_embed_module.ub_write = pyphp_php_output_cb;
-	
-		// Override PHP embed output flush handler.
-		php_embed_module.flush = pyphp_php_output_flush_cb; 
-	
-		// Override PHP embed startup handler.
-		php_embed_module.startup = pyphp_php_startup_cb;
+/**
+Compares the fingerprint of a global variable with its current value.
+
+*entry* (``struct pyphp_global_fp_t *``) is the fingerprint taken before the
+script was executed.
+
+*zv* (``zval *``) is the current value of the variable.
+
+Returns whether the variable was changed (``true``), or not (``false``).
+*/
+static bool pyphp_php_global_changed(struct pyphp_global_fp_t * entry, zval * zv) {
+	struct pyphp_global_fp_t now;
+	bool separated;
 	
-		// Completely initialize/startup PHP.
-		if (php_embed_init(argc, argv PTSRMLS_CC) != SUCCESS) {
-			// Raise internal error.
-			PyErr_SetString(InternalErrorType, "Failed to initialize PHP embed SAPI.");
-			return false;
-		}
-		pyphp.is_inited = true;
-		
-	} else {
-		// Re-initialize PHP.
-		if (php_request_startup(TSRMLS_C) != SUCCESS) {
-			// Raise internal error.
-			PyErr_SetString(InternalErrorType, "Failed to startup PHP.");
-			return false;
-		}
+	pyphp_php_global_snapshot(zv, &now);
+	if (now.type != entry->type) {
+		return true;
 	}
 	
-	// Setup INI settings.
-	all_errors_len = spprintf(&all_errors, 0, "%u", E_ALL);
-	if (all_errors == NULL) {
-		PyErr_Format(InternalErrorType, "Failed to convert E_ALL:%u to string.", E_ALL);
-		goto startup_error;
+	// A shared value which is made a reference (e.g., by ``global $x`` or
+	// ``$y = &$x``) is separated: the variable gets a copy with new string and
+	// array pointers, so only the lengths can be compared.
+	separated = now.zv != entry->zv && now.is_ref && !entry->is_ref && entry->refcount > 1;
+	if (now.zv != entry->zv && !separated) {
+		// The variable was assigned another value.
+		return true;
 	}
-	// .. NOTE: INI key length MUST include NULL byte but value length MUST NOT.
-	zend_alter_ini_entry("error_reporting", sizeof("error_reporting"), all_errors, all_errors_len, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
-	zend_alter_ini_entry("log_errors", sizeof("log_errors"), "1", sizeof("1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
-	zend_alter_ini_entry("display_errors", sizeof("display_errors"), "1", sizeof("1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
-	zend_alter_ini_entry("display_startup_errors", sizeof("display_startup_errors"), "1", sizeof("1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
-	
-	// Clean up.
-	efree(all_errors);
 	
-	// PHP is fully started.
-	pyphp.is_started = true;
-	return true;
-	
-	startup_error: {
-		// Shutdown PHP.
-		pyphp_php_shutdown();
-		return false;
+	// .. NOTE: A reference is changed in place, so its pointer stays the same
+	//    and only its contents tell whether it was written.
+	switch (now.type) {
+		case IS_NULL:
+		case IS_BOOL:
+		case IS_LONG:
+		case IS_RESOURCE:
+			return now.lval != entry->lval;
+		case IS_DOUBLE:
+			return memcmp(&now.dval, &entry->dval, sizeof(now.dval)) != 0;
+		case IS_STRING:
+			return now.len != entry->len || (!separated && now.str != entry->str);
+		case IS_ARRAY:
+			return now.count != entry->count || (!separated && now.ht != entry->ht);
+		case IS_OBJECT:
+			return now.handle != entry->handle || now.handlers != entry->handlers;
+		default:
+			return false;
 	}
 }
 
 /**
-Called when PHP logs a message.
+Finds the global variables which were added or changed since their
+fingerprints were taken.
 
-*message* (``char *``) is the log message.
+.. NOTE: This must be called between ``pyphp_begin_php()`` and
+   ``pyphp_end_php()``.
+
+.. NOTE: The fingerprints are shallow, so these changes are not found:
+   elements changed in place in an array which keeps its element count,
+   properties changed on an object, a string or array freed and replaced by
+   one of the same length at the same address, and a shared value changed
+   to one of the same length right after it was made a reference. Variables
+   which were removed are not returned.
+
+*fp* (``HashTable *``) is the fingerprints (see
+``pyphp_php_global_fingerprint()``).
+
+Returns the new PHP array (``zval *``) of the changed variables mapped by
+name.
 */
-static void pyphp_php_log_cb(char * message) {
-	if (message == NULL) {
-		return;
-	}
-	if (pyphp.log_fp != NULL) {
-		// Write log to file pointer.
-		fputs(message, pyphp.log_fp);
-		fputc('\n', pyphp.log_fp);
-		fflush(pyphp.log_fp);
-	}
-	if (pyphp.pylog_cb != NULL) {
-		// Send log to callback.
-		PyObject * pyargs = Py_BuildValue("(s):pyphp.pyphp_php_log_cb", message);
-		if (pyargs != NULL) {
-			PyObject * pyresult = PyEval_CallObject(pyphp.pylog_cb, pyargs);
-			Py_XDECREF(pyresult);
-			Py_DECREF(pyargs);
+static zval * pyphp_php_global_changes(HashTable * fp) {
+	struct pyphp_global_fp_t * entry = NULL; // borrowed
+	Bucket * p = NULL; // borrowed
+	zval * zv = NULL; // borrowed
+	zval * zchanges = NULL; // owned
+	TSRMLS_FETCH();
+	
+	MAKE_STD_ZVAL(zchanges);
+	array_init(zchanges);
+	for (p = EG(symbol_table).pListHead; p != NULL; p = p->pListNext) {
+		zv = *(zval **)p->pData;
+		if (zend_hash_quick_find(fp, p->arKey, p->nKeyLength, p->h, (void **)&entry) == SUCCESS && !pyphp_php_global_changed(entry, zv)) {
+			// The variable was not changed.
+			continue;
+		}
+		if (zend_hash_quick_update(Z_ARRVAL_P(zchanges), p->arKey, p->nKeyLength, p->h, &zv, sizeof(zv), NULL) == SUCCESS) {
+			Z_ADDREF_P(zv);
 		}
 	}
+	return zchanges;
 }
 
 /**
-Called when PHP outputs data.
+Converts the global variables changed by a script to Python.
 
-*str* (``const char *``) is the output data.
+*zchanges* (``zval *``) is the PHP array of the changed variables (see
+``pyphp_php_global_changes()``).
 
-*str_length* (``unsigned int``) is the number of bytes.
+*json* (``bool``) is whether the values should be encoded as JSON (``true``),
+or converted to Python values (``false``).
 
-Returns the number of bytes written (``int``).
+Returns the new ``dict`` (``PyObject *``) of the changed variables mapped by
+name.
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
 */
-static int pyphp_php_output_cb(const char * str, unsigned int str_length TSRMLS_DC) {
-	int len;
+static PyObject * pyphp_php_global_changes_to_PyObject(zval * zchanges, bool json) {
+	struct pyphp_conv_t conv;
+	Bucket * p = NULL; // borrowed
+	bool result = true;
+	PyObject * pykey = NULL; // owned
+	PyObject * pyval = NULL; // owned
+	PyObject * pydict = NULL; // owned
 	
-	if (str == NULL || str_length == 0) {
-		return 0;
-	}
-	len = str_length > INT_MAX ? INT_MAX : (int)str_length;
-	if (pyphp.out_fp != NULL) {
-		// Write data to file pointer.
-		len = (int)fwrite(str, sizeof(*str), (size_t)len, pyphp.out_fp);
+	pydict = _PyDict_NewPresized(zend_hash_num_elements(Z_ARRVAL_P(zchanges)));
+	if (pydict == NULL) {
+		return NULL;
 	}
-	if (pyphp.pyout_cb != NULL) {
-		// Send data to callback.
-		PyObject * pyargs = Py_BuildValue("(s#):pyphp.pyphp_php_output_cb", str, (Py_ssize_t)len);
-		if (pyargs != NULL) {
-			PyObject * pyresult = PyEval_CallObject(pyphp.pyout_cb, pyargs);
-			Py_XDECREF(pyresult);
-			Py_DECREF(pyargs);
+	
+	// Convert the changed variables with one conversion so that the arrays
+	// they share are converted once.
+	pyphp_conv_init(&conv);
+	for (p = Z_ARRVAL_P(zchanges)->pListHead; result && p != NULL; p = p->pListNext) {
+		pykey = bucket_key_to_PyObject(p, conv.interns);
+		if (pykey == NULL) {
+			pyval = NULL;
+		} else if (json) {
+			pyval = zval_to_json(*(zval **)p->pData);
+		} else {
+			pyval = zval_to_PyObject(*(zval **)p->pData, &conv);
 		}
+		result = pykey != NULL && pyval != NULL && PyDict_SetItem(pydict, pykey, pyval) == 0;
+		Py_XDECREF(pykey);
+		Py_XDECREF(pyval);
 	}
-	return len;
+	pyphp_conv_free(&conv);
+	if (!result) {
+		Py_DECREF(pydict);
+		return NULL;
+	}
+	return pydict;
 }
 
 /**
-Called when the PHP output file pointer needs to be flushed.
-*/
-static void pyphp_php_output_flush_cb(void * server_ctx) {
-	fflush(pyphp.out_fp);
-}
+Executes the specified PHP script.
 
-/**
-Restarts PHP.
+*zfile* (``zend_file_handle *``) is the file handle of the script. This is
+either a file pointer (``ZEND_HANDLE_FP``), or a mapped
+(``ZEND_HANDLE_MAPPED``) handle.
 
-Returns whether PHP was successfully restarted (``true``), or not (``false``).
-*/
-static bool pyphp_php_restart() {
-	pyphp_php_shutdown();
-	return pyphp_php_startup(0, NULL);
-}
+.. NOTE: The file handle is stolen.
 
-/**
-Sets the PHP error handler Python callback function.
+*json* (``bool``) is whether the value returned by the script should be
+encoded as JSON (``true``), or converted to a Python value (``false``).
 
-*pyerr_cb* (``PyObject *``) is the python callback.
-*/
-static void pyphp_php_set_error_cb(PyObject * pyerr_cb) {
-	Py_XINCREF(pyerr_cb);
-	Py_XDECREF(pyphp.pyerr_cb);
-	pyphp.pyerr_cb = pyerr_cb;
-}
+*pychanges* (``PyObject **``) optionally is where to store the ``dict`` of the
+global variables added or changed by the script (see
+``pyphp_php_global_changes()``). This can be ``NULL`` to not track them.
 
-/**
-Sets the PHP log handler Python callback function.
+.. NOTE: This is a new reference.
 
-*pylog_cb* (``PyObject *``) is the python callback.
-*/
-static void pyphp_php_set_log_cb(PyObject * pylog_cb) {
-	Py_XINCREF(pylog_cb);
-	Py_XDECREF(pyphp.pylog_cb);
-	pyphp.pylog_cb = pylog_cb;
-}
+*pyresult* (``PyObject **``) is where to store the value returned by the
+script.
+
+.. NOTE: This is a new reference.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_exec_file(zend_file_handle * zfile, bool json, PyObject ** pychanges, PyObject ** pyresult) {
+	bool result = false;
+	bool bailout = false;
+	PyObject * pyretval = NULL; // owned
+	PyObject * pychanged = NULL; // owned
+
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		pyphp_php_file_handle_close(zfile);
+		return false;
+	}
+	
+	// Execute script.
+	// .. TODO: Properly send php errors to python.
+	{
+		zval * zretval = NULL; // owned
+		zval * zchanges = NULL; // owned
+		HashTable fp;
+		bool released = false;
+		TSRMLS_FETCH();
+		result = true;
+		released = pyphp_begin_php();
+		zend_first_try {
+			if (pychanges != NULL) {
+				pyphp_php_global_fingerprint(&fp);
+			}
+			if (zend_execute_scripts(ZEND_REQUIRE TSRMLS_CC, &zretval, 1, zfile) != SUCCESS) {
+				result = false;
+			}
+			if (pychanges != NULL) {
+				zchanges = pyphp_php_global_changes(&fp);
+				zend_hash_destroy(&fp);
+			}
+		} zend_catch {
+			result = false;
+			bailout = true;
+		} zend_end_try();
+		pyphp_end_php(released);
+		
+		// Convert the return value and the changed globals before PHP is reset.
+		// They are not destroyed if PHP bailed out because PHP will be restarted
+		// anyway.
+		if (!bailout && zretval != NULL) {
+			if (result && PyErr_Occurred() == NULL) {
+				pyretval = json ? zval_to_json(zretval) : zval_to_PyObject(zretval, NULL);
+			}
+			zval_ptr_dtor(&zretval);
+		}
+		if (!bailout && zchanges != NULL) {
+			if (result && PyErr_Occurred() == NULL) {
+				pychanged = pyphp_php_global_changes_to_PyObject(zchanges, json);
+			}
+			zval_ptr_dtor(&zchanges);
+		}
+	}
+	
+	// Reset php.
+	if (!pyphp_php_exec_end(bailout)) {
+		Py_XDECREF(pyretval);
+		Py_XDECREF(pychanged);
+		return false;
+	}
+	
+	// Check for python exception.
+	if (PyErr_Occurred() != NULL) {
+		Py_XDECREF(pyretval);
+		Py_XDECREF(pychanged);
+		return false;
+	} else if (!result) {
+		PyErr_SetString(InternalErrorType, "Failed to execute script.");
+		return false;
+	}
+	
+	// Return the value returned by the script.
+	if (pyretval == NULL && json) {
+		pyretval = PyString_FromString("null");
+		if (pyretval == NULL) {
+			return false;
+		}
+	} else if (pyretval == NULL) {
+		Py_INCREF(Py_None);
+		pyretval = Py_None;
+	}
+	*pyresult = pyretval;
+	if (pychanges != NULL) {
+		*pychanges = pychanged;
+	}
+	return true;
+}
 
 /**
-Sets the PHP output handler Python callback function.
+Compiles the specified PHP inline string/script.
 
-*pyout_cb* (``PyObject *``) is the python callback.
+*name* (``const char *``) optionally is the name of the inline string/script.
+
+*str* (``const char *``) is the string to compile.
+
+*str_len* (``int``) is the length of *str*.
+
+.. NOTE: The compiled script is only valid until PHP is restarted.
+
+Returns the compiled script (``zend_op_array *``) on success; otherwise,
+``NULL``.
 */
-static void pyphp_php_set_output_cb(PyObject * pyout_cb) {
-	Py_XINCREF(pyout_cb);
-	Py_XDECREF(pyphp.pyout_cb);
-	pyphp.pyout_cb = pyout_cb;
+static zend_op_array * pyphp_php_compile_inline(const char * name, const char * str, int str_len) {
+	/*
+	.. NOTE: This function is derived from ``zend_eval_stringl()`` from
+	   ``php-5.3.13/Zend/zend_execute_API.c``.
+	*/
+	zend_op_array * op_array = NULL; // owned
+	zval zstr;
+	bool bailout = false;
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return NULL;
+	}
+	
+	// Compile string.
+	// .. NOTE: The compiler copies the string so it is safe to cast it to
+	//    `char *`.
+	if (name == NULL) {
+		name = "inline script";
+	}
+	Z_TYPE(zstr) = IS_STRING;
+	Z_STRVAL(zstr) = (char *)str;
+	Z_STRLEN(zstr) = str_len;
+	{
+		bool released = false;
+		TSRMLS_FETCH();
+		released = pyphp_begin_php();
+		zend_first_try {
+			op_array = zend_compile_string(&zstr, (char *)name TSRMLS_CC);
+		} zend_catch {
+			op_array = NULL;
+			bailout = true;
+		} zend_end_try();
+		pyphp_end_php(released);
+	}
+	
+	// Reset php after a bailout.
+	if (bailout && !pyphp_php_exec_end(bailout)) {
+		return NULL;
+	}
+	
+	// Check for python exception.
+	if (PyErr_Occurred() != NULL) {
+		if (op_array != NULL) {
+			TSRMLS_FETCH();
+			destroy_op_array(op_array TSRMLS_CC);
+			efree(op_array);
+		}
+		return NULL;
+	} else if (op_array == NULL) {
+		PyErr_SetString(InternalErrorType, "Failed to compile string.");
+		return NULL;
+	}
+	
+	return op_array;
 }
 
 /**
-Completely, irreversibly shuts-down PHP.
+Executes the specified compiled PHP script.
+
+*op_array* (``zend_op_array *``) is the compiled script to execute.
+
+.. NOTE: This reference is borrowed. If PHP is restarted after the execution,
+   the compiled script is no longer valid.
+
+*destroy* (``bool``) is whether the compiled script should be destroyed after
+it is executed (``true``), or not (``false``).
+
+*json* (``bool``) is whether the value returned by the script should be
+encoded as JSON (``true``), or converted to a Python value (``false``).
+
+*pychanges* (``PyObject **``) optionally is where to store the ``dict`` of the
+global variables added or changed by the script (see
+``pyphp_php_global_changes()``). This can be ``NULL`` to not track them.
+
+.. NOTE: This is a new reference.
+
+*pyresult* (``PyObject **``) is where to store the value returned by the
+script.
+
+.. NOTE: This is a new reference.
+
+Returns ``true`` on success; otherwise, ``false``.
 */
-static void pyphp_php_destroy() {
-	if (!pyphp.is_inited) {
-		return;
+static bool pyphp_php_exec_op_array(zend_op_array * op_array, bool destroy, bool json, PyObject ** pychanges, PyObject ** pyresult) {
+	/*
+	.. NOTE: This function is derived from ``zend_eval_stringl()`` from
+	   ``php-5.3.13/Zend/zend_execute_API.c``.
+	*/
+	bool result = false;
+	bool bailout = false;
+	PyObject * pyretval = NULL; // owned
+	PyObject * pychanged = NULL; // owned
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		if (destroy) {
+			TSRMLS_FETCH();
+			destroy_op_array(op_array TSRMLS_CC);
+			efree(op_array);
+		}
+		return false;
 	}
-	pyphp.is_inited = false;
-	pyphp.is_started = false;
+	
+	// Execute compiled script.
+	// .. TODO: Properly send php errors to python.
 	{
+		zval * zretval = NULL; // owned
+		zval * zchanges = NULL; // owned
+		HashTable fp;
+		zval ** orig_retval_ptr = NULL; // borrowed
+		zend_op ** orig_opline_ptr = NULL; // borrowed
+		zend_op_array * orig_op_array = NULL; // borrowed
+		bool released = false;
 		TSRMLS_FETCH();
-		php_embed_shutdown(TSRMLS_C);
+		
+		orig_retval_ptr = EG(return_value_ptr_ptr);
+		orig_opline_ptr = EG(opline_ptr);
+		orig_op_array = EG(active_op_array);
+		
+		result = true;
+		released = pyphp_begin_php();
+		zend_first_try {
+			EG(return_value_ptr_ptr) = &zretval;
+			EG(active_op_array) = op_array;
+			if (EG(active_symbol_table) == NULL) {
+				zend_rebuild_symbol_table(TSRMLS_C);
+			}
+			if (pychanges != NULL) {
+				pyphp_php_global_fingerprint(&fp);
+			}
+			zend_execute(op_array TSRMLS_CC);
+			if (EG(exception) != NULL) {
+				// Uncaught PHP exceptions are fatal.
+				zend_exception_error(EG(exception), E_ERROR TSRMLS_CC);
+			}
+			if (pychanges != NULL) {
+				zchanges = pyphp_php_global_changes(&fp);
+				zend_hash_destroy(&fp);
+			}
+		} zend_catch {
+			result = false;
+			bailout = true;
+		} zend_end_try();
+		pyphp_end_php(released);
+		
+		// Convert the return value and the changed globals before PHP is reset.
+		// Nothing is destroyed if PHP bailed out because PHP will be restarted
+		// anyway.
+		if (!bailout) {
+			if (zretval != NULL) {
+				if (result && PyErr_Occurred() == NULL) {
+					pyretval = json ? zval_to_json(zretval) : zval_to_PyObject(zretval, NULL);
+				}
+				zval_ptr_dtor(&zretval);
+			}
+			if (zchanges != NULL) {
+				if (result && PyErr_Occurred() == NULL) {
+					pychanged = pyphp_php_global_changes_to_PyObject(zchanges, json);
+				}
+				zval_ptr_dtor(&zchanges);
+			}
+			if (destroy) {
+				destroy_op_array(op_array TSRMLS_CC);
+				efree(op_array);
+			}
+		}
+		EG(return_value_ptr_ptr) = orig_retval_ptr;
+		EG(opline_ptr) = orig_opline_ptr;
+		EG(active_op_array) = orig_op_array;
 	}
+	
+	// Reset php.
+	if (!pyphp_php_exec_end(bailout)) {
+		Py_XDECREF(pyretval);
+		Py_XDECREF(pychanged);
+		return false;
+	}
+	
+	// Check for python exception.
+	if (PyErr_Occurred() != NULL) {
+		Py_XDECREF(pyretval);
+		Py_XDECREF(pychanged);
+		return false;
+	} else if (!result) {
+		PyErr_SetString(InternalErrorType, "Failed to execute script.");
+		return false;
+	}
+	
+	// Return the value returned by the script.
+	if (pyretval == NULL && json) {
+		pyretval = PyString_FromString("null");
+		if (pyretval == NULL) {
+			return false;
+		}
+	} else if (pyretval == NULL) {
+		Py_INCREF(Py_None);
+		pyretval = Py_None;
+	}
+	*pyresult = pyretval;
+	if (pychanges != NULL) {
+		*pychanges = pychanged;
+	}
+	return true;
 }
 
 /**
-Called when PHP is started up.
+Executes the specified PHP inline string/script.
 
-.. HACK: Stores and overrides the internal PHP error handler.
+*name* (``const char *``) optionally is the name of the inline string/script.
 
-*sapi* (``sapi_module_struct *``) is the SAPI module to start up.
+*str* (``const char *``) is the string to execute.
 
-Returns ``SUCCESS`` on success; otherwise, ``FAILURE``.
+*str_len* (``int``) is the length of *str*.
+
+*json* (``bool``) is whether the value returned by the string should be
+encoded as JSON (``true``), or converted to a Python value (``false``).
+
+*pychanges* (``PyObject **``) optionally is where to store the ``dict`` of the
+global variables added or changed by the string. This can be ``NULL`` to not
+track them.
+
+*pyresult* (``PyObject **``) is where to store the value returned by the
+string.
+
+.. NOTE: This is a new reference.
+
+Returns ``true`` on success; otherwise, ``false``.
 */
-static int pyphp_php_startup_cb(sapi_module_struct * sapi) {
-	if (php_module_startup(&sapi_module, NULL, 0) == FAILURE) {
-		return FAILURE;
+static bool pyphp_php_exec_inline(const char * name, const char * str, int str_len, bool json, PyObject ** pychanges, PyObject ** pyresult) {
+	zend_op_array * op_array = NULL; // owned
+	
+	// Compile string.
+	op_array = pyphp_php_compile_inline(name, str, str_len);
+	if (op_array == NULL) {
+		return false;
 	}
-	//HACK: Grab the function pointer to the internal PHP (zend) error handler.
-	pyphp.php_internal_error_cb = zend_error_cb;
-	//HACK: Override the internal PHP error handler.
-	zend_error_cb = pyphp_php_error_cb;
 	
-	return SUCCESS;
+	// Execute string.
+	// .. NOTE: The compiled string is destroyed.
+	return pyphp_php_exec_op_array(op_array, true, json, pychanges, pyresult);
 }
 
+/**
+Called when a function call cache entry is destroyed.
 
+*pentry* (``void *``) is the cache entry (``struct pyphp_fcall_entry_t *``).
+*/
+static void pyphp_php_fcall_entry_dtor(void * pentry) {
+	struct pyphp_fcall_entry_t * entry = pentry; // borrowed
+	
+	zval_ptr_dtor(&entry->zname);
+}
 
-/****************************** Module Methods ******************************/
+/**
+Clears the function call cache.
+*/
+static void pyphp_php_fcall_cache_clear() {
+	if (pyphp_interp->fcall_cache == NULL) {
+		return;
+	}
+	zend_hash_destroy(pyphp_interp->fcall_cache);
+	FREE_HASHTABLE(pyphp_interp->fcall_cache);
+	pyphp_interp->fcall_cache = NULL;
+}
 
-static const char pyphp_exec_file_doc[] = (
-	"Executes the specified PHP script.\n"
-	"\n"
-	"*file* (**string**) is the name of the file to execute.\n"
-	"\n"
-	".. NOTE: If *file* is ``unicode``, it will be encoded using the result\n"
-	"   from ``sys.getfilesystemencoding()``. If an encoding other than that\n"
-	"   is required, encode *file* to a binary ``str`` prior to sending it to\n"
-	"   this method.\n" 
-);
+/**
+Resolves the specified PHP function. Resolved functions are cached for the
+rest of the request.
 
-static PyObject * pyphp_exec_file(PyObject * self, PyObject * args) {
-	PyObject * pyfile = NULL; // borrowed
-	PyObject * pyfile_tmp = NULL; // owned
-	FILE * fp = NULL; // owned
-	bool result = false;
+*name* (``const char *``) is the name of the function.
+
+*namelen* (``int``) is the length of *name*.
+
+*error* (``char **``) is where to store the error message if the function
+cannot be resolved.
+
+.. NOTE: You are responsible for destroying the error message with the PHP
+   function ``efree()``.
+
+.. NOTE: This is called while the GIL is released so it does not use any
+   Python APIs.
+
+Returns a borrowed reference to the resolved function
+(``struct pyphp_fcall_entry_t *``) on success; otherwise, ``NULL``.
+*/
+static struct pyphp_fcall_entry_t * pyphp_php_fcall_resolve(const char * name, int namelen, char ** error) {
+	struct pyphp_fcall_entry_t entry;
+	struct pyphp_fcall_entry_t * cached = NULL; // borrowed
+	zend_fcall_info fci;
+	TSRMLS_FETCH();
+	
+	// Look for the resolved function.
+	// .. NOTE: Hash key length MUST include NULL byte.
+	if (pyphp_interp->fcall_cache != NULL && zend_hash_find(pyphp_interp->fcall_cache, name, (unsigned int)namelen + 1, (void **)&cached) == SUCCESS) {
+		return cached;
+	}
 	
-	if (!PyArg_ParseTuple(args, "O:pyphp.exec_file", &pyfile)) {
+	// Resolve the function.
+	MAKE_STD_ZVAL(entry.zname);
+	if (entry.zname == NULL) {
+		*error = estrdup("failed to create zval");
 		return NULL;
 	}
-	if (PyString_Check(pyfile)) {
-		Py_BEGIN_ALLOW_THREADS
-		fp = fopen(PyString_AS_STRING(pyfile), "rb");
-		Py_END_ALLOW_THREADS
-		
-	} else if (PyUnicode_Check(pyfile)) {
-		pyfile_tmp = PyUnicode_AsEncodedString(pyfile, Py_FileSystemDefaultEncoding, "strict");
-		if (pyfile_tmp == NULL) {
-			return NULL;
+	ZVAL_STRINGL(entry.zname, name, namelen, 1);
+	if (zend_fcall_info_init(entry.zname, 0, &fci, &entry.fcc, NULL, error TSRMLS_CC) != SUCCESS) {
+		if (*error == NULL) {
+			*error = estrdup("unknown error");
+		}
+		zval_ptr_dtor(&entry.zname);
+		return NULL;
+	}
+	if (*error != NULL) {
+		// Ignore non-fatal errors (e.g., calling a non-static method statically).
+		efree(*error);
+		*error = NULL;
+	}
+	
+	// Cache the resolved function.
+	if (pyphp_interp->fcall_cache == NULL) {
+		ALLOC_HASHTABLE(pyphp_interp->fcall_cache);
+		zend_hash_init(pyphp_interp->fcall_cache, 0, NULL, pyphp_php_fcall_entry_dtor, 0);
+	}
+	if (zend_hash_update(pyphp_interp->fcall_cache, name, (unsigned int)namelen + 1, &entry, sizeof(entry), (void **)&cached) != SUCCESS) {
+		*error = estrdup("failed to cache function");
+		zval_ptr_dtor(&entry.zname);
+		return NULL;
+	}
+	return cached;
+}
+
+/**
+Calls the specified PHP function.
+
+*name* (``const char *``) is the name of the function. This can also be a
+static method (e.g., ``"Class::method"``).
+
+*namelen* (``int``) is the length of *name*.
+
+*zargs* (``zval **``) is the array of arguments.
+
+.. NOTE: These references are stolen but the array itself is borrowed.
+
+*zargc* (``int``) is the number of arguments.
+
+*pyresult* (``PyObject **``) is where to store the value returned by the
+function.
+
+.. NOTE: This is a new reference.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_call_function(const char * name, int namelen, zval ** zargs, int zargc, PyObject ** pyresult) {
+	/*
+	.. NOTE: This function is derived from ``call_user_func_array()`` from
+	   ``php-5.3.13/ext/standard/basic_functions.c``.
+	*/
+	struct pyphp_fcall_entry_t * entry = NULL; // borrowed
+	zval *** params = NULL; // owned
+	bool result = false;
+	bool bailout = false;
+	PyObject * pyretval = NULL; // owned
+	int i;
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		// The arguments are still stolen.
+		for (i = 0; i < zargc; ++i) {
+			zval_ptr_dtor(&zargs[i]);
 		}
+		return false;
+	}
+	
+	{
+		zend_fcall_info fci;
+		zval * zretval = NULL; // owned
+		char * error = NULL; // owned
+		bool released = false;
+		TSRMLS_FETCH();
 		
-		#ifdef MS_WINDOWS
-		// Require windows to have PY_UNICODE defined as wchar_t.
-		// - http://mail.python.org/pipermail/python-dev/2004-October/049277.html
-		# ifdef HAVE_USABLE_WCHAR_T
-		Py_BEGIN_ALLOW_THREADS
-		fp = _wfopen(PyUnicode_AS_UNICODE(pyfile), L"rb");
-		Py_END_ALLOW_THREADS
-		# else
-		#  error "Py_UNICODE must be wchar_t on Windows."
-		# endif
-		#else
-		Py_BEGIN_ALLOW_THREADS
-		fp = fopen(PyString_AS_STRING(pyfile_tmp), "rb");
-		Py_END_ALLOW_THREADS
-		#endif
+		// Setup arguments.
+		if (zargc > 0) {
+			params = safe_emalloc((size_t)zargc, sizeof(*params), 0);
+			for (i = 0; i < zargc; ++i) {
+				params[i] = &zargs[i];
+			}
+		}
+		fci.size = sizeof(fci);
+		fci.function_table = EG(function_table);
+		fci.function_name = NULL;
+		fci.symbol_table = NULL;
+		fci.object_ptr = NULL;
+		fci.retval_ptr_ptr = &zretval;
+		fci.param_count = (zend_uint)zargc;
+		fci.params = params;
+		fci.no_separation = 1;
 		
-	} else {
-		PyErr_Format(PyExc_TypeError, "file:%s is not a string.", Py_TYPE(pyfile)->tp_name);
+		// Call function.
+		// .. TODO: Properly send php errors to python.
+		result = true;
+		released = pyphp_begin_php();
+		zend_first_try {
+			// Resolve function.
+			// .. NOTE: Resolving a static method can autoload its class.
+			entry = pyphp_php_fcall_resolve(name, namelen, &error);
+			if (entry == NULL) {
+				result = false;
+			} else {
+				fci.function_name = entry->zname;
+				if (zend_call_function(&fci, &entry->fcc TSRMLS_CC) != SUCCESS) {
+					result = false;
+				}
+				if (EG(exception) != NULL) {
+					// Uncaught PHP exceptions are fatal.
+					zend_exception_error(EG(exception), E_ERROR TSRMLS_CC);
+				}
+			}
+		} zend_catch {
+			result = false;
+			bailout = true;
+		} zend_end_try();
+		pyphp_end_php(released);
+		
+		// Report an unresolved function.
+		if (error != NULL) {
+			if (!bailout) {
+				PyErr_Format(PyExc_NameError, "PHP function:%s is not callable: %s", name, error);
+				efree(error);
+			}
+			error = NULL;
+		}
+		
+		// Convert the return value before PHP is reset. Nothing is destroyed if
+		// PHP bailed out because PHP will be restarted anyway.
+		if (!bailout) {
+			if (zretval != NULL) {
+				if (result && PyErr_Occurred() == NULL) {
+					pyretval = zval_to_PyObject(zretval, NULL);
+				}
+				zval_ptr_dtor(&zretval);
+			}
+			for (i = 0; i < zargc; ++i) {
+				zval_ptr_dtor(&zargs[i]);
+			}
+			if (params != NULL) {
+				efree(params);
+			}
+		}
+	}
+	
+	// Reset php.
+	if (!pyphp_php_exec_end(bailout)) {
+		Py_XDECREF(pyretval);
+		return false;
+	}
+	
+	// Check for python exception.
+	if (PyErr_Occurred() != NULL) {
+		Py_XDECREF(pyretval);
+		return false;
+	} else if (!result) {
+		PyErr_Format(InternalErrorType, "Failed to call function:%s.", name);
+		return false;
+	}
+	
+	// Return the value returned by the function.
+	if (pyretval == NULL) {
+		Py_INCREF(Py_None);
+		pyretval = Py_None;
+	}
+	*pyresult = pyretval;
+	return true;
+}
+
+/**
+Begins a persistent PHP request. Until the matching call to
+``pyphp_php_end_request()``, PHP is not restarted after each execution so
+that functions, classes and globals defined by one execution are available to
+the next.
+
+.. NOTE: Persistent requests can be nested. Only the outermost request
+   actually ends the PHP request.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_begin_request() {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	++pyphp_interp->request_depth;
+	return true;
+}
+
+/**
+Ends a persistent PHP request. When the outermost persistent request ends,
+PHP is restarted.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_end_request() {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	if (pyphp_interp->request_depth == 0) {
+		PyErr_SetString(InternalErrorType, "No persistent request has begun.");
+		return false;
+	}
+	if (pyphp_interp->request_depth == 1 && !pyphp_php_request_can_end()) {
+		return false;
+	}
+	if (--pyphp_interp->request_depth > 0) {
+		// Still within an outer persistent request.
+		return true;
+	}
+	
+	// Reset php.
+	return pyphp_php_restart();
+}
+
+/**
+Checks whether the current PHP request can end. It cannot end while buffers
+exported by ``PhpBytes`` views point into its memory.
+
+Returns ``true`` if it can end; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool pyphp_php_request_can_end() {
+	if (pyphp_interp->bytes_exports > 0) {
+		// Keep the exception raised by the execution which is ending.
+		if (PyErr_Occurred() == NULL) {
+			PyErr_Format(PyExc_BufferError, "PHP request cannot end while %lu buffer(s) of PhpBytes views are exported.", pyphp_interp->bytes_exports);
+		}
+		return false;
+	}
+	return true;
+}
+
+/**
+Checks whether a script or function can be executed. Outside of a persistent
+request, PHP is restarted after the execution which is refused while buffers
+of ``PhpBytes`` views are exported. A restart which was refused is retried.
+
+.. NOTE: This must be called before anything is allocated in the request
+   memory for the execution (e.g., compiling the script or converting the
+   arguments) because retrying the restart releases that memory.
+
+Returns ``true`` if it can be executed; otherwise, ``false`` with a Python
+exception raised.
+*/
+static bool pyphp_php_exec_begin() {
+	if (pyphp_interp->restart_pending && !pyphp_php_restart()) {
+		return false;
+	}
+	if (pyphp_interp->request_depth == 0 && !pyphp_php_request_can_end()) {
+		return false;
+	}
+	return true;
+}
+
+/**
+Finishes an execution of PHP code. PHP is restarted unless a persistent
+request is active.
+
+*bailout* (``bool``) is whether PHP bailed out of the execution (e.g., a fatal
+error or ``exit()``). PHP is always restarted after a bailout because the
+request can no longer be used.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_exec_end(bool bailout) {
+	if (pyphp_interp->request_depth > 0 && !bailout) {
+		// Keep the persistent request.
+		return true;
+	}
+	return pyphp_php_restart();
+}
+
+/**
+Gets the hash table of the specified global array, or the global symbol table.
+
+.. NOTE: This must be called between ``pyphp_begin_php()`` and
+   ``pyphp_end_php()``.
+
+*var* (``const char *``) optionally is the name of the global array. If this
+is ``NULL``, the global symbol table is returned.
+
+*varlen* (``int``) is the length of *var*.
+
+*separate* (``bool``) is whether the global array should be separated from
+any copies because it will be changed (``true``), or not (``false``).
+
+*error_type* (``PyObject **``) will be set to the type of the Python
+exception to raise on failure.
+
+*error* (``const char **``) will be set to the message of the Python
+exception to raise on failure.
+
+Returns the hash table (``HashTable *``) on success; otherwise, ``NULL``.
+*/
+static HashTable * pyphp_php_global_table(const char * var, int varlen, bool separate, PyObject ** error_type, const char ** error) {
+	zval ** zdict = NULL; // borrowed
+	TSRMLS_FETCH();
+	
+	// Get global symbol table.
+	if (var == NULL) {
+		return &EG(symbol_table);
+	}
+	
+	// Get hash table for specified var.
+	// .. NOTE: Hash key length must include NULL byte.
+	if (zend_symtable_find(&EG(symbol_table), var, (unsigned int)varlen + 1, (void **)&zdict) != SUCCESS) {
+		*error_type = PyExc_KeyError;
+		*error = "var is not set.";
+		return NULL;
+	} else if (Z_TYPE_PP(zdict) != IS_ARRAY) {
+		*error_type = PyExc_TypeError;
+		*error = "var is not an array.";
+		return NULL;
+	}
+	if (separate) {
+		// Separate the array from any copies before changing it.
+		SEPARATE_ZVAL_IF_NOT_REF(zdict);
+	}
+	return Z_ARRVAL_PP(zdict);
+}
+
+/**
+Gets the value of the specified global variable.
+
+*key* (``const char *``) is the name of the variable to get.
+
+*keylen* (``int``) is the length of *key*.
+
+*var* (``const char *``) optionally gets the keyed value from the specified
+global variable instead of from the global symbol table.
+
+*varlen* (``int``) is the length of *var*.
+
+Returns a borrowed reference to value (``zval *``) of the global variable.
+*/
+static zval * pyphp_php_global_get(const char * key, int keylen, const char * var, int varlen) {
+	HashTable * ht = NULL; // borrowed
+	zval ** zv = NULL; // borrowed
+	PyObject * error_type = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return NULL;
+	}
+	
+	{
+		bool released = false;
+		released = pyphp_begin_php();
+		ht = pyphp_php_global_table(var, varlen, false, &error_type, &error);
+		
+		// Get php variable.
+		// .. NOTE: Hash key length MUST include NULL byte.
+		if (ht != NULL && zend_symtable_find(ht, key, (unsigned int)keylen + 1, (void **)&zv) != SUCCESS) {
+			error_type = PyExc_KeyError;
+			error = "key is not set.";
+		}
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_SetString(error_type, error);
+		return NULL;
+	}
+	return *zv;
+}
+
+/**
+Gets the values of the specified global variables.
+
+*globals* (``struct pyphp_global_t *``) is the variables to get. The value of
+each variable will be set to a borrowed reference to its value (``zval *``),
+or ``NULL`` if it is not set.
+
+*count* (``Py_ssize_t``) is the number of *globals*.
+
+*var* (``const char *``) optionally gets the keyed values from the specified
+global variable instead of from the global symbol table.
+
+*varlen* (``int``) is the length of *var*.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_global_get_many(struct pyphp_global_t * globals, Py_ssize_t count, const char * var, int varlen) {
+	HashTable * ht = NULL; // borrowed
+	zval ** zv = NULL; // borrowed
+	PyObject * error_type = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	Py_ssize_t i;
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Get php variables.
+	// .. NOTE: Hash key length MUST include NULL byte.
+	{
+		bool released = false;
+		released = pyphp_begin_php();
+		ht = pyphp_php_global_table(var, varlen, false, &error_type, &error);
+		if (ht != NULL) {
+			for (i = 0; i < count; ++i) {
+				if (zend_symtable_find(ht, globals[i].key, (unsigned int)globals[i].keylen + 1, (void **)&zv) == SUCCESS) {
+					globals[i].zv = *zv;
+				} else {
+					globals[i].zv = NULL;
+				}
+			}
+		}
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_SetString(error_type, error);
+		return false;
+	}
+	return true;
+}
+
+/**
+Sets the value of the specified global variable.
+
+*key* (``const char *``) is the name of the variable to set.
+
+*keylen* (``int``) is the length of *key*.
+
+*var* (``cosnt char *``) optionally sets the keyed value in the specified
+global variable instead of in the global symbol table.
+
+*varlen* (``int``) is the length of *var*.
+
+*zv* (``zval *``) is the value of the variable to set.
+
+.. NOTE: This reference is stolen.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_global_set(const char * key, int keylen, const char * var, int varlen, zval * zv) {
+	HashTable * ht = NULL; // borrowed
+	PyObject * error_type = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	{
+		bool released = false;
+		released = pyphp_begin_php();
+		ht = pyphp_php_global_table(var, varlen, true, &error_type, &error);
+		
+		// Set php value.
+		// .. NOTE: Hash key length MUST include NULL byte.
+		// .. NOTE: The zv reference is stolen.
+		if (ht != NULL && zend_symtable_update(ht, key, (unsigned int)keylen + 1, &zv, sizeof(zv), NULL) != SUCCESS) {
+			error_type = InternalErrorType;
+			error = "Failed to set key/value.";
+		}
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_SetString(error_type, error);
+		return false;
+	}
+	return true;
+}
+
+/**
+Sets the values of the specified global variables.
+
+*globals* (``struct pyphp_global_t *``) is the variables to set.
+
+.. NOTE: The value of each variable that is set is stolen and cleared. The
+   values which are left must be destroyed by the caller.
+
+*count* (``Py_ssize_t``) is the number of *globals*.
+
+*var* (``const char *``) optionally sets the keyed values in the specified
+global variable instead of in the global symbol table.
+
+*varlen* (``int``) is the length of *var*.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_global_set_many(struct pyphp_global_t * globals, Py_ssize_t count, const char * var, int varlen) {
+	HashTable * ht = NULL; // borrowed
+	PyObject * error_type = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	Py_ssize_t i;
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set php values.
+	// .. NOTE: Hash key length MUST include NULL byte.
+	{
+		bool released = false;
+		released = pyphp_begin_php();
+		ht = pyphp_php_global_table(var, varlen, true, &error_type, &error);
+		for (i = 0; ht != NULL && i < count; ++i) {
+			if (zend_symtable_update(ht, globals[i].key, (unsigned int)globals[i].keylen + 1, &globals[i].zv, sizeof(globals[i].zv), NULL) != SUCCESS) {
+				error_type = InternalErrorType;
+				error = "Failed to set key/value.";
+				break;
+			}
+			globals[i].zv = NULL;
+		}
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_SetString(error_type, error);
+		return false;
+	}
+	return true;
+}
+
+/**
+Finds the element of a PHP array at the specified path key.
+
+*ht* (``HashTable *``) is the php array.
+
+*k* (``struct pyphp_path_key_t *``) is the path key.
+
+Returns the element (``zval **``) if found; otherwise, ``NULL``.
+*/
+static zval ** pyphp_php_path_find(HashTable * ht, struct pyphp_path_key_t * k) {
+	zval ** zv = NULL; // borrowed
+	int result = FAILURE;
+	
+	// .. NOTE: Hash key length MUST include NULL byte.
+	if (k->key != NULL) {
+		result = zend_symtable_find(ht, k->key, (unsigned int)k->keylen + 1, (void **)&zv);
+	} else {
+		result = zend_hash_index_find(ht, (ulong)k->index, (void **)&zv);
+	}
+	return result == SUCCESS ? zv : NULL;
+}
+
+/**
+Sets the element of a PHP array at the specified path key.
+
+*ht* (``HashTable *``) is the php array.
+
+*k* (``struct pyphp_path_key_t *``) is the path key.
+
+*zv* (``zval *``) is the value to set.
+
+.. NOTE: The zv reference is stolen on success.
+
+*dest* (``zval ***``) optionally will be set to the element. This can be
+``NULL``.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_path_update(HashTable * ht, struct pyphp_path_key_t * k, zval * zv, zval *** dest) {
+	int result = FAILURE;
+	
+	// .. NOTE: Hash key length MUST include NULL byte.
+	if (k->key != NULL) {
+		result = zend_symtable_update(ht, k->key, (unsigned int)k->keylen + 1, &zv, sizeof(zv), (void **)dest);
+	} else {
+		result = zend_hash_index_update(ht, (ulong)k->index, &zv, sizeof(zv), (void **)dest);
+	}
+	return result == SUCCESS;
+}
+
+/**
+Gets the value at the specified path through nested global arrays.
+
+*path* (``struct pyphp_path_key_t *``) is the keys of the path. The first
+key is the name of the global variable, and each following key is the key
+of an element in the array before it.
+
+*count* (``Py_ssize_t``) is the number of keys in *path*. This must be at
+least 1.
+
+Returns a borrowed reference to the value (``zval *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static zval * pyphp_php_global_get_path(struct pyphp_path_key_t * path, Py_ssize_t count) {
+	zval ** zv = NULL; // borrowed
+	PyObject * error_type = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	Py_ssize_t i = 0;
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return NULL;
+	}
+	
+	// Walk the php arrays down to the value.
+	{
+		HashTable * ht = NULL; // borrowed
+		bool released = false;
+		TSRMLS_FETCH();
+		released = pyphp_begin_php();
+		ht = &EG(symbol_table);
+		for (i = 0; i < count; ++i) {
+			zv = pyphp_php_path_find(ht, &path[i]);
+			if (zv == NULL) {
+				error_type = PyExc_KeyError;
+				error = "path key:%" PY_Z "i is not set.";
+				break;
+			}
+			if (i + 1 < count) {
+				if (Z_TYPE_PP(zv) != IS_ARRAY) {
+					error_type = PyExc_TypeError;
+					error = "path key:%" PY_Z "i is not an array.";
+					break;
+				}
+				ht = Z_ARRVAL_PP(zv);
+			}
+		}
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_Format(error_type, error, i);
+		return NULL;
+	}
+	return *zv;
+}
+
+/**
+Sets the value at the specified path through nested global arrays. Missing
+or ``null`` arrays along the path are created, and the arrays along the path
+are separated from any copies before they are changed.
+
+*path* (``struct pyphp_path_key_t *``) is the keys of the path. The first
+key is the name of the global variable, and each following key is the key
+of an element in the array before it.
+
+*count* (``Py_ssize_t``) is the number of keys in *path*. This must be at
+least 1.
+
+*zv* (``zval *``) is the value to set.
+
+.. NOTE: The zv reference is stolen on success.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_global_set_path(struct pyphp_path_key_t * path, Py_ssize_t count, zval * zv) {
+	PyObject * error_type = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	Py_ssize_t i = 0;
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Walk the php arrays down to the value, creating the missing ones.
+	{
+		HashTable * ht = NULL; // borrowed
+		zval ** zdict = NULL; // borrowed
+		zval * znew = NULL; // owned
+		bool released = false;
+		TSRMLS_FETCH();
+		released = pyphp_begin_php();
+		ht = &EG(symbol_table);
+		for (i = 0; i + 1 < count; ++i) {
+			zdict = pyphp_php_path_find(ht, &path[i]);
+			if (zdict == NULL) {
+				// Create the missing array.
+				MAKE_STD_ZVAL(znew);
+				array_init(znew);
+				if (!pyphp_php_path_update(ht, &path[i], znew, &zdict)) {
+					zval_del(&znew);
+					error_type = InternalErrorType;
+					error = "Failed to set path key:%" PY_Z "i.";
+					break;
+				}
+				znew = NULL; // PHP array steals reference to php value.
+			} else if (Z_TYPE_PP(zdict) == IS_NULL) {
+				// Replace null with an array the same way PHP does when an element
+				// is assigned to it.
+				SEPARATE_ZVAL_IF_NOT_REF(zdict);
+				array_init(*zdict);
+			} else if (Z_TYPE_PP(zdict) == IS_ARRAY) {
+				// Separate the array from any copies before changing it.
+				SEPARATE_ZVAL_IF_NOT_REF(zdict);
+			} else {
+				error_type = PyExc_TypeError;
+				error = "path key:%" PY_Z "i is not an array.";
+				break;
+			}
+			ht = Z_ARRVAL_PP(zdict);
+		}
+		
+		// Set php value.
+		// .. NOTE: The zv reference is stolen.
+		if (error == NULL && !pyphp_php_path_update(ht, &path[i], zv, NULL)) {
+			error_type = InternalErrorType;
+			error = "Failed to set path key:%" PY_Z "i.";
+		}
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_Format(error_type, error, i);
+		return false;
+	}
+	return true;
+}
+
+/**
+Gets the value of the specified configuration option.
+
+*key* (``const char *``) is the name of the option to get.
+
+*keylen* (``int``) is the length of *key*.
+
+*orig* (``bool``) is whether the original configuration option should be
+returned (``true``), or the current value (``false``).
+
+Returns a borrowed reference to the option value (``const char *``).
+*/
+static const char * pyphp_php_ini_get(const char * key, int keylen, bool orig) {
+	/*
+	.. NOTE: This function is derived from ``ini_get()`` from
+	   ``php-5.3.13/ext/standard/basic_functions.c``.
+	*/
+	char * val = NULL; // borrowed
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return NULL;
+	}
+	
+	// Get INI value.
+	// .. NOTE: I think it is safe to cast to `char *`.
+	// .. NOTE: INI key length must include NULL byte.
+	val = zend_ini_string((char *)key, (unsigned int)keylen + 1, (int)orig);
+	if (val == NULL) {
+		PyErr_SetString(PyExc_KeyError, "key is not set.");
+		return NULL;
+	}
+	return val;
+}
+
+/*
+NOTE: This function is copied from ``php_ini_get_option()`` from
+``php-5.3.13/ext/standard/basic_functions.c``.
+*/
+static int php_ini_get_option(zend_ini_entry * ini_entry TSRMLS_DC, int num_args, va_list args, zend_hash_key * hash_key) {
+	zval *ini_array = va_arg(args, zval *);
+	int module_number = va_arg(args, int);
+	int details = va_arg(args, int);
+	zval *option;
+
+	if (module_number != 0 && ini_entry->module_number != module_number) {
+		return 0;
+	}
+
+	if (hash_key->nKeyLength == 0 ||
+		hash_key->arKey[0] != 0
+	) {
+		if (details) {
+			MAKE_STD_ZVAL(option);
+			array_init(option);
+
+			if (ini_entry->orig_value) {
+				add_assoc_stringl(option, "global_value", ini_entry->orig_value, ini_entry->orig_value_length, 1);
+			} else if (ini_entry->value) {
+				add_assoc_stringl(option, "global_value", ini_entry->value, ini_entry->value_length, 1);
+			} else {
+				add_assoc_null(option, "global_value");
+			}
+
+			if (ini_entry->value) {
+				add_assoc_stringl(option, "local_value", ini_entry->value, ini_entry->value_length, 1);
+			} else {
+				add_assoc_null(option, "local_value");
+			}
+
+			add_assoc_long(option, "access", ini_entry->modifiable);
+
+			add_assoc_zval_ex(ini_array, ini_entry->name, ini_entry->name_length, option);
+		} else {
+			if (ini_entry->value) {
+				add_assoc_stringl(ini_array, ini_entry->name, ini_entry->value, ini_entry->value_length, 1);
+			} else {
+				add_assoc_null(ini_array, ini_entry->name);
+			}
+		}
+	}
+	return 0;
+}
+
+/**
+Gets all configuration options.
+
+*ext* (``const char *``) optionally is the name of the specific extension to
+get the configuration options for. If ``NULL`, all options will be returned.
+
+*extlen* (``int``) is the length of *ext*.
+
+*details* (``bool``) is whether detailed settings should be returned
+(``true``), or not (``false``).
+
+Returns a dict (``zval *``) mapping option key (``char *``) to value
+(``char *``).
+*/
+static zval * pyphp_php_ini_get_all(const char * ext, int extlen, bool details) {
+	/*
+	.. NOTE: This function is derived from ``ini_get_all()`` and
+	   ``php_ini_get_option()`` from
+	   ``php-5.3.13/ext/standard/basic_functions.c``.
+	*/
+	zval * zdict = NULL; // owned
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return NULL;
+	}
+	
+	{
+		int zmodnum = 0;
+		TSRMLS_FETCH();
+		
+		// Get php module extension ID.
+		zend_ini_sort_entries(TSRMLS_C);
+		if (ext != NULL) {
+			zend_module_entry * zmod = NULL;
+			if (zend_symtable_find(&module_registry, ext, extlen + 1, &zmod) != SUCCESS) {
+				PyErr_SetString(PyExc_KeyError, "extension is not set.");
+				return NULL;
+			}
+			zmodnum = zmod->module_number;
+		}
+		
+		// Copy ini options to php dict.
+		MAKE_STD_ZVAL(zdict);
+		array_init(zdict);
+		zend_hash_apply_with_arguments(EG(ini_directives) TSRMLS_CC, (apply_func_args_t)php_ini_get_option, 3, zdict, zmodnum, (int)details);
+	}
+	return zdict;
+}
+
+/**
+Sets the value of the specified configuration option.
+
+*key* (``const char *``) is the name of the option to set.
+
+*keylen* (``int``) is the length of *key*.
+
+*val* (``const char *``) is the value of the option to set.
+
+*vallen (``int``) is the length of *val*.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_ini_set(const char * key, int keylen, const char * val, int vallen) {
+	/*
+	.. NOTE: This function is derived from ``ini_set()`` from
+	   ``php-5.3.13/ext/standard/basic_functions.c``.
+	*/
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set INI value.
+	// .. NOTE: INI key length must include NULL byte but value length MUST NOT.
+	// .. NOTE: The GIL is released because changing an option can report
+	//    errors.
+	{
+		int status;
+		bool released = pyphp_begin_php();
+		status = zend_alter_ini_entry((char *)key, (unsigned int)keylen + 1, (char *)val, (unsigned int)vallen, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
+		pyphp_end_php(released);
+		if (status != SUCCESS) {
+			PyErr_SetString(InternalErrorType, "Failed to set option key/value.");
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+Sets the PHP output callback function.
+
+*pyout* (``PyObject *``) is the output callback.
+
+Returns ``true`` on success; otherwise, ``false``. 
+*/
+static bool pyphp_php_output_callback_set(PyObject * pyout) {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set callback.
+	Py_INCREF(pyout);
+	Py_XDECREF(pyphp_interp->pyout_cb);
+	pyphp_interp->pyout_cb = pyout;
+	
+	return true;
+}
+
+/**
+Sets the PHP output file pointer.
+
+*out_fp* (``int``) is the output file pointer.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_output_fp_set(FILE * out_fp) {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set file pointer.
+	pyphp_interp->out_fp = out_fp;
+	
+	return true;
+}
+
+/**
+Sets the PHP error callback function.
+
+*pyerr* (``PyObject *``) is the error callback.
+
+Returns ``true`` on success; otherwise, ``false``. 
+*/
+static bool pyphp_php_error_callback_set(PyObject * pyerr) {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set callback.
+	Py_INCREF(pyerr);
+	Py_XDECREF(pyphp_interp->pyerr_cb);
+	pyphp_interp->pyerr_cb = pyerr;
+	
+	return true;
+}
+
+/**
+Sets the PHP error file pointer.
+
+*err_fp* (``int``) is the error file pointer.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_error_fp_set(FILE * err_fp) {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set file pointer.
+	pyphp_interp->err_fp = err_fp;
+	
+	return true;
+}
+
+/**
+Sets the PHP log callback function.
+
+*pylog* (``PyObject *``) is the log callback.
+
+Returns ``true`` on success; otherwise, ``false``. 
+*/
+static bool pyphp_php_log_callback_set(PyObject * pylog) {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set callback.
+	Py_INCREF(pylog);
+	Py_XDECREF(pyphp_interp->pylog_cb);
+	pyphp_interp->pylog_cb = pylog;
+	
+	return true;
+}
+
+/**
+Sets the PHP log file pointer.
+
+*log_fp* (``int``) is the log file pointer.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_php_log_fp_set(FILE * log_fp) {
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		return false;
+	}
+	
+	// Set file pointer.
+	pyphp_interp->log_fp = log_fp;
+	
+	return true;
+}
+
+
+/**
+Shuts-down PHP. PHP can be re-started after being shutdown.
+*/
+static void pyphp_php_shutdown() {
+	if (!pyphp_interp->is_started) {
+		// Since PHP is not started, do nothing.
+		return;
+	}
+	pyphp_interp->is_started = false;
+	++pyphp_interp->request_id;
+	
+	// Destroy the caches before the request memory is released.
+	pyphp_php_fcall_cache_clear();
+	
+	// .. NOTE: The GIL is released because shutting down the request can run
+	//    PHP code (e.g., destructors and shutdown functions).
+	{
+		bool released = pyphp_begin_php();
+		php_request_shutdown(NULL);
+		pyphp_end_php(released);
+	}
+}
+
+/**
+Called when PHP encounters an error.
+
+.. TODO: Test to see if Python catches a fatal error raised by PHP.
+
+*type* (``int``) is the error type.
+
+*file* (``const char *``) is the file the error occured in.
+
+*line* (``const unsigned int``) is the line the error occured on.
+
+*format* (``const char *``) is the error message format.
+
+*args* (``va_list``) is the error message arguments.
+*/
+static void pyphp_php_error_cb(int type, const char * file, const unsigned int line, const char * format, va_list args) {
+	char * error = NULL;
+	bool is_fatal = false;
+	
+	switch (type) {
+		case E_ERROR:
+			is_fatal = true;
+			error = "Fatal Error";
+			break;
+		
+		case E_CORE_ERROR:
+			is_fatal = true;
+			error = "Fatal Core Error";
+			break;
+		
+		case E_COMPILE_ERROR:
+			is_fatal = true;
+			error = "Fatal Compile Error";
+			break;
+			
+		case E_USER_ERROR:
+			is_fatal = true;
+			error = "Fatal User Error";
+			break;
+			
+		case E_RECOVERABLE_ERROR:
+			error = "Recoverable Error";
+			break;
+			
+		case E_WARNING:
+			error = "Warning";
+			break;
+		
+		case E_CORE_WARNING:
+			error = "Core Warning";
+			break;
+			
+		case E_COMPILE_WARNING:
+			error = "Compile Warning";
+			break;
+			
+		case E_USER_WARNING:
+			error = "User Warning";
+			break;
+			
+		case E_PARSE:
+			error = "Parse Error";
+			break;
+			
+		case E_NOTICE:
+			error = "Notice";
+			break;
+		
+		case E_USER_NOTICE:
+			error = "User Notice";
+			break;
+			
+		case E_STRICT:
+			error = "Strict Standards";
+			break;
+			
+		case E_DEPRECATED:
+			error = "Deprecated";
+			break;
+			
+		case E_USER_DEPRECATED:
+			error = "User Deprecated";
+			break;
+			
+		default:
+			error = "Unknown error";
+			break;
+	}
+	
+	// If the error is fatal, raise a python exception.
+	if (is_fatal) {
+		char * message = NULL;
+		int msglen;
+		va_list vars;
+		bool acquired = false;
+		TSRMLS_FETCH();
+		
+		// Copy args so that the arguments are not consumed before being passed to
+		// internal PHP error handler.
+		va_copy(vars, args);
+		msglen = vspprintf(&message, PG(log_errors_max_len), format, vars);
+		va_end(vars);
+		acquired = pyphp_begin_py();
+		if (message == NULL) {
+			PyErr_SetString(InternalErrorType, "Failed to format PHP fatal error message.");
+		} else {
+			// Raise fatal error.
+			PyObject * pyval = Py_BuildValue("(ss#sI)", error, message, (Py_ssize_t)msglen, file, line);
+			if (pyval != NULL) {
+				PyErr_SetObject(PhpFatalErrorType, pyval);
+				Py_DECREF(pyval);
+			}
+			// Clean up.
+			efree(message);
+		}
+		// .. NOTE: The GIL must be released again before calling the internal
+		//    handler because it bails out of fatal errors.
+		pyphp_end_py(acquired);
+	}
+	
+	// Call the internal PHP error handler.
+	pyphp.php_internal_error_cb(type, file, line, format, args);
+}
+
+/**
+Starts-up PHP.
+
+*argc* (``int``) is the number of arguments.
+
+*argv* (``char **``) is the arguments.
+
+Returns ``true`` on success; otherwise, ``false`` and raises a Python
+Exception.
+*/
+static bool pyphp_php_startup(int argc, char ** argv) {
+	char * all_errors = NULL;
+	int all_errors_len;
+	bool released = false;
+	int status;
+	#ifdef ZTS
+	void *** tsrm_ls = NULL;
+	#endif
+	
+	if (pyphp_interp->is_started) {
+		// Since PHP is already started, do nothing.
+		return true;
+	}
+	
+	if (!pyphp.is_inited) {
+		// Initialize the PHP embed SAPI.
+		// .. NOTE: PHP can only be initialized with the main interpreter.
+		if (pyphp_interp != &pyphp.main) {
+			PyErr_SetString(InternalErrorType, "PHP must be initialized with init() before other interpreters are started.");
+			return false;
+		}
+		
+		pyphp_interp->out_fp = stdout;
+		pyphp_interp->err_fp = stdout;
+		pyphp_interp->log_fp = stdout;
+	
+		// Override PHP embed log handler.
+		php_embed_module.log_message = pyphp_php_log_cb;
+
+		// Override PHP embed output handler.
+		php_embed_module.ub_write = pyphp_php_output_cb;
+	
+		// Override PHP embed output flush handler.
+		php_embed_module.flush = pyphp_php_output_flush_cb; 
+	
+		// Override PHP embed startup handler.
+		php_embed_module.startup = pyphp_php_startup_cb;
+	
+		// Completely initialize/startup PHP.
+		released = pyphp_begin_php();
+		status = php_embed_init(argc, argv PTSRMLS_CC);
+		pyphp_end_php(released);
+		if (status != SUCCESS) {
+			// Raise internal error.
+			PyErr_SetString(InternalErrorType, "Failed to initialize PHP embed SAPI.");
+			return false;
+		}
+		pyphp.is_inited = true;
+		
+		#ifdef ZTS
+		// Grab the TSRM context PHP was initialized with for the main
+		// interpreter.
+		pyphp.main.ctx = tsrm_set_interpreter_context(NULL);
+		tsrm_set_interpreter_context(pyphp.main.ctx);
+		#endif
+		
+	} else {
+		#ifdef ZTS
+		if (pyphp_interp->ctx == NULL) {
+			// Create the TSRM context for the interpreter. The PHP globals of the
+			// context are initialized from the started PHP modules.
+			pyphp_interp->ctx = tsrm_new_interpreter_context();
+			tsrm_set_interpreter_context(pyphp_interp->ctx);
+			tsrm_ls = (void ***)ts_resource_ex(0, NULL);
+			
+			// Do not change the working directory to the executed script (the
+			// same as the embed SAPI).
+			SG(options) |= SAPI_OPTION_NO_CHDIR;
+		} else {
+			tsrm_ls = (void ***)ts_resource_ex(0, NULL);
+		}
+		#endif
+		
+		// Re-initialize PHP.
+		released = pyphp_begin_php();
+		status = php_request_startup(TSRMLS_C);
+		pyphp_end_php(released);
+		if (status != SUCCESS) {
+			// Raise internal error.
+			PyErr_SetString(InternalErrorType, "Failed to startup PHP.");
+			return false;
+		}
+	}
+	
+	// Setup INI settings.
+	all_errors_len = spprintf(&all_errors, 0, "%u", E_ALL);
+	if (all_errors == NULL) {
+		PyErr_Format(InternalErrorType, "Failed to convert E_ALL:%u to string.", E_ALL);
+		goto startup_error;
+	}
+	// .. NOTE: INI key length MUST include NULL byte but value length MUST NOT.
+	zend_alter_ini_entry("error_reporting", sizeof("error_reporting"), all_errors, all_errors_len, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
+	zend_alter_ini_entry("log_errors", sizeof("log_errors"), "1", sizeof("1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
+	zend_alter_ini_entry("display_errors", sizeof("display_errors"), "1", sizeof("1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
+	zend_alter_ini_entry("display_startup_errors", sizeof("display_startup_errors"), "1", sizeof("1") - 1, PHP_INI_SYSTEM, PHP_INI_STAGE_RUNTIME);
+	
+	// Clean up.
+	efree(all_errors);
+	
+	// PHP is fully started.
+	pyphp_interp->is_started = true;
+	return true;
+	
+	startup_error: {
+		// Shutdown PHP.
+		pyphp_php_shutdown();
+		return false;
+	}
+}
+
+/**
+Called when PHP logs a message.
+
+*message* (``char *``) is the log message.
+*/
+static void pyphp_php_log_cb(char * message) {
+	if (message == NULL) {
+		return;
+	}
+	if (pyphp_interp->log_fp != NULL) {
+		// Write log to file pointer.
+		fputs(message, pyphp_interp->log_fp);
+		fputc('\n', pyphp_interp->log_fp);
+		fflush(pyphp_interp->log_fp);
+	}
+	if (pyphp_interp->pylog_cb != NULL) {
+		// Send log to callback.
+		bool acquired = pyphp_begin_py();
+		PyObject * pylog_cb = pyphp_interp->pylog_cb; // owned
+		PyObject * pyargs = NULL; // owned
+		// .. NOTE: Hold a reference in case the callback replaces itself.
+		Py_INCREF(pylog_cb);
+		pyargs = Py_BuildValue("(s):pyphp.pyphp_php_log_cb", message);
+		if (pyargs != NULL) {
+			PyObject * pyresult = PyEval_CallObject(pylog_cb, pyargs);
+			Py_XDECREF(pyresult);
+			Py_DECREF(pyargs);
+		}
+		Py_DECREF(pylog_cb);
+		pyphp_end_py(acquired);
+	}
+}
+
+/**
+Called when PHP outputs data.
+
+*str* (``const char *``) is the output data.
+
+*str_length* (``unsigned int``) is the number of bytes.
+
+Returns the number of bytes written (``int``).
+*/
+static int pyphp_php_output_cb(const char * str, unsigned int str_length TSRMLS_DC) {
+	int len;
+	
+	if (str == NULL || str_length == 0) {
+		return 0;
+	}
+	len = str_length > INT_MAX ? INT_MAX : (int)str_length;
+	if (pyphp_interp->out_fp != NULL) {
+		// Write data to file pointer.
+		len = (int)fwrite(str, sizeof(*str), (size_t)len, pyphp_interp->out_fp);
+	}
+	if (pyphp_interp->pyout_cb != NULL) {
+		// Send data to callback.
+		bool acquired = pyphp_begin_py();
+		PyObject * pyout_cb = pyphp_interp->pyout_cb; // owned
+		PyObject * pyargs = NULL; // owned
+		// .. NOTE: Hold a reference in case the callback replaces itself.
+		Py_INCREF(pyout_cb);
+		pyargs = Py_BuildValue("(s#):pyphp.pyphp_php_output_cb", str, (Py_ssize_t)len);
+		if (pyargs != NULL) {
+			PyObject * pyresult = PyEval_CallObject(pyout_cb, pyargs);
+			Py_XDECREF(pyresult);
+			Py_DECREF(pyargs);
+		}
+		Py_DECREF(pyout_cb);
+		pyphp_end_py(acquired);
+	}
+	return len;
+}
+
+/**
+Called when the PHP output file pointer needs to be flushed.
+*/
+static void pyphp_php_output_flush_cb(void * server_ctx) {
+	fflush(pyphp_interp->out_fp);
+}
+
+/**
+Restarts PHP.
+
+Returns whether PHP was successfully restarted (``true``), or not (``false``).
+*/
+static bool pyphp_php_restart() {
+	// The request memory cannot be released while buffers point into it so the
+	// restart is retried before PHP is used again.
+	if (!pyphp_php_request_can_end()) {
+		pyphp_interp->restart_pending = true;
+		return false;
+	}
+	pyphp_interp->restart_pending = false;
+	pyphp_php_shutdown();
+	return pyphp_php_startup(0, NULL);
+}
+
+/**
+Sets the PHP error handler Python callback function.
+
+*pyerr_cb* (``PyObject *``) is the python callback.
+*/
+static void pyphp_php_set_error_cb(PyObject * pyerr_cb) {
+	Py_XINCREF(pyerr_cb);
+	Py_XDECREF(pyphp_interp->pyerr_cb);
+	pyphp_interp->pyerr_cb = pyerr_cb;
+}
+
+/**
+Sets the PHP log handler Python callback function.
+
+*pylog_cb* (``PyObject *``) is the python callback.
+*/
+static void pyphp_php_set_log_cb(PyObject * pylog_cb) {
+	Py_XINCREF(pylog_cb);
+	Py_XDECREF(pyphp_interp->pylog_cb);
+	pyphp_interp->pylog_cb = pylog_cb;
+}
+
+/**
+Sets the PHP output handler Python callback function.
+
+*pyout_cb* (``PyObject *``) is the python callback.
+*/
+static void pyphp_php_set_output_cb(PyObject * pyout_cb) {
+	Py_XINCREF(pyout_cb);
+	Py_XDECREF(pyphp_interp->pyout_cb);
+	pyphp_interp->pyout_cb = pyout_cb;
+}
+
+/**
+Completely, irreversibly shuts-down PHP.
+*/
+static void pyphp_php_destroy() {
+	if (!pyphp.is_inited) {
+		return;
+	}
+	pyphp.is_inited = false;
+	pyphp_interp->is_started = false;
+	++pyphp_interp->request_id;
+	{
+		TSRMLS_FETCH();
+		php_embed_shutdown(TSRMLS_C);
+	}
+}
+
+/**
+Called when PHP is started up.
+
+.. HACK: Stores and overrides the internal PHP error handler.
+
+*sapi* (``sapi_module_struct *``) is the SAPI module to start up.
+
+Returns ``SUCCESS`` on success; otherwise, ``FAILURE``.
+*/
+static int pyphp_php_startup_cb(sapi_module_struct * sapi) {
+	if (php_module_startup(&sapi_module, NULL, 0) == FAILURE) {
+		return FAILURE;
+	}
+	//HACK: Grab the function pointer to the internal PHP (zend) error handler.
+	pyphp.php_internal_error_cb = zend_error_cb;
+	//HACK: Override the internal PHP error handler.
+	zend_error_cb = pyphp_php_error_cb;
+	
+	return SUCCESS;
+}
+
+
+
+/******************************* Python Types *******************************/
+
+static const char InterpreterType_doc[] = (
+	"The ``Interpreter`` class is a PHP interpreter with its own PHP globals,\n"
+	"requests, caches, callbacks and file descriptors. It has the same methods\n"
+	"as the module which use the main interpreter (``main_interpreter``).\n"
+	"\n"
+	"Separate interpreters execute PHP at the same time when called from\n"
+	"separate threads. Calls to the same interpreter are serialized.\n"
+	"\n"
+	".. NOTE: PHP must be thread-safe (ZTS) to create interpreters other than\n"
+	"   the main interpreter, and PHP must be initialized with ``init()``\n"
+	"   before they are started."
+);
+
+static PyObject * pyphp_interpreter_new(PyTypeObject * type, PyObject * args, PyObject * kwargs) {
+	InterpreterObject * self = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, ":pyphp.Interpreter")) {
+		return NULL;
+	}
+	
+	#ifndef ZTS
+	PyErr_SetString(InternalErrorType, "PHP is not thread-safe (ZTS): only the main interpreter is available.");
+	return NULL;
+	#endif
+	
+	self = (InterpreterObject *)type->tp_alloc(type, 0);
+	if (self == NULL) {
+		return NULL;
+	}
+	self->interp = PyMem_New(struct pyphp_interp_t, 1);
+	if (self->interp == NULL) {
+		PyErr_NoMemory();
+		goto new_error;
+	}
+	memset(self->interp, 0, sizeof(*self->interp));
+	self->interp->out_fp = stdout;
+	self->interp->err_fp = stdout;
+	self->interp->log_fp = stdout;
+	self->interp->max_depth = PYPHP_MAX_DEPTH;
+	self->interp->lock = PyThread_allocate_lock();
+	if (self->interp->lock == NULL) {
+		PyErr_SetString(PyExc_MemoryError, "Failed to allocate interpreter lock.");
+		goto new_error;
+	}
+	
+	return (PyObject *)self;
+	
+	new_error: {
+		Py_DECREF(self);
+	}
+	return NULL;
+}
+
+static void pyphp_interpreter_dealloc(InterpreterObject * self) {
+	struct pyphp_interp_t * interp = self->interp; // owned
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	
+	// .. NOTE: The main interpreter is never destroyed.
+	if (interp != NULL && interp != &pyphp.main) {
+		if (interp->lock != NULL) {
+			// Shutdown PHP.
+			prev = pyphp_enter((PyObject *)self);
+			interp->request_depth = 0;
+			pyphp_php_shutdown();
+			pyphp_leave((PyObject *)self, prev);
+			PyThread_free_lock(interp->lock);
+		}
+		#ifdef ZTS
+		if (interp->ctx != NULL) {
+			tsrm_free_interpreter_context(interp->ctx);
+		}
+		#endif
+		Py_XDECREF(interp->pyerr_cb);
+		Py_XDECREF(interp->pylog_cb);
+		Py_XDECREF(interp->pyout_cb);
+		intern_clear(&interp->interns);
+		PyMem_Free(interp);
+	}
+	self->interp = NULL;
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static PyTypeObject InterpreterType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"cpyphp.Interpreter", // tp_name
+	sizeof(InterpreterObject), // tp_basicsize
+	0, // tp_itemsize
+	(destructor)pyphp_interpreter_dealloc, // tp_dealloc
+	0, // tp_print
+	0, // tp_getattr
+	0, // tp_setattr
+	0, // tp_compare
+	0, // tp_repr
+	0, // tp_as_number
+	0, // tp_as_sequence
+	0, // tp_as_mapping
+	0, // tp_hash
+	0, // tp_call
+	0, // tp_str
+	0, // tp_getattro
+	0, // tp_setattro
+	0, // tp_as_buffer
+	Py_TPFLAGS_DEFAULT, // tp_flags
+	InterpreterType_doc, // tp_doc
+	0, // tp_traverse
+	0, // tp_clear
+	0, // tp_richcompare
+	0, // tp_weaklistoffset
+	0, // tp_iter
+	0, // tp_iternext
+	0, // tp_methods: set to the module methods by ``initcpyphp()``.
+	0, // tp_members
+	0, // tp_getset
+	0, // tp_base
+	0, // tp_dict
+	0, // tp_descr_get
+	0, // tp_descr_set
+	0, // tp_dictoffset
+	0, // tp_init
+	0, // tp_alloc
+	pyphp_interpreter_new, // tp_new
+};
+
+static const char CompiledScriptType_doc[] = (
+	"The ``CompiledScript`` class is a PHP inline string/script that has been\n"
+	"compiled by ``compile()`` so that it can be executed repeatedly without\n"
+	"being recompiled.\n"
+	"\n"
+	".. NOTE: A compiled script is only valid for the PHP request it was\n"
+	"   compiled in. If PHP has been restarted since, the script is\n"
+	"   transparently recompiled when it is next executed. Use a persistent\n"
+	"   request (see ``begin_request()``) to avoid recompiling."
+);
+
+typedef struct {
+	PyObject_HEAD
+	
+	// The source code (``str``).
+	PyObject * source;
+	
+	// The name (``str`` or ``None``).
+	PyObject * name;
+	
+	// The interpreter (``Interpreter``) the script is compiled for.
+	PyObject * interp;
+	
+	// The compiled script.
+	// .. NOTE: This is only valid while *request_id* is the current request.
+	zend_op_array * op_array;
+	unsigned long request_id;
+} CompiledScriptObject;
+
+/**
+Compiles the source code of the specified compiled script.
+
+*self* (``CompiledScriptObject *``) is the compiled script.
+
+Returns ``true`` on success; otherwise, ``false``.
+*/
+static bool pyphp_compiled_script_compile(CompiledScriptObject * self) {
+	const char * name = NULL; // borrowed
+	Py_ssize_t source_len = 0;
+	
+	source_len = PyString_GET_SIZE(self->source);
+	if (source_len < 0 || INT_MAX < source_len) {
+		PyErr_Format(PyExc_ValueError, "source length:%" PY_Z "i must be between 0 and %i inclusive.", source_len, INT_MAX);
+		return false;
+	}
+	name = self->name != Py_None ? PyString_AS_STRING(self->name) : NULL;
+	
+	// Compile source.
+	self->op_array = pyphp_php_compile_inline(name, PyString_AS_STRING(self->source), (int)source_len);
+	if (self->op_array == NULL) {
+		return false;
+	}
+	self->request_id = pyphp_interp->request_id;
+	return true;
+}
+
+static void pyphp_compiled_script_dealloc(CompiledScriptObject * self) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	
+	// Destroy the compiled script if its request is still active.
+	if (self->op_array != NULL) {
+		prev = pyphp_enter(self->interp);
+		if (pyphp_interp->is_started && self->request_id == pyphp_interp->request_id) {
+			TSRMLS_FETCH();
+			destroy_op_array(self->op_array TSRMLS_CC);
+			efree(self->op_array);
+		}
+		pyphp_leave(self->interp, prev);
+	}
+	self->op_array = NULL;
+	Py_XDECREF(self->source);
+	Py_XDECREF(self->name);
+	Py_XDECREF(self->interp);
+	Py_TYPE(self)->tp_free((PyObject *)self);
+}
+
+static const char pyphp_compiled_script_execute_doc[] = (
+	"Executes the compiled script.\n"
+	"\n"
+	"*json* (``bool``) is whether the value returned by the script should be\n"
+	"encoded as a JSON ``str`` (``True``), or converted to a Python value\n"
+	"(``False``). Default is ``False``.\n"
+	"\n"
+	"*track_changes* (``bool``) is whether the global variables added or\n"
+	"changed by the script should also be returned (``True``), or not\n"
+	"(``False``). Only the changed variables are converted. Default is\n"
+	"``False``.\n"
+	"\n"
+	".. NOTE: Only a shallow snapshot of each variable is compared, so\n"
+	"   elements changed in an array without changing its element count, and\n"
+	"   properties changed on an object, are not tracked. Removed variables\n"
+	"   are not returned.\n"
+	"\n"
+	".. NOTE: PHP is restarted after the script is executed unless a\n"
+	"   persistent request is active (see ``begin_request()``).\n"
+	"\n"
+	"Returns the value (**mixed**) returned by the script, or ``None``. If\n"
+	"*track_changes* is ``True``, returns a ``tuple`` of the value and the\n"
+	"``dict`` of the changed global variables mapped by name."
+);
+
+static PyObject * pyphp_compiled_script_execute(CompiledScriptObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pyresult = NULL; // owned
+	bool result = false;
+	int json = 0;
+	int track_changes = 0;
+	PyObject * pychanges = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "|ii:pyphp.CompiledScript.execute", &json, &track_changes)) {
+		return NULL;
+	}
+	
+	prev = pyphp_enter(self->interp);
+	
+	// Retry a pending restart before the compiled script is checked because the
+	// restart releases it.
+	result = pyphp_php_exec_begin();
+	
+	// Recompile the script if the request it was compiled in has ended.
+	if (result && (self->op_array == NULL || self->request_id != pyphp_interp->request_id)) {
+		self->op_array = NULL;
+		result = pyphp_compiled_script_compile(self);
+	}
+	
+	// Execute compiled script.
+	if (result) {
+		result = pyphp_php_exec_op_array(self->op_array, false, (bool)json, track_changes ? &pychanges : NULL, &pyresult);
+	}
+	
+	pyphp_leave(self->interp, prev);
+	if (!result) {
+		return NULL;
+	}
+	
+	if (track_changes) {
+		// Return the value along with the changed globals.
+		return Py_BuildValue("(NN)", pyresult, pychanges);
+	}
+	return pyresult;
+}
+
+static PyMethodDef CompiledScriptType_methods[] = {
+	{"execute", (PyCFunction)pyphp_compiled_script_execute, METH_VARARGS, pyphp_compiled_script_execute_doc},
+	{NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef CompiledScriptType_members[] = {
+	{"interpreter", T_OBJECT, offsetof(CompiledScriptObject, interp), READONLY, "The interpreter (``Interpreter``) the script is compiled for."},
+	{"name", T_OBJECT, offsetof(CompiledScriptObject, name), READONLY, "The name (``str`` or ``None``) of the script."},
+	{"source", T_OBJECT, offsetof(CompiledScriptObject, source), READONLY, "The source code (``str``) of the script."},
+	{NULL, 0, 0, 0, NULL}
+};
+
+static PyTypeObject CompiledScriptType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"cpyphp.CompiledScript", // tp_name
+	sizeof(CompiledScriptObject), // tp_basicsize
+	0, // tp_itemsize
+	(destructor)pyphp_compiled_script_dealloc, // tp_dealloc
+	0, // tp_print
+	0, // tp_getattr
+	0, // tp_setattr
+	0, // tp_compare
+	0, // tp_repr
+	0, // tp_as_number
+	0, // tp_as_sequence
+	0, // tp_as_mapping
+	0, // tp_hash
+	0, // tp_call
+	0, // tp_str
+	0, // tp_getattro
+	0, // tp_setattro
+	0, // tp_as_buffer
+	Py_TPFLAGS_DEFAULT, // tp_flags
+	CompiledScriptType_doc, // tp_doc
+	0, // tp_traverse
+	0, // tp_clear
+	0, // tp_richcompare
+	0, // tp_weaklistoffset
+	0, // tp_iter
+	0, // tp_iternext
+	CompiledScriptType_methods, // tp_methods
+	CompiledScriptType_members, // tp_members
+};
+
+static const char PhpArrayType_doc[] = (
+	"The ``PhpArray`` class is a read-only view of a PHP array returned by\n"
+	"``global_get()`` when *lazy* is ``True``. Elements are converted to\n"
+	"Python values when they are accessed instead of converting the whole\n"
+	"array up front. Nested arrays are returned as ``PhpArray`` views.\n"
+	"\n"
+	"Indexing, ``len()``, ``in``, iteration (over keys), ``get()``,\n"
+	"``keys()``, ``values()`` and ``items()`` behave as they do for ``dict``.\n"
+	"Use ``to_python()`` to convert the whole array.\n"
+	"\n"
+	".. NOTE: The view keeps a reference to the PHP array so it is a snapshot\n"
+	"   of the array unless the variable is a PHP reference. The view is only\n"
+	"   valid for the PHP request it was created in. Accessing it afterward\n"
+	"   raises an ``InternalError``."
+);
+
+typedef struct {
+	PyObject_HEAD
+	
+	// The interpreter (``Interpreter``) the array belongs to.
+	PyObject * interp;
+	
+	// The php array.
+	// .. NOTE: This is only valid while *request_id* is the current request.
+	zval * zarray;
+	unsigned long request_id;
+} PhpArrayObject;
+
+static PyTypeObject PhpArrayType;
+
+/**
+Creates a view of the specified PHP array for the current interpreter.
+
+*pyinterp* (``PyObject *``) is the interpreter.
+
+*zarray* (``zval *``) is the PHP array. A reference to it is added.
+
+Returns the new view (``PyObject *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * pyphp_array_wrap(PyObject * pyinterp, zval * zarray) {
+	PhpArrayObject * self = NULL; // owned
+	
+	self = PyObject_New(PhpArrayObject, &PhpArrayType);
+	if (self == NULL) {
+		return NULL;
+	}
+	Py_INCREF(pyinterp);
+	self->interp = pyinterp;
+	Z_ADDREF_P(zarray);
+	self->zarray = zarray;
+	self->request_id = pyphp_interp->request_id;
+	return (PyObject *)self;
+}
+
+/**
+Checks whether the specified view is still valid. This must be called after
+entering its interpreter.
+
+*self* (``PhpArrayObject *``) is the view.
+
+Returns ``true`` if it is valid; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool pyphp_array_check(PhpArrayObject * self) {
+	if (!pyphp_interp->is_started || self->request_id != pyphp_interp->request_id) {
+		PyErr_SetString(InternalErrorType, "PHP array is no longer valid because its request has ended.");
+		return false;
+	}
+	return true;
+}
+
+/**
+Converts the specified element of a view to a Python value.
+
+*self* (``PhpArrayObject *``) is the view.
+
+*zv* (``zval *``) is the element.
+
+Returns the new Python value (``PyObject *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * pyphp_array_value(PhpArrayObject * self, zval * zv) {
+	if (Z_TYPE_P(zv) == IS_ARRAY) {
+		return pyphp_array_wrap(self->interp, zv);
+	}
+	return zval_to_PyObject(zv, NULL);
+}
+
+/**
+Finds the specified element of a view.
+
+*self* (``PhpArrayObject *``) is the view.
+
+*pykey* (``int``, ``long``, ``str`` or ``unicode``) is the key.
+
+*found* (``bool *``) is set to whether the key was found.
+
+Returns the element (``zval *``) if found; otherwise, ``NULL``.
+
+.. NOTE: If the return value is ``NULL`` and *found* is ``true``, a Python
+   exception has been raised.
+*/
+static zval * pyphp_array_find(PhpArrayObject * self, PyObject * pykey, bool * found) {
+	zval ** zv = NULL; // borrowed
+	PyObject * pykey_tmp = NULL; // owned
+	int result = FAILURE;
+	
+	*found = true;
+	if (PyInt_Check(pykey) || PyLong_Check(pykey)) {
+		long index = PyInt_AsLong(pykey);
+		if (index == -1 && PyErr_Occurred() != NULL) {
+			return NULL;
+		}
+		result = zend_hash_index_find(Z_ARRVAL_P(self->zarray), (ulong)index, (void **)&zv);
+	} else if (PyString_Check(pykey) || PyUnicode_Check(pykey)) {
+		Py_ssize_t keylen = 0;
+		if (PyUnicode_Check(pykey)) {
+			pykey_tmp = PyUnicode_AsUTF8String(pykey);
+			if (pykey_tmp == NULL) {
+				return NULL;
+			}
+			pykey = pykey_tmp;
+		}
+		keylen = PyString_GET_SIZE(pykey);
+		if (keylen < INT_MAX) {
+			// .. NOTE: Hash key length MUST include NULL byte.
+			result = zend_symtable_find(Z_ARRVAL_P(self->zarray), PyString_AS_STRING(pykey), (unsigned int)keylen + 1, (void **)&zv);
+		}
+		Py_XDECREF(pykey_tmp);
+	} else {
+		PyErr_Format(PyExc_TypeError, "PHP array key cannot be type:%s.", Py_TYPE(pykey)->tp_name);
+		return NULL;
+	}
+	if (result != SUCCESS) {
+		*found = false;
+		return NULL;
+	}
+	return *zv;
+}
+
+static void pyphp_array_dealloc(PhpArrayObject * self) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	
+	// Release the php array if its request is still active.
+	if (self->zarray != NULL) {
+		prev = pyphp_enter(self->interp);
+		if (pyphp_interp->is_started && self->request_id == pyphp_interp->request_id) {
+			zval_del(&self->zarray);
+		}
+		pyphp_leave(self->interp, prev);
+	}
+	self->zarray = NULL;
+	Py_XDECREF(self->interp);
+	PyObject_Del(self);
+}
+
+static Py_ssize_t pyphp_array_length(PhpArrayObject * self) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	Py_ssize_t len = -1;
+	
+	prev = pyphp_enter(self->interp);
+	if (pyphp_array_check(self)) {
+		len = (Py_ssize_t)zend_hash_num_elements(Z_ARRVAL_P(self->zarray));
+	}
+	pyphp_leave(self->interp, prev);
+	return len;
+}
+
+static PyObject * pyphp_array_subscript(PhpArrayObject * self, PyObject * pykey) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pyval = NULL; // owned
+	zval * zv = NULL; // borrowed
+	bool found = false;
+	
+	prev = pyphp_enter(self->interp);
+	if (pyphp_array_check(self)) {
+		zv = pyphp_array_find(self, pykey, &found);
+		if (zv != NULL) {
+			pyval = pyphp_array_value(self, zv);
+		} else if (!found) {
+			PyErr_SetObject(PyExc_KeyError, pykey);
+		}
+	}
+	pyphp_leave(self->interp, prev);
+	return pyval;
+}
+
+static int pyphp_array_contains(PhpArrayObject * self, PyObject * pykey) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	int result = -1;
+	bool found = false;
+	
+	prev = pyphp_enter(self->interp);
+	if (pyphp_array_check(self)) {
+		if (pyphp_array_find(self, pykey, &found) != NULL) {
+			result = 1;
+		} else if (!found) {
+			result = 0;
+		}
+	}
+	pyphp_leave(self->interp, prev);
+	return result;
+}
+
+/**
+Collects the keys, values or items of a view.
+
+*self* (``PhpArrayObject *``) is the view.
+
+*keys* (``bool``) is whether the keys should be collected.
+
+*values* (``bool``) is whether the values should be collected. If both
+*keys* and *values* are ``true``, ``(key, value)`` tuples are collected.
+
+Returns the new ``list``.
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * pyphp_array_collect(PhpArrayObject * self, bool keys, bool values) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pylist = NULL; // owned
+	PyObject * pykey = NULL; // owned
+	PyObject * pyval = NULL; // owned
+	PyObject * pyitem = NULL; // owned
+	Bucket * p = NULL; // borrowed
+	Py_ssize_t i = 0;
+	
+	prev = pyphp_enter(self->interp);
+	if (!pyphp_array_check(self)) {
+		goto collect_error;
+	}
+	pylist = PyList_New((Py_ssize_t)zend_hash_num_elements(Z_ARRVAL_P(self->zarray)));
+	if (pylist == NULL) {
+		goto collect_error;
+	}
+	for (p = Z_ARRVAL_P(self->zarray)->pListHead; p != NULL; p = p->pListNext, ++i) {
+		if (keys) {
+			pykey = bucket_key_to_PyObject(p, pyphp_interns());
+			if (pykey == NULL) {
+				goto collect_error;
+			}
+		}
+		if (values) {
+			pyval = pyphp_array_value(self, *(zval **)p->pData);
+			if (pyval == NULL) {
+				goto collect_error;
+			}
+		}
+		if (keys && values) {
+			pyitem = PyTuple_Pack(2, pykey, pyval);
+			Py_CLEAR(pykey);
+			Py_CLEAR(pyval);
+			if (pyitem == NULL) {
+				goto collect_error;
+			}
+		} else {
+			pyitem = keys ? pykey : pyval;
+			pykey = NULL;
+			pyval = NULL;
+		}
+		// .. NOTE: Python list steals reference to item.
+		PyList_SET_ITEM(pylist, i, pyitem);
+		pyitem = NULL;
+	}
+	pyphp_leave(self->interp, prev);
+	return pylist;
+	
+	collect_error: {
+		Py_XDECREF(pykey);
+		Py_XDECREF(pyval);
+		Py_XDECREF(pylist);
+		pyphp_leave(self->interp, prev);
+	}
+	return NULL;
+}
+
+static PyObject * pyphp_array_iter(PhpArrayObject * self) {
+	PyObject * pykeys = NULL; // owned
+	PyObject * pyiter = NULL; // owned
+	
+	pykeys = pyphp_array_collect(self, true, false);
+	if (pykeys == NULL) {
+		return NULL;
+	}
+	pyiter = PyObject_GetIter(pykeys);
+	Py_DECREF(pykeys);
+	return pyiter;
+}
+
+static const char pyphp_array_get_doc[] = (
+	"Gets the specified element.\n"
+	"\n"
+	"*key* (``int`` or ``str``) is the key of the element.\n"
+	"\n"
+	"*default* (**mixed**) is the value to return if *key* is not set.\n"
+	"Default is ``None``.\n"
+	"\n"
+	"Returns the value (**mixed**) of the element."
+);
+
+static PyObject * pyphp_array_get(PhpArrayObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pykey = NULL; // borrowed
+	PyObject * pydefault = Py_None; // borrowed
+	PyObject * pyval = NULL; // owned
+	zval * zv = NULL; // borrowed
+	bool found = false;
+	
+	if (!PyArg_ParseTuple(args, "O|O:pyphp.PhpArray.get", &pykey, &pydefault)) {
+		return NULL;
+	}
+	
+	prev = pyphp_enter(self->interp);
+	if (pyphp_array_check(self)) {
+		zv = pyphp_array_find(self, pykey, &found);
+		if (zv != NULL) {
+			pyval = pyphp_array_value(self, zv);
+		} else if (!found) {
+			Py_INCREF(pydefault);
+			pyval = pydefault;
+		}
+	}
+	pyphp_leave(self->interp, prev);
+	return pyval;
+}
+
+static const char pyphp_array_items_doc[] = (
+	"Returns the ``list`` of ``(key, value)`` elements."
+);
+
+static PyObject * pyphp_array_items(PhpArrayObject * self, PyObject * args) {
+	return pyphp_array_collect(self, true, true);
+}
+
+static const char pyphp_array_keys_doc[] = (
+	"Returns the ``list`` of keys."
+);
+
+static PyObject * pyphp_array_keys(PhpArrayObject * self, PyObject * args) {
+	return pyphp_array_collect(self, true, false);
+}
+
+static const char pyphp_array_values_doc[] = (
+	"Returns the ``list`` of values."
+);
+
+static PyObject * pyphp_array_values(PhpArrayObject * self, PyObject * args) {
+	return pyphp_array_collect(self, false, true);
+}
+
+static const char pyphp_array_to_python_doc[] = (
+	"Converts the whole array to Python.\n"
+	"\n"
+	"Returns the ``list`` or ``dict``."
+);
+
+static PyObject * pyphp_array_to_python(PhpArrayObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pyval = NULL; // owned
+	
+	prev = pyphp_enter(self->interp);
+	if (pyphp_array_check(self)) {
+		pyval = zval_to_PyObject(self->zarray, NULL);
+	}
+	pyphp_leave(self->interp, prev);
+	return pyval;
+}
+
+static PyMethodDef PhpArrayType_methods[] = {
+	{"get", (PyCFunction)pyphp_array_get, METH_VARARGS, pyphp_array_get_doc},
+	{"items", (PyCFunction)pyphp_array_items, METH_NOARGS, pyphp_array_items_doc},
+	{"keys", (PyCFunction)pyphp_array_keys, METH_NOARGS, pyphp_array_keys_doc},
+	{"to_python", (PyCFunction)pyphp_array_to_python, METH_NOARGS, pyphp_array_to_python_doc},
+	{"values", (PyCFunction)pyphp_array_values, METH_NOARGS, pyphp_array_values_doc},
+	{NULL, NULL, 0, NULL}
+};
+
+static PyMemberDef PhpArrayType_members[] = {
+	{"interpreter", T_OBJECT, offsetof(PhpArrayObject, interp), READONLY, "The interpreter (``Interpreter``) the array belongs to."},
+	{NULL, 0, 0, 0, NULL}
+};
+
+static PyMappingMethods PhpArrayType_as_mapping = {
+	(lenfunc)pyphp_array_length, // mp_length
+	(binaryfunc)pyphp_array_subscript, // mp_subscript
+	0, // mp_ass_subscript
+};
+
+static PySequenceMethods PhpArrayType_as_sequence = {
+	(lenfunc)pyphp_array_length, // sq_length
+	0, // sq_concat
+	0, // sq_repeat
+	0, // sq_item
+	0, // sq_slice
+	0, // sq_ass_item
+	0, // sq_ass_slice
+	(objobjproc)pyphp_array_contains, // sq_contains
+};
+
+static PyTypeObject PhpArrayType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"cpyphp.PhpArray", // tp_name
+	sizeof(PhpArrayObject), // tp_basicsize
+	0, // tp_itemsize
+	(destructor)pyphp_array_dealloc, // tp_dealloc
+	0, // tp_print
+	0, // tp_getattr
+	0, // tp_setattr
+	0, // tp_compare
+	0, // tp_repr
+	0, // tp_as_number
+	&PhpArrayType_as_sequence, // tp_as_sequence
+	&PhpArrayType_as_mapping, // tp_as_mapping
+	0, // tp_hash
+	0, // tp_call
+	0, // tp_str
+	0, // tp_getattro
+	0, // tp_setattro
+	0, // tp_as_buffer
+	Py_TPFLAGS_DEFAULT, // tp_flags
+	PhpArrayType_doc, // tp_doc
+	0, // tp_traverse
+	0, // tp_clear
+	0, // tp_richcompare
+	0, // tp_weaklistoffset
+	(getiterfunc)pyphp_array_iter, // tp_iter
+	0, // tp_iternext
+	PhpArrayType_methods, // tp_methods
+	PhpArrayType_members, // tp_members
+};
+
+static const char PhpBytesType_doc[] = (
+	"The ``PhpBytes`` class is a read-only view of a PHP string returned by\n"
+	"``global_get_bytes()``. It exposes the bytes of the string through the\n"
+	"buffer protocol without copying them so it can be passed to\n"
+	"``memoryview``, ``socket.send()``, ``file.write()``, etc. Use ``str()``\n"
+	"to copy the bytes into a Python string.\n"
+	"\n"
+	".. NOTE: The view keeps a reference to the PHP string. It is only valid\n"
+	"   for the PHP request it was created in. Accessing the view after that\n"
+	"   request has ended raises an ``InternalError``. While buffers obtained\n"
+	"   from it (e.g., a ``memoryview``) are alive, the request cannot end:\n"
+	"   executing PHP outside of a persistent request, ``end_request()``,\n"
+	"   ``reset()`` and ``shutdown()`` raise a ``BufferError`` until the\n"
+	"   buffers are released."
+);
+
+typedef struct {
+	PyObject_HEAD
+	
+	// The interpreter (``Interpreter``) the string belongs to.
+	PyObject * interp;
+	
+	// The php string.
+	// .. NOTE: This is only valid while *request_id* is the current request.
+	zval * zstr;
+	unsigned long request_id;
+} PhpBytesObject;
+
+static PyTypeObject PhpBytesType;
+
+/**
+Creates a view of the specified PHP string for the current interpreter.
+
+*pyinterp* (``PyObject *``) is the interpreter.
+
+*zstr* (``zval *``) is the PHP string. A reference to it is added.
+
+Returns the new view (``PyObject *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * pyphp_bytes_wrap(PyObject * pyinterp, zval * zstr) {
+	PhpBytesObject * self = NULL; // owned
+	
+	self = PyObject_New(PhpBytesObject, &PhpBytesType);
+	if (self == NULL) {
+		return NULL;
+	}
+	if (Z_ISREF_P(zstr)) {
+		// PHP modifies references in place which could reallocate the string
+		// under the view so the string must be copied.
+		zstr = zval_from_string(Z_STRVAL_P(zstr), Z_STRLEN_P(zstr));
+		if (zstr == NULL) {
+			PyErr_Format(InternalErrorType, "Failed to copy PHP string.");
+			self->zstr = NULL;
+			self->interp = NULL;
+			Py_DECREF(self);
+			return NULL;
+		}
+	} else {
+		Z_ADDREF_P(zstr);
+	}
+	Py_INCREF(pyinterp);
+	self->interp = pyinterp;
+	self->zstr = zstr;
+	self->request_id = pyphp_interp->request_id;
+	return (PyObject *)self;
+}
+
+/**
+Checks whether the specified view is still valid.
+
+*self* (``PhpBytesObject *``) is the view.
+
+Returns ``true`` if it is valid; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool pyphp_bytes_check(PhpBytesObject * self) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	bool result = false;
+	
+	prev = pyphp_enter(self->interp);
+	result = pyphp_interp->is_started && self->request_id == pyphp_interp->request_id;
+	pyphp_leave(self->interp, prev);
+	if (!result) {
+		PyErr_SetString(InternalErrorType, "PHP string is no longer valid because its request has ended.");
+	}
+	return result;
+}
+
+static void pyphp_bytes_dealloc(PhpBytesObject * self) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	
+	// Release the php string if its request is still active.
+	if (self->zstr != NULL) {
+		prev = pyphp_enter(self->interp);
+		if (pyphp_interp->is_started && self->request_id == pyphp_interp->request_id) {
+			zval_del(&self->zstr);
+		}
+		pyphp_leave(self->interp, prev);
+	}
+	self->zstr = NULL;
+	Py_XDECREF(self->interp);
+	PyObject_Del(self);
+}
+
+static Py_ssize_t pyphp_bytes_length(PhpBytesObject * self) {
+	if (!pyphp_bytes_check(self)) {
+		return -1;
+	}
+	return (Py_ssize_t)Z_STRLEN_P(self->zstr);
+}
+
+static PyObject * pyphp_bytes_str(PhpBytesObject * self) {
+	if (!pyphp_bytes_check(self)) {
+		return NULL;
+	}
+	return PyString_FromStringAndSize(Z_STRVAL_P(self->zstr), (Py_ssize_t)Z_STRLEN_P(self->zstr));
+}
+
+static Py_ssize_t pyphp_bytes_getreadbuffer(PhpBytesObject * self, Py_ssize_t segment, void ** ptr) {
+	if (segment != 0) {
+		PyErr_SetString(PyExc_SystemError, "Accessing non-existent PHP string segment.");
+		return -1;
+	}
+	if (!pyphp_bytes_check(self)) {
+		return -1;
+	}
+	*ptr = Z_STRVAL_P(self->zstr);
+	return (Py_ssize_t)Z_STRLEN_P(self->zstr);
+}
+
+static Py_ssize_t pyphp_bytes_getsegcount(PhpBytesObject * self, Py_ssize_t * lenp) {
+	// .. NOTE: No segments are reported once the request has ended so that
+	//    the string is not accessed.
+	if (!pyphp_bytes_check(self)) {
+		if (lenp != NULL) {
+			*lenp = 0;
+		}
+		return 0;
+	}
+	if (lenp != NULL) {
+		*lenp = (Py_ssize_t)Z_STRLEN_P(self->zstr);
+	}
+	return 1;
+}
+
+static int pyphp_bytes_getbuffer(PhpBytesObject * self, Py_buffer * view, int flags) {
+	if (!pyphp_bytes_check(self)) {
+		return -1;
+	}
+	if (PyBuffer_FillInfo(view, (PyObject *)self, Z_STRVAL_P(self->zstr), (Py_ssize_t)Z_STRLEN_P(self->zstr), 1, flags) != 0) {
+		return -1;
+	}
+	
+	// Count the exported buffer so that the request is not ended while it
+	// points into the request's memory (see ``pyphp_php_request_can_end()``).
+	((InterpreterObject *)self->interp)->interp->bytes_exports += 1;
+	return 0;
+}
+
+static void pyphp_bytes_releasebuffer(PhpBytesObject * self, Py_buffer * view) {
+	((InterpreterObject *)self->interp)->interp->bytes_exports -= 1;
+}
+
+static PySequenceMethods PhpBytesType_as_sequence = {
+	(lenfunc)pyphp_bytes_length, // sq_length
+};
+
+static PyBufferProcs PhpBytesType_as_buffer = {
+	(readbufferproc)pyphp_bytes_getreadbuffer, // bf_getreadbuffer
+	0, // bf_getwritebuffer
+	(segcountproc)pyphp_bytes_getsegcount, // bf_getsegcount
+	(charbufferproc)pyphp_bytes_getreadbuffer, // bf_getcharbuffer
+	(getbufferproc)pyphp_bytes_getbuffer, // bf_getbuffer
+	(releasebufferproc)pyphp_bytes_releasebuffer, // bf_releasebuffer
+};
+
+static PyMemberDef PhpBytesType_members[] = {
+	{"interpreter", T_OBJECT, offsetof(PhpBytesObject, interp), READONLY, "The interpreter (``Interpreter``) the string belongs to."},
+	{NULL, 0, 0, 0, NULL}
+};
+
+static PyTypeObject PhpBytesType = {
+	PyVarObject_HEAD_INIT(NULL, 0)
+	"cpyphp.PhpBytes", // tp_name
+	sizeof(PhpBytesObject), // tp_basicsize
+	0, // tp_itemsize
+	(destructor)pyphp_bytes_dealloc, // tp_dealloc
+	0, // tp_print
+	0, // tp_getattr
+	0, // tp_setattr
+	0, // tp_compare
+	0, // tp_repr
+	0, // tp_as_number
+	&PhpBytesType_as_sequence, // tp_as_sequence
+	0, // tp_as_mapping
+	0, // tp_hash
+	0, // tp_call
+	(reprfunc)pyphp_bytes_str, // tp_str
+	0, // tp_getattro
+	0, // tp_setattro
+	&PhpBytesType_as_buffer, // tp_as_buffer
+	Py_TPFLAGS_DEFAULT | Py_TPFLAGS_HAVE_NEWBUFFER, // tp_flags
+	PhpBytesType_doc, // tp_doc
+	0, // tp_traverse
+	0, // tp_clear
+	0, // tp_richcompare
+	0, // tp_weaklistoffset
+	0, // tp_iter
+	0, // tp_iternext
+	0, // tp_methods
+	PhpBytesType_members, // tp_members
+};
+
+
+
+/****************************** Module Methods ******************************/
+
+static const char pyphp_exec_file_doc[] = (
+	"Executes the specified PHP script.\n"
+	"\n"
+	"*file* (**string**) is the name of the file to execute.\n"
+	"\n"
+	".. NOTE: If *file* is ``unicode``, it will be encoded using the result\n"
+	"   from ``sys.getfilesystemencoding()``. If an encoding other than that\n"
+	"   is required, encode *file* to a binary ``str`` prior to sending it to\n"
+	"   this method.\n"
+	"\n"
+	"*json* (``bool``) is whether the value returned by the script should be\n"
+	"encoded as a JSON ``str`` (``True``), or converted to a Python value\n"
+	"(``False``). Default is ``False``.\n"
+	"\n"
+	"*track_changes* (``bool``) is whether the global variables added or\n"
+	"changed by the script should also be returned (``True``), or not\n"
+	"(``False``). Only the changed variables are converted. Default is\n"
+	"``False``.\n"
+	"\n"
+	".. NOTE: Only a shallow snapshot of each variable is compared, so\n"
+	"   elements changed in an array without changing its element count, and\n"
+	"   properties changed on an object, are not tracked. Removed variables\n"
+	"   are not returned.\n"
+	"\n"
+	".. NOTE: PHP is restarted after the script is executed unless a\n"
+	"   persistent request is active (see ``begin_request()``).\n"
+	"\n"
+	"Returns the value (**mixed**) returned by the script, or ``None``. If\n"
+	"*track_changes* is ``True``, returns a ``tuple`` of the value and the\n"
+	"``dict`` of the changed global variables mapped by name."
+);
+
+static PyObject * pyphp_exec_file(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pyfile = NULL; // borrowed
+	PyObject * pypath = NULL; // owned
+	PyObject * pyresult = NULL; // owned
+	zend_file_handle zfile;
+	bool is_open = false;
+	bool result = false;
+	int json = 0;
+	int track_changes = 0;
+	PyObject * pychanges = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "O|ii:pyphp.exec_file", &pyfile, &json, &track_changes)) {
+		return NULL;
+	}
+	if (PyString_Check(pyfile)) {
+		Py_INCREF(pyfile);
+		pypath = pyfile;
+	} else if (PyUnicode_Check(pyfile)) {
+		pypath = PyUnicode_AsEncodedString(pyfile, Py_FileSystemDefaultEncoding, "strict");
+		if (pypath == NULL) {
+			return NULL;
+		}
+	} else {
+		PyErr_Format(PyExc_TypeError, "file:%s is not a string.", Py_TYPE(pyfile)->tp_name);
+		return NULL;
+	}
+	
+	#ifdef HAVE_MMAP
+	// Map the script into memory so that it does not need to be read.
+	Py_BEGIN_ALLOW_THREADS
+	is_open = pyphp_php_file_handle_map(PyString_AS_STRING(pypath), &zfile);
+	Py_END_ALLOW_THREADS
+	#endif
+	
+	if (!is_open) {
+		// Open the script to be read through a file pointer.
+		FILE * fp = NULL; // owned
+		
+		#ifdef MS_WINDOWS
+		if (PyUnicode_Check(pyfile)) {
+			// Require windows to have PY_UNICODE defined as wchar_t.
+			// - http://mail.python.org/pipermail/python-dev/2004-October/049277.html
+			# ifdef HAVE_USABLE_WCHAR_T
+			Py_BEGIN_ALLOW_THREADS
+			fp = _wfopen(PyUnicode_AS_UNICODE(pyfile), L"rb");
+			Py_END_ALLOW_THREADS
+			# else
+			#  error "Py_UNICODE must be wchar_t on Windows."
+			# endif
+		} else
+		#endif
+		{
+			Py_BEGIN_ALLOW_THREADS
+			fp = fopen(PyString_AS_STRING(pypath), "rb");
+			Py_END_ALLOW_THREADS
+		}
+		if (fp == NULL) {
+			PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, pyfile);
+			Py_DECREF(pypath);
+			return NULL;
+		}
+		
+		// Setup zend file handle.
+		zfile.type = ZEND_HANDLE_FP;
+		zfile.filename = PyString_AS_STRING(pypath);
+		zfile.opened_path = NULL;
+		zfile.handle.fp = fp;
+		zfile.free_filename = 0;
+	}
+	
+	// Execute file.
+	// .. NOTE: The file handle is stolen.
+	prev = pyphp_enter(self);
+	result = pyphp_php_exec_begin();
+	if (result) {
+		result = pyphp_php_exec_file(&zfile, (bool)json, track_changes ? &pychanges : NULL, &pyresult);
+	} else {
+		pyphp_php_file_handle_close(&zfile);
+	}
+	pyphp_leave(self, prev);
+	Py_DECREF(pypath);
+	if (!result) {
+		return NULL;
+	}
+	
+	if (track_changes) {
+		// Return the value along with the changed globals.
+		return Py_BuildValue("(NN)", pyresult, pychanges);
+	}
+	return pyresult;
+}
+
+static const char pyphp_exec_inline_doc[] = (
+	"Executes the specified PHP inline string/script.\n"
+	"\n"
+	"*string* (``str``) is the string to execute.\n"
+	"\n"
+	"*name* (``str``) optionally is the name to use in the case of an error.\n"
+	"\n"
+	"*json* (``bool``) is whether the value returned by the string should be\n"
+	"encoded as a JSON ``str`` (``True``), or converted to a Python value\n"
+	"(``False``). Default is ``False``.\n"
+	"\n"
+	"*track_changes* (``bool``) is whether the global variables added or\n"
+	"changed by the string should also be returned (``True``), or not\n"
+	"(``False``). Only the changed variables are converted. Default is\n"
+	"``False``.\n"
+	"\n"
+	".. NOTE: Only a shallow snapshot of each variable is compared, so\n"
+	"   elements changed in an array without changing its element count, and\n"
+	"   properties changed on an object, are not tracked. Removed variables\n"
+	"   are not returned.\n"
+	"\n"
+	".. NOTE: PHP is restarted after the string is executed unless a\n"
+	"   persistent request is active (see ``begin_request()``).\n"
+	"\n"
+	"Returns the value (**mixed**) returned by the string, or ``None``. If\n"
+	"*track_changes* is ``True``, returns a ``tuple`` of the value and the\n"
+	"``dict`` of the changed global variables mapped by name."
+);
+
+static PyObject * pyphp_exec_inline(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	const char * str = NULL;
+	const char * name = NULL;
+	Py_ssize_t str_len = 0;
+	PyObject * pyresult = NULL; // owned
+	bool result = false;
+	int json = 0;
+	int track_changes = 0;
+	PyObject * pychanges = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "s#|zii:pyphp.exec_inline", &str, &str_len, &name, &json, &track_changes)) {
+		return NULL;
+	}
+	if (str_len < 0 || INT_MAX < str_len) {
+		PyErr_Format(PyExc_ValueError, "string length:%" PY_Z "i must be between 0 and %i inclusive.", str_len, INT_MAX);
+		return NULL;
+	}
+	
+	// Execute string.
+	// .. NOTE: A pending restart is retried before the string is compiled
+	//    because the restart releases the request memory.
+	prev = pyphp_enter(self);
+	result = pyphp_php_exec_begin();
+	if (result) {
+		result = pyphp_php_exec_inline(name, str, (int)str_len, (bool)json, track_changes ? &pychanges : NULL, &pyresult);
+	}
+	pyphp_leave(self, prev);
+	if (!result) {
+		return NULL;
+	}
+	
+	if (track_changes) {
+		// Return the value along with the changed globals.
+		return Py_BuildValue("(NN)", pyresult, pychanges);
+	}
+	return pyresult;
+}
+
+static const char pyphp_call_function_doc[] = (
+	"Calls the specified PHP function.\n"
+	"\n"
+	"*name* (``str``) is the name of the function. This can also be a static\n"
+	"method (e.g., ``\"Class::method\"``).\n"
+	"\n"
+	"*args* (**mixed**) are the arguments to pass to the function.\n"
+	"\n"
+	".. NOTE: Resolved functions are cached for the rest of the PHP request.\n"
+	"\n"
+	".. NOTE: PHP is restarted after the function is called unless a\n"
+	"   persistent request is active (see ``begin_request()``).\n"
+	"\n"
+	"Returns the value (**mixed**) returned by the function."
+);
+
+static PyObject * pyphp_call_function(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	PyObject * pyname = NULL; // borrowed
+	PyObject * pyresult = NULL; // owned
+	Py_ssize_t namelen = 0;
+	Py_ssize_t pyargc = 0;
+	Py_ssize_t i;
+	zval ** zargs = NULL; // owned
+	int zargc = 0;
+	bool result = false;
+	
+	pyargc = PyTuple_GET_SIZE(args);
+	if (pyargc < 1) {
+		PyErr_SetString(PyExc_TypeError, "pyphp.call_function() takes at least 1 argument (0 given).");
+		return NULL;
+	}
+	pyname = PyTuple_GET_ITEM(args, 0);
+	if (!PyString_Check(pyname)) {
+		PyErr_Format(PyExc_TypeError, "name:%s is not a string.", Py_TYPE(pyname)->tp_name);
+		return NULL;
+	}
+	namelen = PyString_GET_SIZE(pyname);
+	if (namelen < 0 || INT_MAX < namelen) {
+		PyErr_Format(PyExc_ValueError, "name length:%" PY_Z "i must be between 0 and %i inclusive.", namelen, INT_MAX);
+		return NULL;
+	}
+	if (INT_MAX < pyargc - 1) {
+		PyErr_Format(PyExc_ValueError, "argument count:%" PY_Z "i must be between 0 and %i inclusive.", pyargc - 1, INT_MAX);
+		return NULL;
+	}
+	
+	prev = pyphp_enter(self);
+	
+	// Make sure PyPHP has been started.
+	if (!pyphp_interp->is_started) {
+		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
+		goto call_error; // Clean up.
+	}
+	
+	// Retry a pending restart before the arguments are converted because the
+	// restart releases the request memory.
+	if (!pyphp_php_exec_begin()) {
+		goto call_error; // Clean up.
+	}
+	
+	// Convert python arguments to php values.
+	if (pyargc > 1) {
+		zargs = PyMem_New(zval *, (size_t)(pyargc - 1));
+		if (zargs == NULL) {
+			PyErr_NoMemory();
+			goto call_error; // Clean up.
+		}
+		for (i = 1; i < pyargc; ++i) {
+			zargs[zargc] = PyObject_to_zval(PyTuple_GET_ITEM(args, i), NULL);
+			if (zargs[zargc] == NULL) {
+				goto call_error; // Clean up.
+			}
+			++zargc;
+		}
+	}
+	
+	// Call function.
+	// .. NOTE: The php arguments are stolen.
+	result = pyphp_php_call_function(PyString_AS_STRING(pyname), (int)namelen, zargs, zargc, &pyresult);
+	pyphp_leave(self, prev);
+	PyMem_Free(zargs);
+	if (!result) {
+		return NULL;
+	}
+	
+	return pyresult;
+	
+	// Failed to convert arguments.
+	call_error: {
+		while (zargc > 0) {
+			zval_del(&zargs[--zargc]);
+		}
+		pyphp_leave(self, prev);
+		PyMem_Free(zargs);
+	}
+	return NULL;
+}
+
+static const char pyphp_compile_doc[] = (
+	"Compiles the specified PHP inline string/script so that it can be\n"
+	"executed repeatedly without being recompiled.\n"
+	"\n"
+	"*string* (``str``) is the string to compile.\n"
+	"\n"
+	"*name* (``str``) optionally is the name to use in the case of an error.\n"
+	"\n"
+	"Returns the compiled script (``CompiledScript``)."
+);
+
+static PyObject * pyphp_compile(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	const char * str = NULL;
+	const char * name = NULL;
+	Py_ssize_t str_len = 0;
+	CompiledScriptObject * pyscript = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "s#|z:pyphp.compile", &str, &str_len, &name)) {
+		return NULL;
+	}
+	if (str_len < 0 || INT_MAX < str_len) {
+		PyErr_Format(PyExc_ValueError, "string length:%" PY_Z "i must be between 0 and %i inclusive.", str_len, INT_MAX);
+		return NULL;
+	}
+	
+	// Create compiled script.
+	pyscript = PyObject_New(CompiledScriptObject, &CompiledScriptType);
+	if (pyscript == NULL) {
+		return NULL;
+	}
+	pyscript->op_array = NULL;
+	pyscript->request_id = 0;
+	pyscript->name = NULL;
+	Py_INCREF(self);
+	pyscript->interp = self;
+	pyscript->source = PyString_FromStringAndSize(str, str_len);
+	if (pyscript->source == NULL) {
+		goto compile_error;
+	}
+	if (name != NULL) {
+		pyscript->name = PyString_FromString(name);
+		if (pyscript->name == NULL) {
+			goto compile_error;
+		}
+	} else {
+		Py_INCREF(Py_None);
+		pyscript->name = Py_None;
+	}
+	
+	// Compile string.
+	prev = pyphp_enter(self);
+	if (!pyphp_compiled_script_compile(pyscript)) {
+		pyphp_leave(self, prev);
+		goto compile_error;
+	}
+	pyphp_leave(self, prev);
+	
+	return (PyObject *)pyscript;
+	
+	compile_error: {
+		Py_DECREF(pyscript);
+	}
+	return NULL;
+}
+
+static const char pyphp_begin_request_doc[] = (
+	"Begins a persistent PHP request. Until the matching call to\n"
+	"``end_request()``, PHP is not restarted after each execution so that\n"
+	"functions, classes and globals defined by one execution are available\n"
+	"to the next. Persistent requests can be nested.\n"
+	"\n"
+	".. NOTE: If PHP bails out of an execution (e.g., a fatal error or\n"
+	"   ``exit()``), PHP is still restarted.\n"
+	"\n"
+	".. NOTE: Compiled scripts are not cached across restarts. To avoid\n"
+	"   recompiling the same scripts, include them with ``require_once``, or\n"
+	"   reuse a ``CompiledScript`` (see ``compile()``), within one persistent\n"
+	"   request."
+);
+
+static PyObject * pyphp_begin_request(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	bool result = false;
+	
+	prev = pyphp_enter(self);
+	result = pyphp_php_begin_request();
+	pyphp_leave(self, prev);
+	if (!result) {
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static const char pyphp_end_request_doc[] = (
+	"Ends a persistent PHP request begun with ``begin_request()``. When the\n"
+	"outermost persistent request ends, PHP is restarted."
+);
+
+static PyObject * pyphp_end_request(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	bool result = false;
+	
+	prev = pyphp_enter(self);
+	result = pyphp_php_end_request();
+	pyphp_leave(self, prev);
+	if (!result) {
+		return NULL;
+	}
+	Py_RETURN_NONE;
+}
+
+static const char pyphp_intern_set_size_doc[] = (
+	"Sets the maximum number of strings to intern across conversions from PHP\n"
+	"to Python.\n"
+	"\n"
+	"Array keys and short string values are always shared within a single\n"
+	"conversion (e.g., the repeated column names of a list of records). When\n"
+	"the size is greater than 0, they are also shared between conversions\n"
+	"until the size is reached (e.g., by ``PhpArray`` elements and repeated\n"
+	"``global_get()`` calls).\n"
+	"\n"
+	"*size* (``int``) is the maximum number of strings. Set to 0 to only\n"
+	"intern strings within a conversion. Default is 0.\n"
+	"\n"
+	".. NOTE: Setting the size releases the strings already interned."
+);
+
+static PyObject * pyphp_intern_set_size(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	long size = 0;
+	
+	if (!PyArg_ParseTuple(args, "l:pyphp.intern_set_size", &size)) {
+		return NULL;
+	}
+	if (size < 0) {
+		PyErr_Format(PyExc_ValueError, "size:%li must be at least 0.", size);
+		return NULL;
+	}
+	
+	// Set intern table size.
+	prev = pyphp_enter(self);
+	intern_clear(&pyphp_interp->interns);
+	pyphp_interp->interns.max = (size_t)size;
+	pyphp_leave(self, prev);
+	
+	Py_RETURN_NONE;
+}
+
+static const char pyphp_max_depth_set_doc[] = (
+	"Sets the maximum nesting depth of the lists, tuples, dicts and arrays\n"
+	"converted between Python and PHP. Converting a value nested deeper raises\n"
+	"a ``ValueError``.\n"
+	"\n"
+	"*depth* (``int``) is the maximum nesting depth. Set to 0 for no limit.\n"
+	"Default is 100000.\n"
+	"\n"
+	".. NOTE: Values are converted without recursion so the depth is only\n"
+	"   limited by memory."
+);
+
+static PyObject * pyphp_max_depth_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	long depth = 0;
+	
+	if (!PyArg_ParseTuple(args, "l:pyphp.set_max_depth", &depth)) {
+		return NULL;
+	}
+	if (depth < 0) {
+		PyErr_Format(PyExc_ValueError, "depth:%li must be at least 0.", depth);
+		return NULL;
+	}
+	
+	// Set maximum depth.
+	prev = pyphp_enter(self);
+	pyphp_interp->max_depth = (unsigned long)depth;
+	pyphp_leave(self, prev);
+	
+	Py_RETURN_NONE;
+}
+
+static const char pyphp_php_serialize_doc[] = (
+	"Serializes the Python value in the format of PHP's ``serialize()``\n"
+	"without PHP. The value is converted the same way as it is by\n"
+	"``global_set()``.\n"
+	"\n"
+	"*value* (``object``) is the value to serialize.\n"
+	"\n"
+	"Returns the serialized value (``str``)."
+);
+
+static PyObject * pyphp_php_serialize(PyObject * self, PyObject * args) {
+	PyObject * pyobj = NULL; // borrowed
+	
+	if (!PyArg_ParseTuple(args, "O:pyphp.php_serialize", &pyobj)) {
+		return NULL;
+	}
+	
+	// .. NOTE: The interpreter is not entered because PHP is not used.
+	return serialize_to_string(pyobj, ((InterpreterObject *)self)->interp->max_depth);
+}
+
+static const char pyphp_php_unserialize_doc[] = (
+	"Unserializes the Python value from the format of PHP's ``serialize()``\n"
+	"without PHP. PHP arrays become lists when their keys are exactly the\n"
+	"indices 0 through n-1; otherwise, dicts. PHP objects become dicts of\n"
+	"their public properties.\n"
+	"\n"
+	"*data* (``str``) is the serialized value.\n"
+	"\n"
+	"Returns the unserialized value (``object``)."
+);
+
+static PyObject * pyphp_php_unserialize(PyObject * self, PyObject * args) {
+	const char * data = NULL; // borrowed
+	Py_ssize_t datalen = 0;
+	
+	if (!PyArg_ParseTuple(args, "s#:pyphp.php_unserialize", &data, &datalen)) {
+		return NULL;
+	}
+	
+	// .. NOTE: The interpreter is not entered because PHP is not used.
+	return unserialize_from_string(data, datalen, ((InterpreterObject *)self)->interp->max_depth);
+}
+
+static const char pyphp_global_get_doc[] = (
+	"Gets the value of the specified global variable.\n"
+	"\n"
+	"*key* (``str``) is the name of the variable to get.\n"
+	"\n"
+	"*var* (``str``) optionally gets the keyed value from the specified\n"
+	"global variable instead of from the global symbol table. Default is\n"
+	"``None``.\n"
+	"\n"
+	"*lazy* (``bool``) is whether an array should be returned as a\n"
+	"``PhpArray`` view which converts its elements when they are accessed\n"
+	"(``True``), or converted to a ``list`` or ``dict`` (``False``). Default\n"
+	"is ``False``.\n"
+	"\n"
+	"Returns the value (**mixed**) of the global variable."
+);
+
+static PyObject * pyphp_global_get(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	const char * key = NULL; // borrowed
+	const char * var = NULL; // borrowed
+	Py_ssize_t keylen = 0;
+	Py_ssize_t varlen = 0;
+	int lazy = 0;
+	zval * zv = NULL; // borrowed
+	PyObject * pyval = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "s#|z#i:pyphp.global_get", &key, &keylen, &var, &varlen, &lazy)) {
+		return NULL;
+	}
+	if (keylen < 0 || INT_MAX < keylen) {
+		PyErr_Format(PyExc_ValueError, "key length:%" PY_Z "i must be between 0 and %i inclusive.", keylen, INT_MAX);
+		return NULL;
+	}
+	if (varlen < 0 || INT_MAX < varlen) {
+		PyErr_Format(PyExc_ValueError, "var length:%" PY_Z "i must be between 0 and %i inclusive.", varlen, INT_MAX);
+		return NULL;
+	}
+	
+	// Get global.
+	prev = pyphp_enter(self);
+	zv = pyphp_php_global_get(key, (int)keylen, var, (int)varlen);
+	if (zv != NULL) {
+		if (lazy && Z_TYPE_P(zv) == IS_ARRAY) {
+			// Wrap php array in a lazy view.
+			pyval = pyphp_array_wrap(self, zv);
+		} else {
+			// Convert php value to python value.
+			pyval = zval_to_PyObject(zv, NULL);
+		}
+	}
+	pyphp_leave(self, prev);
+	
+	return pyval;
+}
+
+/**
+Gets the name of a global variable got or set in a batch.
+
+*pykey* (``PyObject *``) is the name of the variable. If this is ``unicode``,
+it is encoded as UTF-8.
+
+*global* (``struct pyphp_global_t *``) will be set to the name.
+
+Returns the new reference to the string (``PyObject *``) which holds the name
+of *global*.
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * pyphp_global_key(PyObject * pykey, struct pyphp_global_t * global) {
+	PyObject * pystr = NULL; // owned
+	
+	if (PyString_Check(pykey)) {
+		Py_INCREF(pykey);
+		pystr = pykey;
+	} else if (PyUnicode_Check(pykey)) {
+		pystr = PyUnicode_AsUTF8String(pykey);
+		if (pystr == NULL) {
+			return NULL;
+		}
+	} else {
+		PyErr_Format(PyExc_TypeError, "key:%s is not a string.", Py_TYPE(pykey)->tp_name);
+		return NULL;
+	}
+	if (INT_MAX < PyString_GET_SIZE(pystr)) {
+		PyErr_Format(PyExc_ValueError, "key length:%" PY_Z "i must be between 0 and %i inclusive.", PyString_GET_SIZE(pystr), INT_MAX);
+		Py_DECREF(pystr);
+		return NULL;
+	}
+	global->key = PyString_AS_STRING(pystr);
+	global->keylen = (int)PyString_GET_SIZE(pystr);
+	global->zv = NULL;
+	return pystr;
+}
+
+/**
+Gets the keys of a path through nested global arrays.
+
+*pypath* (**sequence**) is the keys (``int``, ``long``, ``str`` or
+``unicode``) of the path. If a key is ``unicode``, it is encoded as UTF-8.
+
+*count* (``Py_ssize_t *``) will be set to the number of keys.
+
+*pykeep* (``PyObject **``) will be set to the new reference to the list which
+holds the string keys of the path. This must be released after the path is
+no longer used.
+
+Returns the keys (``struct pyphp_path_key_t *``). This must be freed with
+``PyMem_Free()``.
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static struct pyphp_path_key_t * pyphp_path_keys(PyObject * pypath, Py_ssize_t * count, PyObject ** pykeep) {
+	struct pyphp_path_key_t * path = NULL; // owned
+	PyObject * pyfast = NULL; // owned
+	PyObject * pykey = NULL; // borrowed
+	PyObject * pystr = NULL; // owned
+	Py_ssize_t i = 0;
+	
+	*pykeep = NULL;
+	pyfast = PySequence_Fast(pypath, "path must be a sequence.");
+	if (pyfast == NULL) {
+		return NULL;
+	}
+	*count = PySequence_Fast_GET_SIZE(pyfast);
+	if (*count == 0) {
+		PyErr_SetString(PyExc_ValueError, "path must not be empty.");
+		goto path_error; // Clean up.
+	}
+	path = PyMem_New(struct pyphp_path_key_t, *count);
+	if (path == NULL) {
+		PyErr_NoMemory();
+		goto path_error; // Clean up.
+	}
+	*pykeep = PyList_New(*count);
+	if (*pykeep == NULL) {
+		goto path_error; // Clean up.
+	}
+	for (i = 0; i < *count; ++i) {
+		pykey = PySequence_Fast_GET_ITEM(pyfast, i);
+		if (PyInt_Check(pykey) || PyLong_Check(pykey)) {
+			path[i].key = NULL;
+			path[i].keylen = 0;
+			path[i].index = PyInt_AsLong(pykey);
+			if (path[i].index == -1 && PyErr_Occurred() != NULL) {
+				goto path_error; // Clean up.
+			}
+			Py_INCREF(pykey);
+			pystr = pykey;
+		} else if (PyString_Check(pykey) || PyUnicode_Check(pykey)) {
+			if (PyUnicode_Check(pykey)) {
+				pystr = PyUnicode_AsUTF8String(pykey);
+				if (pystr == NULL) {
+					goto path_error; // Clean up.
+				}
+			} else {
+				Py_INCREF(pykey);
+				pystr = pykey;
+			}
+			if (INT_MAX < PyString_GET_SIZE(pystr)) {
+				PyErr_Format(PyExc_ValueError, "path key:%" PY_Z "i length:%" PY_Z "i must be between 0 and %i inclusive.", i, PyString_GET_SIZE(pystr), INT_MAX);
+				Py_DECREF(pystr);
+				goto path_error; // Clean up.
+			}
+			path[i].key = PyString_AS_STRING(pystr);
+			path[i].keylen = (int)PyString_GET_SIZE(pystr);
+			path[i].index = 0;
+		} else {
+			PyErr_Format(PyExc_TypeError, "PHP array key cannot be type:%s.", Py_TYPE(pykey)->tp_name);
+			goto path_error; // Clean up.
+		}
+		PyList_SET_ITEM(*pykeep, i, pystr); // Steals reference.
+	}
+	Py_DECREF(pyfast);
+	return path;
+	
+	// Failed to get path keys.
+	path_error: {
+		if (path != NULL) {
+			PyMem_Free(path);
+		}
+		Py_CLEAR(*pykeep);
+		Py_DECREF(pyfast);
+	}
+	return NULL;
+}
+
+static const char pyphp_global_get_many_doc[] = (
+	"Gets the values of the specified global variables.\n"
+	"\n"
+	"*keys* (**sequence** or ``dict``) is the names (``str``) of the\n"
+	"variables to get. If this is a ``dict``, its values are the defaults\n"
+	"for the variables which are not set.\n"
+	"\n"
+	"*var* (``str``) optionally gets the keyed values from the specified\n"
+	"global variable instead of from the global symbol table. Default is\n"
+	"``None``.\n"
+	"\n"
+	".. NOTE: The values are converted together so arrays shared between\n"
+	"   them are converted once.\n"
+	"\n"
+	"Returns the values (``dict``) of the global variables mapped by name."
+);
+
+static PyObject * pyphp_global_get_many(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	struct pyphp_conv_t conv;
+	struct pyphp_global_t * globals = NULL; // owned
+	const char * var = NULL; // borrowed
+	Py_ssize_t varlen = 0;
+	Py_ssize_t count = 0;
+	Py_ssize_t i = 0;
+	bool result = false;
+	PyObject * pykeys = NULL; // borrowed
+	PyObject * pydefaults = NULL; // borrowed
+	PyObject * pyfast = NULL; // owned
+	PyObject * pystrs = NULL; // owned
+	PyObject * pystr = NULL; // owned
+	PyObject * pykey = NULL; // borrowed
+	PyObject * pyval = NULL; // owned
+	PyObject * pyresult = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "O|z#:pyphp.global_get_many", &pykeys, &var, &varlen)) {
+		return NULL;
+	}
+	if (varlen < 0 || INT_MAX < varlen) {
+		PyErr_Format(PyExc_ValueError, "var length:%" PY_Z "i must be between 0 and %i inclusive.", varlen, INT_MAX);
+		return NULL;
+	}
+	
+	// Get names of variables.
+	if (PyDict_Check(pykeys)) {
+		pydefaults = pykeys;
+		pyfast = PyDict_Keys(pykeys);
+	} else {
+		pyfast = PySequence_Fast(pykeys, "keys must be a sequence or dict.");
+	}
+	if (pyfast == NULL) {
+		return NULL;
+	}
+	count = PySequence_Fast_GET_SIZE(pyfast);
+	globals = PyMem_New(struct pyphp_global_t, count > 0 ? count : 1);
+	pystrs = PyList_New(count);
+	pyresult = _PyDict_NewPresized(count);
+	if (globals == NULL || pystrs == NULL || pyresult == NULL) {
+		if (globals == NULL) {
+			PyErr_NoMemory();
+		}
+		goto get_many_error; // Clean up.
+	}
+	for (i = 0; i < count; ++i) {
+		pystr = pyphp_global_key(PySequence_Fast_GET_ITEM(pyfast, i), &globals[i]);
+		if (pystr == NULL) {
+			goto get_many_error; // Clean up.
+		}
+		PyList_SET_ITEM(pystrs, i, pystr); // Steals reference.
+	}
+	
+	// Get globals.
+	prev = pyphp_enter(self);
+	result = pyphp_php_global_get_many(globals, count, var, (int)varlen);
+	if (result) {
+		// Convert php values to python values.
+		pyphp_conv_init(&conv);
+		for (i = 0; result && i < count; ++i) {
+			pykey = PySequence_Fast_GET_ITEM(pyfast, i);
+			if (globals[i].zv != NULL) {
+				pyval = zval_to_PyObject(globals[i].zv, &conv);
+			} else if (pydefaults != NULL) {
+				pyval = PyDict_GetItem(pydefaults, pykey);
+				Py_XINCREF(pyval);
+			} else {
+				PyErr_Format(PyExc_KeyError, "key:%s is not set.", globals[i].key);
+				pyval = NULL;
+			}
+			result = pyval != NULL && PyDict_SetItem(pyresult, pykey, pyval) == 0;
+			Py_XDECREF(pyval);
+		}
+		pyphp_conv_free(&conv);
+	}
+	pyphp_leave(self, prev);
+	if (!result) {
+		goto get_many_error; // Clean up.
+	}
+	
+	// Clean up temporary values.
+	PyMem_Free(globals);
+	Py_DECREF(pystrs);
+	Py_DECREF(pyfast);
+	
+	return pyresult;
+	
+	// Failed to get globals.
+	get_many_error: {
+		if (globals != NULL) {
+			PyMem_Free(globals);
+		}
+		Py_XDECREF(pystrs);
+		Py_XDECREF(pyresult);
+		Py_DECREF(pyfast);
+	}
+	return NULL;
+}
+
+static const char pyphp_global_get_path_doc[] = (
+	"Gets the value at the specified path through nested global arrays\n"
+	"without converting the arrays along the path.\n"
+	"\n"
+	"*path* (**sequence**) is the keys (``int`` or ``str``) of the path. The\n"
+	"first key is the name of the global variable, and each following key is\n"
+	"the key of an element in the array before it (e.g.,\n"
+	"``(\"config\", \"db\", \"host\")`` for ``$config['db']['host']``).\n"
+	"\n"
+	"*lazy* (``bool``) is whether an array should be returned as a\n"
+	"``PhpArray`` view (``True``), or converted to a ``list`` or ``dict``\n"
+	"(``False``). Default is ``False``.\n"
+	"\n"
+	"Returns the value (**mixed**) at the path."
+);
+
+static PyObject * pyphp_global_get_path(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	struct pyphp_path_key_t * path = NULL; // owned
+	Py_ssize_t count = 0;
+	int lazy = 0;
+	zval * zv = NULL; // borrowed
+	PyObject * pypath = NULL; // borrowed
+	PyObject * pykeep = NULL; // owned
+	PyObject * pyval = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "O|i:pyphp.global_get_path", &pypath, &lazy)) {
+		return NULL;
+	}
+	path = pyphp_path_keys(pypath, &count, &pykeep);
+	if (path == NULL) {
+		return NULL;
+	}
+	
+	// Get value.
+	prev = pyphp_enter(self);
+	zv = pyphp_php_global_get_path(path, count);
+	if (zv != NULL) {
+		if (lazy && Z_TYPE_P(zv) == IS_ARRAY) {
+			// Wrap php array in a lazy view.
+			pyval = pyphp_array_wrap(self, zv);
+		} else {
+			// Convert php value to python value.
+			pyval = zval_to_PyObject(zv, NULL);
+		}
+	}
+	pyphp_leave(self, prev);
+	PyMem_Free(path);
+	Py_DECREF(pykeep);
+	
+	return pyval;
+}
+
+static const char pyphp_global_get_bytes_doc[] = (
+	"Gets the value of the specified global string variable without copying\n"
+	"it.\n"
+	"\n"
+	"*key* (``str``) is the name of the variable to get.\n"
+	"\n"
+	"*var* (``str``) optionally gets the keyed value from the specified\n"
+	"global variable instead of from the global symbol table. Default is\n"
+	"``None``.\n"
+	"\n"
+	"Returns the value (``PhpBytes``) of the global variable."
+);
+
+static PyObject * pyphp_global_get_bytes(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	const char * key = NULL; // borrowed
+	const char * var = NULL; // borrowed
+	Py_ssize_t keylen = 0;
+	Py_ssize_t varlen = 0;
+	zval * zv = NULL; // borrowed
+	PyObject * pyval = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "s#|z#:pyphp.global_get_bytes", &key, &keylen, &var, &varlen)) {
 		return NULL;
 	}
-	if (fp == NULL) {
-		PyErr_SetFromErrnoWithFilenameObject(PyExc_IOError, pyfile);
+	if (keylen < 0 || INT_MAX < keylen) {
+		PyErr_Format(PyExc_ValueError, "key length:%" PY_Z "i must be between 0 and %i inclusive.", keylen, INT_MAX);
 		return NULL;
 	}
-	
-	// Execute file.
-	// .. NOTE: The file pointer is stolen.
-	{
-		PyObject * pystr = pyfile_tmp != NULL ? pyfile_tmp : pyfile; // borrowed
-		result = pyphp_php_exec_file(PyString_AS_STRING(pystr), PyString_GET_SIZE(pystr), fp);
-	}
-	Py_XDECREF(pyfile_tmp);
-	if (!result) {
+	if (varlen < 0 || INT_MAX < varlen) {
+		PyErr_Format(PyExc_ValueError, "var length:%" PY_Z "i must be between 0 and %i inclusive.", varlen, INT_MAX);
 		return NULL;
 	}
 	
-	Py_RETURN_NONE;
+	// Get global.
+	prev = pyphp_enter(self);
+	zv = pyphp_php_global_get(key, (int)keylen, var, (int)varlen);
+	if (zv != NULL) {
+		if (Z_TYPE_P(zv) != IS_STRING) {
+			PyErr_SetString(PyExc_TypeError, "key is not a string.");
+		} else {
+			// Wrap php string in a view.
+			pyval = pyphp_bytes_wrap(self, zv);
+		}
+	}
+	pyphp_leave(self, prev);
+	
+	return pyval;
 }
 
-static const char pyphp_exec_inline_doc[] = (
-	"Executes the specified PHP inline string/script.\n"
+static const char pyphp_global_get_array_doc[] = (
+	"Gets the value of the specified global list of numbers as a packed\n"
+	"``array.array``.\n"
 	"\n"
-	"*string* (``str``) is the string to execute.\n"
+	"*key* (``str``) is the name of the variable to get.\n"
 	"\n"
-	"*name* (``str``) optionally is the name to use in the case of an error.\n"
+	"*typecode* (``str``) is the ``array`` module type code of the items\n"
+	"(e.g., ``\"l\"`` or ``\"d\"``). ``\"q\"`` and ``\"Q\"`` are not\n"
+	"supported because ``array.array`` does not support them.\n"
+	"\n"
+	"*var* (``str``) optionally gets the keyed value from the specified\n"
+	"global variable instead of from the global symbol table. Default is\n"
+	"``None``.\n"
+	"\n"
+	"Returns the value (``array.array``) of the global variable."
 );
 
-static PyObject * pyphp_exec_inline(PyObject * self, PyObject * args) {
-	const char * str = NULL;
-	const char * name = NULL;
-	Py_ssize_t str_len = 0;
+static PyObject * pyphp_global_get_array(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	const char * key = NULL; // borrowed
+	const char * typecode = NULL; // borrowed
+	const char * var = NULL; // borrowed
+	const char * error = NULL; // borrowed
+	Py_ssize_t keylen = 0;
+	Py_ssize_t typecodelen = 0;
+	Py_ssize_t varlen = 0;
+	Py_ssize_t buflen = 0;
+	void * buf = NULL; // borrowed
+	zval * zv = NULL; // borrowed
+	PyObject * pyarray = NULL; // owned
+	PyObject * pyitem = NULL; // owned
+	PyObject * pymodule = NULL; // owned
 	
-	if (!PyArg_ParseTuple(args, "s#|z:pyphp.exec_inline", &str, &str_len, &name)) {
+	if (!PyArg_ParseTuple(args, "s#s#|z#:pyphp.global_get_array", &key, &keylen, &typecode, &typecodelen, &var, &varlen)) {
 		return NULL;
 	}
-	if (str_len < 0 || INT_MAX < str_len) {
-		PyErr_Format(PyExc_ValueError, "string length:%" PY_Z "i must be between 0 and %i inclusive.", str_len, INT_MAX);
+	if (keylen < 0 || INT_MAX < keylen) {
+		PyErr_Format(PyExc_ValueError, "key length:%" PY_Z "i must be between 0 and %i inclusive.", keylen, INT_MAX);
 		return NULL;
 	}
-	
-	// Execute string.
-	if (!pyphp_php_exec_inline(name, str, str_len)) {
+	if (typecodelen != 1 || buffer_itemsize(typecode[0]) == 0) {
+		PyErr_Format(PyExc_ValueError, "typecode:%s is not supported.", typecode);
+		return NULL;
+	}
+	if (typecode[0] == 'q' || typecode[0] == 'Q') {
+		// array.array does not support long longs.
+		PyErr_Format(PyExc_ValueError, "typecode:%s is not supported by array.array.", typecode);
+		return NULL;
+	}
+	if (varlen < 0 || INT_MAX < varlen) {
+		PyErr_Format(PyExc_ValueError, "var length:%" PY_Z "i must be between 0 and %i inclusive.", varlen, INT_MAX);
 		return NULL;
 	}
 	
-	Py_RETURN_NONE;
+	// Get global.
+	prev = pyphp_enter(self);
+	zv = pyphp_php_global_get(key, (int)keylen, var, (int)varlen);
+	if (zv == NULL) {
+		goto get_array_error;
+	}
+	if (Z_TYPE_P(zv) != IS_ARRAY) {
+		PyErr_SetString(PyExc_TypeError, "key is not an array.");
+		goto get_array_error;
+	}
+	if (!zval_is_list(zv)) {
+		PyErr_SetString(PyExc_ValueError, "key is not a list.");
+		goto get_array_error;
+	}
+	
+	// Create python array of zeros large enough for all of the items.
+	pymodule = PyImport_ImportModule("array");
+	if (pymodule == NULL) {
+		goto get_array_error;
+	}
+	pyitem = PyObject_CallMethod(pymodule, "array", "s#[i]", typecode, typecodelen, 0);
+	if (pyitem == NULL) {
+		goto get_array_error;
+	}
+	pyarray = PySequence_Repeat(pyitem, (Py_ssize_t)zend_hash_num_elements(Z_ARRVAL_P(zv)));
+	if (pyarray == NULL) {
+		goto get_array_error;
+	}
+	if (PyObject_AsWriteBuffer(pyarray, &buf, &buflen) != 0) {
+		goto get_array_error;
+	}
+	
+	// Store php values in python array.
+	// .. NOTE: The python array is not shared yet so its buffer can be filled
+	//    while the GIL is released.
+	{
+		bool released = pyphp_begin_php();
+		zval_to_buffer(zv, typecode[0], (char *)buf, &error);
+		pyphp_end_php(released);
+	}
+	if (error != NULL) {
+		PyErr_SetString(PyExc_ValueError, error);
+		goto get_array_error;
+	}
+	pyphp_leave(self, prev);
+	
+	Py_DECREF(pyitem);
+	Py_DECREF(pymodule);
+	return pyarray;
+	
+	get_array_error: {
+		pyphp_leave(self, prev);
+		Py_XDECREF(pyarray);
+		Py_XDECREF(pyitem);
+		Py_XDECREF(pymodule);
+	}
+	return NULL;
 }
 
-static const char pyphp_global_get_doc[] = (
-	"Gets the value of the specified global variable.\n"
+static const char pyphp_global_get_json_doc[] = (
+	"Gets the value of the specified global variable encoded as JSON without\n"
+	"converting it to a Python value first.\n"
 	"\n"
 	"*key* (``str``) is the name of the variable to get.\n"
 	"\n"
 	"*var* (``str``) optionally gets the keyed value from the specified\n"
 	"global variable instead of from the global symbol table. Default is\n"
-	"``None``."
+	"``None``.\n"
 	"\n"
-	"Returns the value (**mixed**) of the global variable."
+	".. NOTE: Strings must be UTF-8 encoded. The result is the same as\n"
+	"   ``json.dumps(global_get(key, var), separators=(',', ':'))``.\n"
+	"\n"
+	"Returns the JSON (``str``) of the global variable."
 );
 
-static PyObject * pyphp_global_get(PyObject * self, PyObject * args) {
+static PyObject * pyphp_global_get_json(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	const char * key = NULL; // borrowed
 	const char * var = NULL; // borrowed
 	Py_ssize_t keylen = 0;
 	Py_ssize_t varlen = 0;
 	zval * zv = NULL; // borrowed
+	PyObject * pyjson = NULL; // owned
 	
-	if (!PyArg_ParseTuple(args, "s#|z#:pyphp.global_get", &key, &keylen, &var, &varlen)) {
+	if (!PyArg_ParseTuple(args, "s#|z#:pyphp.global_get_json", &key, &keylen, &var, &varlen)) {
 		return NULL;
 	}
 	if (keylen < 0 || INT_MAX < keylen) {
@@ -1787,13 +6625,15 @@ static PyObject * pyphp_global_get(PyObject * self, PyObject * args) {
 	}
 	
 	// Get global.
+	prev = pyphp_enter(self);
 	zv = pyphp_php_global_get(key, (int)keylen, var, (int)varlen);
-	if (zv == NULL) {
-		return NULL;
+	if (zv != NULL) {
+		// Encode php value as json.
+		pyjson = zval_to_json(zv);
 	}
+	pyphp_leave(self, prev);
 	
-	// Convert php value to python value.
-	return zval_to_PyObject(zv, NULL);
+	return pyjson;
 }
 
 static const char pyphp_global_set_doc[] = (
@@ -1808,6 +6648,7 @@ static const char pyphp_global_set_doc[] = (
 );
 
 static PyObject * pyphp_global_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	const char * key = NULL; // borrowed
 	const char * var = NULL; // borrowed
 	Py_ssize_t keylen = 0;
@@ -1828,8 +6669,260 @@ static PyObject * pyphp_global_set(PyObject * self, PyObject * args) {
 	}
 	
 	// Convert python value to php value.
+	prev = pyphp_enter(self);
+	zv = PyObject_to_zval(pyval, NULL);
+	if (zv == NULL) {
+		pyphp_leave(self, prev);
+		return NULL;
+	}
+	
+	// Set global.
+	// .. NOTE: zv reference is stolen.
+	if (!pyphp_php_global_set(key, (int)keylen, var, (int)varlen, zv)) {
+		// Clean up.
+		zval_del(&zv);
+		pyphp_leave(self, prev);
+		return NULL;
+	}
+	pyphp_leave(self, prev);
+	
+	Py_RETURN_NONE;
+}
+
+static const char pyphp_global_set_many_doc[] = (
+	"Sets the values of the specified global variables.\n"
+	"\n"
+	"*values* (``dict`` or **sequence**) is the values (**mixed**) to set\n"
+	"mapped by the names (``str``) of the variables, or a sequence of\n"
+	"``(name, value)`` pairs.\n"
+	"\n"
+	"*var* (``str``) optionally sets the keyed values in the specified\n"
+	"global variable instead of in the global symbol table. Default is\n"
+	"``None``.\n"
+	"\n"
+	".. NOTE: If any value cannot be converted, no variable is set."
+);
+
+static PyObject * pyphp_global_set_many(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	struct pyphp_global_t * globals = NULL; // owned
+	const char * var = NULL; // borrowed
+	Py_ssize_t varlen = 0;
+	Py_ssize_t count = 0;
+	Py_ssize_t i = 0;
+	bool result = false;
+	PyObject * pyvalues = NULL; // borrowed
+	PyObject * pyfast = NULL; // owned
+	PyObject * pystrs = NULL; // owned
+	PyObject * pystr = NULL; // owned
+	PyObject * pyitem = NULL; // borrowed
+	
+	if (!PyArg_ParseTuple(args, "O|z#:pyphp.global_set_many", &pyvalues, &var, &varlen)) {
+		return NULL;
+	}
+	if (varlen < 0 || INT_MAX < varlen) {
+		PyErr_Format(PyExc_ValueError, "var length:%" PY_Z "i must be between 0 and %i inclusive.", varlen, INT_MAX);
+		return NULL;
+	}
+	
+	// Get names and values of variables.
+	if (PyDict_Check(pyvalues)) {
+		pyfast = PyDict_Items(pyvalues);
+	} else {
+		pyfast = PySequence_Fast(pyvalues, "values must be a dict or sequence.");
+	}
+	if (pyfast == NULL) {
+		return NULL;
+	}
+	count = PySequence_Fast_GET_SIZE(pyfast);
+	globals = PyMem_New(struct pyphp_global_t, count > 0 ? count : 1);
+	pystrs = PyList_New(count);
+	if (globals == NULL || pystrs == NULL) {
+		if (globals == NULL) {
+			PyErr_NoMemory();
+		}
+		goto set_many_error; // Clean up.
+	}
+	for (i = 0; i < count; ++i) {
+		pyitem = PySequence_Fast_GET_ITEM(pyfast, i);
+		if (!PyTuple_Check(pyitem) || PyTuple_GET_SIZE(pyitem) != 2) {
+			PyErr_Format(PyExc_TypeError, "values item:%" PY_Z "i is not a (key, value) pair.", i);
+			goto set_many_error; // Clean up.
+		}
+		pystr = pyphp_global_key(PyTuple_GET_ITEM(pyitem, 0), &globals[i]);
+		if (pystr == NULL) {
+			goto set_many_error; // Clean up.
+		}
+		PyList_SET_ITEM(pystrs, i, pystr); // Steals reference.
+	}
+	
+	// Convert python values to php values, and set globals.
+	// .. NOTE: Each value is converted with its own memo because the
+	//    temporary containers of a value (e.g., from an iterator) are freed
+	//    once it is converted and their pointers could be reused.
+	prev = pyphp_enter(self);
+	result = true;
+	for (i = 0; result && i < count; ++i) {
+		globals[i].zv = PyObject_to_zval(PyTuple_GET_ITEM(PySequence_Fast_GET_ITEM(pyfast, i), 1), NULL);
+		result = globals[i].zv != NULL;
+	}
+	if (result) {
+		// .. NOTE: The values which are set are stolen.
+		result = pyphp_php_global_set_many(globals, count, var, (int)varlen);
+	}
+	for (i = 0; i < count; ++i) {
+		if (globals[i].zv != NULL) {
+			zval_del(&globals[i].zv);
+		}
+	}
+	pyphp_leave(self, prev);
+	if (!result) {
+		goto set_many_error; // Clean up.
+	}
+	
+	// Clean up temporary values.
+	PyMem_Free(globals);
+	Py_DECREF(pystrs);
+	Py_DECREF(pyfast);
+	
+	Py_RETURN_NONE;
+	
+	// Failed to set globals.
+	set_many_error: {
+		if (globals != NULL) {
+			PyMem_Free(globals);
+		}
+		Py_XDECREF(pystrs);
+		Py_DECREF(pyfast);
+	}
+	return NULL;
+}
+
+static const char pyphp_global_set_path_doc[] = (
+	"Sets the value at the specified path through nested global arrays\n"
+	"without converting the arrays along the path.\n"
+	"\n"
+	"*path* (**sequence**) is the keys (``int`` or ``str``) of the path (see\n"
+	"``global_get_path()``). Missing or ``null`` arrays along the path are\n"
+	"created.\n"
+	"\n"
+	"*value* (**mixed**) is the value to set."
+);
+
+static PyObject * pyphp_global_set_path(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	struct pyphp_path_key_t * path = NULL; // owned
+	Py_ssize_t count = 0;
+	bool result = false;
+	zval * zv = NULL; // owned
+	PyObject * pypath = NULL; // borrowed
+	PyObject * pyval = NULL; // borrowed
+	PyObject * pykeep = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "OO:pyphp.global_set_path", &pypath, &pyval)) {
+		return NULL;
+	}
+	path = pyphp_path_keys(pypath, &count, &pykeep);
+	if (path == NULL) {
+		return NULL;
+	}
+	
+	// Convert python value to php value, and set it.
+	// .. NOTE: zv reference is stolen on success.
+	prev = pyphp_enter(self);
 	zv = PyObject_to_zval(pyval, NULL);
+	if (zv != NULL) {
+		result = pyphp_php_global_set_path(path, count, zv);
+		if (!result) {
+			// Clean up.
+			zval_del(&zv);
+		}
+	}
+	pyphp_leave(self, prev);
+	PyMem_Free(path);
+	Py_DECREF(pykeep);
+	if (!result) {
+		return NULL;
+	}
+	
+	Py_RETURN_NONE;
+}
+
+static const char pyphp_global_set_array_doc[] = (
+	"Sets the value of the specified global variable to a list of numbers\n"
+	"from a packed buffer.\n"
+	"\n"
+	"*key* (``str``) is the name of the variable to set.\n"
+	"\n"
+	"*data* (``array.array``, ``str``, or any object supporting the buffer\n"
+	"protocol) contains the packed numbers.\n"
+	"\n"
+	"*typecode* (``str``) is the ``array`` module type code of the numbers\n"
+	"(e.g., ``\"l\"`` or ``\"d\"``), or ``\"q\"`` and ``\"Q\"`` for 64-bit\n"
+	"integers. Default is ``None`` to use the ``typecode`` of *data*.\n"
+	"\n"
+	"*var* (``str``) optionally sets the keyed value in the specified global\n"
+	"variable instead of in the global symbol table. Default is ``None``.\n"
+);
+
+static PyObject * pyphp_global_set_array(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	const char * key = NULL; // borrowed
+	const char * typecode = NULL; // borrowed
+	const char * var = NULL; // borrowed
+	const void * buf = NULL; // borrowed
+	Py_ssize_t keylen = 0;
+	Py_ssize_t varlen = 0;
+	Py_ssize_t buflen = 0;
+	PyObject * pydata = NULL; // borrowed
+	PyObject * pytypecode = NULL; // owned
+	zval * zv = NULL; // owned
+	
+	if (!PyArg_ParseTuple(args, "s#O|zz#:pyphp.global_set_array", &key, &keylen, &pydata, &typecode, &var, &varlen)) {
+		return NULL;
+	}
+	if (keylen < 0 || INT_MAX < keylen) {
+		PyErr_Format(PyExc_ValueError, "key length:%" PY_Z "i must be between 0 and %i inclusive.", keylen, INT_MAX);
+		return NULL;
+	}
+	if (varlen < 0 || INT_MAX < varlen) {
+		PyErr_Format(PyExc_ValueError, "var length:%" PY_Z "i must be between 0 and %i inclusive.", varlen, INT_MAX);
+		return NULL;
+	}
+	if (typecode == NULL) {
+		// Get type code from array.
+		pytypecode = PyObject_GetAttrString(pydata, "typecode");
+		if (pytypecode == NULL) {
+			return NULL;
+		}
+		if (!PyString_Check(pytypecode)) {
+			PyErr_Format(PyExc_TypeError, "typecode:%s is not a str.", Py_TYPE(pytypecode)->tp_name);
+			Py_DECREF(pytypecode);
+			return NULL;
+		}
+		typecode = PyString_AS_STRING(pytypecode);
+	}
+	if (strlen(typecode) != 1 || buffer_itemsize(typecode[0]) == 0) {
+		PyErr_Format(PyExc_ValueError, "typecode:%s is not supported.", typecode);
+		Py_XDECREF(pytypecode);
+		return NULL;
+	}
+	
+	// Convert python buffer to php array.
+	// .. NOTE: The buffer is only got once PyPHP is entered because entering
+	//    can release the GIL while it waits for the PyPHP lock, and another
+	//    thread could resize the buffer meanwhile. The GIL is then held while
+	//    the buffer is read.
+	prev = pyphp_enter(self);
+	if (PyObject_AsReadBuffer(pydata, &buf, &buflen) != 0) {
+		Py_XDECREF(pytypecode);
+		pyphp_leave(self, prev);
+		return NULL;
+	}
+	zv = buffer_to_zval((const char *)buf, buflen, typecode[0]);
+	Py_XDECREF(pytypecode);
 	if (zv == NULL) {
+		pyphp_leave(self, prev);
 		return NULL;
 	}
 	
@@ -1838,8 +6931,10 @@ static PyObject * pyphp_global_set(PyObject * self, PyObject * args) {
 	if (!pyphp_php_global_set(key, (int)keylen, var, (int)varlen, zv)) {
 		// Clean up.
 		zval_del(&zv);
+		pyphp_leave(self, prev);
 		return NULL;
 	}
+	pyphp_leave(self, prev);
 	
 	Py_RETURN_NONE;
 }
@@ -1857,10 +6952,12 @@ static const char pyphp_ini_get_doc[] = (
 );
 
 static PyObject * pyphp_ini_get(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	const char * key = NULL; // borrowed
 	Py_ssize_t keylen = 0;
 	int orig = 0;
 	const char * val = NULL; // borrowed
+	PyObject * pyval = NULL; // owned
 	
 	if (!PyArg_ParseTuple(args, "s#|i:pyphp.ini_get", &key, &keylen, &orig)) {
 		return NULL;
@@ -1871,11 +6968,11 @@ static PyObject * pyphp_ini_get(PyObject * self, PyObject * args) {
 	}
 	
 	// Get ini value.
+	prev = pyphp_enter(self);
 	val = pyphp_php_ini_get(key, (int)keylen, (bool)orig);
-	if (val == NULL) {
-		return NULL;
-	}
-	return PyString_FromString(val);
+	pyval = val != NULL ? PyString_FromString(val) : NULL;
+	pyphp_leave(self, prev);
+	return pyval;
 }
 
 static const char pyphp_ini_get_all_doc[] = (
@@ -1891,6 +6988,7 @@ static const char pyphp_ini_get_all_doc[] = (
 );
 
 static PyObject * pyphp_ini_get_all(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	const char * ext = NULL; // borrowed
 	Py_ssize_t extlen = 0;
 	int details = 0;
@@ -1905,21 +7003,15 @@ static PyObject * pyphp_ini_get_all(PyObject * self, PyObject * args) {
 		return NULL;
 	}
 	
-	// Make sure PyPHP has been started.
-	if (!pyphp.is_started) {
-		PyErr_SetString(InternalErrorType, "PyPHP not initialized.");
-		return NULL;
-	}
-	
 	// Get options.
+	prev = pyphp_enter(self);
 	zdict = pyphp_php_ini_get_all(ext, (int)extlen, (bool)details);
-	if (zdict == NULL) {
-		return NULL;
+	if (zdict != NULL) {
+		// Convert php dict to python dict.
+		pydict = zval_to_PyObject(zdict, NULL);
+		zval_del(&zdict);
 	}
-	
-	// Convert php dict to python dict.
-	pydict = zval_to_PyObject(zdict, NULL);
-	zval_del(&zdict);
+	pyphp_leave(self, prev);
 	return pydict;
 }
 
@@ -1932,10 +7024,12 @@ static const char pyphp_ini_set_doc[] = (
 );
 
 static PyObject * pyphp_ini_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	const char * key = NULL; // borrowed
 	const char * val = NULL; // borrowed
 	Py_ssize_t keylen = 0;
 	Py_ssize_t vallen = 0;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "s#s#:pyphp.ini_set", &key, &keylen, &val, &vallen)) {
 		return NULL;
@@ -1950,7 +7044,10 @@ static PyObject * pyphp_ini_set(PyObject * self, PyObject * args) {
 	}
 	
 	// Set INI value.
-	if (!pyphp_php_ini_set(key, (int)keylen, val, (int)vallen)) {
+	prev = pyphp_enter(self);
+	result = pyphp_php_ini_set(key, (int)keylen, val, (int)vallen);
+	pyphp_leave(self, prev);
+	if (!result) {
 		return NULL;
 	}
 	
@@ -1962,7 +7059,13 @@ static const char pyphp_init_doc[] = (
 );
 
 static PyObject * pyphp_init(PyObject * self, PyObject * args) {
-	if (!pyphp_php_startup(0, NULL)) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	bool result = false;
+	
+	prev = pyphp_enter(self);
+	result = pyphp_php_startup(0, NULL);
+	pyphp_leave(self, prev);
+	if (!result) {
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -1973,7 +7076,13 @@ static const char pyphp_reset_doc[] = (
 );
 
 static PyObject * pyphp_reset(PyObject * self, PyObject * args) {
-	if (!pyphp_php_restart(0, NULL)) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	bool result = false;
+	
+	prev = pyphp_enter(self);
+	result = pyphp_php_restart();
+	pyphp_leave(self, prev);
+	if (!result) {
 		return NULL;
 	}
 	Py_RETURN_NONE;
@@ -1984,7 +7093,17 @@ static const char pyphp_shutdown_doc[] = (
 );
 
 static PyObject * pyphp_shutdown(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
+	// Shutting down ends any persistent request.
+	prev = pyphp_enter(self);
+	if (!pyphp_php_request_can_end()) {
+		pyphp_leave(self, prev);
+		return NULL;
+	}
+	pyphp_interp->request_depth = 0;
+	pyphp_interp->restart_pending = false;
 	pyphp_php_shutdown();
+	pyphp_leave(self, prev);
 
 	Py_RETURN_NONE;
 }
@@ -1996,7 +7115,9 @@ static const char pyphp_output_callback_set_doc[] = (
 );
 
 static PyObject * pyphp_output_callback_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	PyObject * pyout = NULL;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "O:pyphp.set_output_callback", &pyout)) {
 		return NULL;
@@ -2007,7 +7128,10 @@ static PyObject * pyphp_output_callback_set(PyObject * self, PyObject * args) {
 	}
 	
 	// Set callback.
-	if (!pyphp_php_output_callback_set(pyout)) {
+	prev = pyphp_enter(self);
+	result = pyphp_php_output_callback_set(pyout);
+	pyphp_leave(self, prev);
+	if (!result) {
 		return NULL;
 	}
 	
@@ -2022,8 +7146,10 @@ static const char pyphp_output_fd_set_doc[] = (
 );
 
 static PyObject * pyphp_output_fd_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	int out_fd = -1;
 	FILE * out_fp = NULL;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "i:pyphp.set_output_fd", &out_fd)) {
 		return NULL;
@@ -2038,7 +7164,10 @@ static PyObject * pyphp_output_fd_set(PyObject * self, PyObject * args) {
 		}
 		
 		// Set file pointer.
-		if (!pyphp_php_output_fp_set(out_fp)) {
+		prev = pyphp_enter(self);
+		result = pyphp_php_output_fp_set(out_fp);
+		pyphp_leave(self, prev);
+		if (!result) {
 			return NULL;
 		}
 	}
@@ -2053,7 +7182,9 @@ static const char pyphp_error_callback_set_doc[] = (
 );
 
 static PyObject * pyphp_error_callback_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	PyObject * pyerr = NULL;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "O:pyphp.set_error_callback", &pyerr)) {
 		return NULL;
@@ -2064,7 +7195,10 @@ static PyObject * pyphp_error_callback_set(PyObject * self, PyObject * args) {
 	}
 	
 	// Set callback.
-	if (!pyphp_php_output_callback_set(pyerr)) {
+	prev = pyphp_enter(self);
+	result = pyphp_php_error_callback_set(pyerr);
+	pyphp_leave(self, prev);
+	if (!result) {
 		return NULL;
 	}
 	
@@ -2079,8 +7213,10 @@ static const char pyphp_error_fd_set_doc[] = (
 );
 
 static PyObject * pyphp_error_fd_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	int err_fd = -1;
 	FILE * err_fp = NULL;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "i:pyphp.set_error_fd", &err_fd)) {
 		return NULL;
@@ -2095,7 +7231,10 @@ static PyObject * pyphp_error_fd_set(PyObject * self, PyObject * args) {
 		}
 		
 		// Set file pointer.
-		if (!pyphp_php_output_fp_set(err_fp)) {
+		prev = pyphp_enter(self);
+		result = pyphp_php_error_fp_set(err_fp);
+		pyphp_leave(self, prev);
+		if (!result) {
 			return NULL;
 		}
 	}
@@ -2110,7 +7249,9 @@ static const char pyphp_log_callback_set_doc[] = (
 );
 
 static PyObject * pyphp_log_callback_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	PyObject * pylog = NULL;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "O:pyphp.set_log_callback", &pylog)) {
 		return NULL;
@@ -2121,7 +7262,10 @@ static PyObject * pyphp_log_callback_set(PyObject * self, PyObject * args) {
 	}
 	
 	// Set callback.
-	if (!pyphp_php_output_callback_set(pylog)) {
+	prev = pyphp_enter(self);
+	result = pyphp_php_log_callback_set(pylog);
+	pyphp_leave(self, prev);
+	if (!result) {
 		return NULL;
 	}
 	
@@ -2136,8 +7280,10 @@ static const char pyphp_log_fd_set_doc[] = (
 );
 
 static PyObject * pyphp_log_fd_set(PyObject * self, PyObject * args) {
+	struct pyphp_interp_t * prev = NULL; // borrowed
 	int log_fd = -1;
 	FILE * log_fp = NULL;
+	bool result = false;
 	
 	if (!PyArg_ParseTuple(args, "i:pyphp_set_output_fd", &log_fd)) {
 		return NULL;
@@ -2152,7 +7298,10 @@ static PyObject * pyphp_log_fd_set(PyObject * self, PyObject * args) {
 		}
 		
 		// Set file pointer.
-		if (!pyphp_php_output_fp_set(log_fp)) {
+		prev = pyphp_enter(self);
+		result = pyphp_php_log_fp_set(log_fp);
+		pyphp_leave(self, prev);
+		if (!result) {
 			return NULL;
 		}
 	}
@@ -2171,11 +7320,26 @@ static const char module_doc[] = (
 static PyMethodDef module_methods[] = {
 	{"exec_file", pyphp_exec_file, METH_VARARGS, pyphp_exec_file_doc},
 	{"exec_inline", pyphp_exec_inline, METH_VARARGS, pyphp_exec_inline_doc},
+	{"call_function", pyphp_call_function, METH_VARARGS, pyphp_call_function_doc},
+	{"compile", pyphp_compile, METH_VARARGS, pyphp_compile_doc},
+	{"begin_request", pyphp_begin_request, METH_NOARGS, pyphp_begin_request_doc},
+	{"end_request", pyphp_end_request, METH_NOARGS, pyphp_end_request_doc},
 	{"global_get", pyphp_global_get, METH_VARARGS, pyphp_global_get_doc},
+	{"global_get_array", pyphp_global_get_array, METH_VARARGS, pyphp_global_get_array_doc},
+	{"global_get_bytes", pyphp_global_get_bytes, METH_VARARGS, pyphp_global_get_bytes_doc},
+	{"global_get_json", pyphp_global_get_json, METH_VARARGS, pyphp_global_get_json_doc},
+	{"global_get_many", pyphp_global_get_many, METH_VARARGS, pyphp_global_get_many_doc},
+	{"global_get_path", pyphp_global_get_path, METH_VARARGS, pyphp_global_get_path_doc},
 	{"global_set", pyphp_global_set, METH_VARARGS, pyphp_global_set_doc},
+	{"global_set_array", pyphp_global_set_array, METH_VARARGS, pyphp_global_set_array_doc},
+	{"global_set_many", pyphp_global_set_many, METH_VARARGS, pyphp_global_set_many_doc},
+	{"global_set_path", pyphp_global_set_path, METH_VARARGS, pyphp_global_set_path_doc},
 	{"ini_get", pyphp_ini_get, METH_VARARGS, pyphp_ini_get_doc},
 	{"ini_get_all", pyphp_ini_get_all, METH_VARARGS, pyphp_ini_get_all_doc},
 	{"ini_set", pyphp_ini_set, METH_VARARGS, pyphp_ini_set_doc},
+	{"intern_set_size", pyphp_intern_set_size, METH_VARARGS, pyphp_intern_set_size_doc},
+	{"php_serialize", pyphp_php_serialize, METH_VARARGS, pyphp_php_serialize_doc},
+	{"php_unserialize", pyphp_php_unserialize, METH_VARARGS, pyphp_php_unserialize_doc},
 	{"init", pyphp_init, METH_NOARGS, pyphp_init_doc},
 	{"reset", pyphp_reset, METH_NOARGS, pyphp_reset_doc},
 	{"shutdown", pyphp_shutdown, METH_NOARGS, pyphp_shutdown_doc},
@@ -2185,15 +7349,48 @@ static PyMethodDef module_methods[] = {
 	{"set_error_fd", pyphp_error_fd_set, METH_VARARGS, pyphp_error_fd_set_doc},
 	{"set_log_callback", pyphp_log_callback_set, METH_VARARGS, pyphp_log_callback_set_doc},
 	{"set_log_fd", pyphp_log_fd_set, METH_VARARGS, pyphp_log_fd_set_doc},
+	{"set_max_depth", pyphp_max_depth_set, METH_VARARGS, pyphp_max_depth_set_doc},
 	{NULL, NULL, 0, NULL}
 };
 
 PyMODINIT_FUNC initcpyphp() {
 	PyObject * module;
+	InterpreterObject * pymain = NULL; // owned
+	
+	// Initialize python threads and the main interpreter lock so that the GIL
+	// can be released while PHP API calls are being made.
+	PyEval_InitThreads();
+	pyphp.main.lock = PyThread_allocate_lock();
+	if (pyphp.main.lock == NULL) {
+		PyErr_SetString(PyExc_MemoryError, "Failed to allocate interpreter lock.");
+		return;
+	}
+	pyphp.main.max_depth = PYPHP_MAX_DEPTH;
+	
+	// Interpreter type.
+	// .. NOTE: Interpreters share the module methods. The module methods are
+	//    bound to the main interpreter.
+	InterpreterType.tp_methods = module_methods;
+	if (PyType_Ready(&InterpreterType) != 0) {
+		return;
+	}
+	pymain = PyObject_New(InterpreterObject, &InterpreterType);
+	if (pymain == NULL) {
+		return;
+	}
+	pymain->interp = &pyphp.main;
 	
 	// Initialize module.
-	module = Py_InitModule3("cpyphp", module_methods, module_doc);
+	module = Py_InitModule4("cpyphp", module_methods, module_doc, (PyObject *)pymain, PYTHON_API_VERSION);
 	if (module == NULL) {
+		Py_DECREF(pymain);
+		return;
+	}
+	if (PyModule_AddObject(module, "main_interpreter", (PyObject *)pymain) != 0) {
+		return;
+	}
+	Py_INCREF(&InterpreterType);
+	if (PyModule_AddObject(module, "Interpreter", (PyObject *)&InterpreterType) != 0) {
 		return;
 	}
 	
@@ -2215,6 +7412,33 @@ PyMODINIT_FUNC initcpyphp() {
 		return;
 	}
 	
+	// Compiled Script type.
+	if (PyType_Ready(&CompiledScriptType) != 0) {
+		return;
+	}
+	Py_INCREF(&CompiledScriptType);
+	if (PyModule_AddObject(module, "CompiledScript", (PyObject *)&CompiledScriptType) != 0) {
+		return;
+	}
+	
+	// PHP Array type.
+	if (PyType_Ready(&PhpArrayType) != 0) {
+		return;
+	}
+	Py_INCREF(&PhpArrayType);
+	if (PyModule_AddObject(module, "PhpArray", (PyObject *)&PhpArrayType) != 0) {
+		return;
+	}
+	
+	// PHP Bytes type.
+	if (PyType_Ready(&PhpBytesType) != 0) {
+		return;
+	}
+	Py_INCREF(&PhpBytesType);
+	if (PyModule_AddObject(module, "PhpBytes", (PyObject *)&PhpBytesType) != 0) {
+		return;
+	}
+	
 	// PHP Fatal Error type.
 	PhpFatalErrorType = PyErr_NewExceptionWithDoc("cpyphp.PhpFatalError", (char *)PhpFatalErrorType_doc, PyphpExceptionType, NULL);
 	if (PhpFatalErrorType == NULL) {
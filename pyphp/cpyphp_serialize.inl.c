@@ -0,0 +1,1047 @@
+/**
+This module contains a codec for the format of PHP's ``serialize()`` and
+``unserialize()`` functions. Python values are serialized and unserialized
+directly without PHP so the PHP engine does not need to be started. All of the
+functions defined within this module are meant to be local (static) to the
+including module so that the exported namespace is not poluted.
+
+:Authors: Caleb P. Burns <cpburnz@gmail.com>; Ben DeMott <ben_demott@hotmail.com>
+:Version: 0.5
+:Status: Development
+:Date: 2026-10-17
+*/
+
+#include <Python.h> // Py*
+#include <limits.h> // LONG_MAX
+#include <stdarg.h> // va_end, va_list, va_start
+#include <stdbool.h> // bool, false, true
+#include <stddef.h> // NULL, size_t
+#include <string.h> // memcmp, memcpy
+
+// The number of frames the work stack of the codec starts with before it is
+// moved to the heap.
+#define SERIALIZE_STACK_INIT 32
+
+// The initial size of a serialized string.
+#define SERIALIZE_INIT_SIZE 256
+
+/**
+The ``serialize_buf_t`` struct is the serialized string being written.
+*/
+struct serialize_buf_t {
+	PyObject * str; // owned
+	Py_ssize_t len;
+};
+
+/**
+The ``serialize_frame_t`` struct is a frame of the work stack serializing a
+Python container as a PHP array.
+*/
+struct serialize_frame_t {
+	// The python container (borrowed).
+	PyObject * pyobj;
+	
+	// The python container as a list or tuple (owned), or NULL if it is a dict.
+	PyObject * pyfast;
+	
+	// The position of the next item.
+	Py_ssize_t pos;
+};
+
+/**
+The ``unserialize_t`` struct is the serialized string being read.
+*/
+struct unserialize_t {
+	const char * start; // borrowed
+	const char * end; // borrowed
+	const char * p; // borrowed
+	
+	// The values read so far (``list``) which back-references (``R:`` and
+	// ``r:``) refer to by their 1-based position.
+	PyObject * vars; // owned
+};
+
+/**
+The ``unserialize_frame_t`` struct is a frame of the work stack unserializing
+a PHP array as a Python list or dict, or a PHP object as a Python dict.
+*/
+struct unserialize_frame_t {
+	// The python list (owned) while the keys are list indices; otherwise, NULL.
+	PyObject * pylist;
+	
+	// The python dict (owned) once a key is not a list index; otherwise, NULL.
+	PyObject * pydict;
+	
+	// The key of the next element (owned), or NULL if it has not been read.
+	PyObject * pykey;
+	
+	// The number of elements, and the number not read yet.
+	Py_ssize_t len;
+	Py_ssize_t remaining;
+	
+	// The position of the container in the values read.
+	Py_ssize_t var;
+	
+	// Whether the container is a PHP object.
+	bool is_object;
+};
+
+/**
+Grows the work stack of the codec.
+
+*frames* (``void **``) is the stack. This is updated to the grown stack.
+
+*local* (``void *``) is the initial stack which is not allocated on the heap.
+
+*size* (``size_t *``) is the number of frames in the stack. This is updated to
+the grown size.
+
+*itemsize* (``size_t``) is the size of a frame.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_stack_grow(void ** frames, void * local, size_t * size, size_t itemsize) {
+	void * grown = NULL; // owned
+	
+	if (*size > (size_t)PY_SSIZE_T_MAX / 2 / itemsize) {
+		PyErr_NoMemory();
+		return false;
+	}
+	grown = PyMem_Malloc(*size * 2 * itemsize);
+	if (grown == NULL) {
+		PyErr_NoMemory();
+		return false;
+	}
+	memcpy(grown, *frames, *size * itemsize);
+	if (*frames != local) {
+		PyMem_Free(*frames);
+	}
+	*frames = grown;
+	*size *= 2;
+	return true;
+}
+
+/**
+Checks whether another level of nesting can be serialized or unserialized.
+
+*depth* (``size_t``) is the current nesting depth.
+
+*max_depth* (``unsigned long``) is the maximum nesting depth, or 0 for no
+limit.
+
+Returns ``true`` if it can; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_depth_check(size_t depth, unsigned long max_depth) {
+	if (max_depth > 0 && depth >= max_depth) {
+		PyErr_Format(PyExc_ValueError, "Maximum nesting depth:%lu exceeded.", max_depth);
+		return false;
+	}
+	return true;
+}
+
+/**
+Appends to the serialized string.
+
+*buf* (``struct serialize_buf_t *``) is the serialized string.
+
+*data* (``const char *``) is the data to append.
+
+*len* (``Py_ssize_t``) is the length of *data*.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_write(struct serialize_buf_t * buf, const char * data, Py_ssize_t len) {
+	Py_ssize_t size = PyString_GET_SIZE(buf->str);
+	
+	// Grow the string by doubling it.
+	if (len > size - buf->len) {
+		while (len > size - buf->len) {
+			if (size > PY_SSIZE_T_MAX / 2) {
+				PyErr_NoMemory();
+				return false;
+			}
+			size *= 2;
+		}
+		if (_PyString_Resize(&buf->str, size) != 0) {
+			return false;
+		}
+	}
+	memcpy(PyString_AS_STRING(buf->str) + buf->len, data, (size_t)len);
+	buf->len += len;
+	return true;
+}
+
+/**
+Appends a formatted header (e.g., ``i:1;`` or ``s:5:"``) to the serialized
+string.
+
+*buf* (``struct serialize_buf_t *``) is the serialized string.
+
+*format* (``const char *``) is the ``printf()`` format.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_writef(struct serialize_buf_t * buf, const char * format, ...) {
+	char tmp[64];
+	int len;
+	va_list args;
+	
+	va_start(args, format);
+	len = PyOS_vsnprintf(tmp, sizeof(tmp), format, args);
+	va_end(args);
+	if (len < 0 || (size_t)len >= sizeof(tmp)) {
+		PyErr_Format(PyExc_SystemError, "Serialized header is too long.");
+		return false;
+	}
+	return serialize_write(buf, tmp, len);
+}
+
+/**
+Appends a PHP double to the serialized string.
+
+*buf* (``struct serialize_buf_t *``) is the serialized string.
+
+*value* (``double``) is the value.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_double(struct serialize_buf_t * buf, double value) {
+	char * repr = NULL; // owned
+	bool result;
+	
+	if (Py_IS_NAN(value)) {
+		return serialize_write(buf, "d:NAN;", 6);
+	} else if (Py_IS_INFINITY(value)) {
+		return value > 0 ? serialize_write(buf, "d:INF;", 6) : serialize_write(buf, "d:-INF;", 7);
+	}
+	
+	// Use the shortest representation which is read back as the same value.
+	repr = PyOS_double_to_string(value, 'r', 0, 0, NULL);
+	if (repr == NULL) {
+		return false;
+	}
+	result = serialize_writef(buf, "d:%s;", repr);
+	PyMem_Free(repr);
+	return result;
+}
+
+/**
+Appends a PHP string to the serialized string.
+
+*buf* (``struct serialize_buf_t *``) is the serialized string.
+
+*str* (``const char *``) is the string.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_string(struct serialize_buf_t * buf, const char * str, Py_ssize_t len) {
+	return serialize_writef(buf, "s:%" PY_FORMAT_SIZE_T "d:\"", len) && serialize_write(buf, str, len) && serialize_write(buf, "\";", 2);
+}
+
+/**
+Determines whether the specified PHP array key is a numeric string which PHP
+stores as an integer key (e.g., ``"5"`` but not ``"05"`` or ``"-0"``).
+
+*str* (``const char *``) is the key.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+*value* (``long *``) will be set to the integer key.
+
+Returns ``true`` if the key is numeric; otherwise, ``false``.
+*/
+static bool serialize_key_is_numeric(const char * str, Py_ssize_t len, long * value) {
+	const char * p = str;
+	const char * end = str + len;
+	bool negative = false;
+	unsigned long limit = (unsigned long)LONG_MAX - 1;
+	unsigned long result = 0;
+	unsigned long digit;
+	
+	if (p < end && *p == '-') {
+		negative = true;
+		++p;
+	}
+	if (p == end || (*p == '0' && (end - p > 1 || negative))) {
+		return false;
+	}
+	
+	// PHP keeps keys which could have overflowed (e.g., the maximum long) as
+	// string keys.
+	for (; p < end; ++p) {
+		if (*p < '0' || '9' < *p) {
+			return false;
+		}
+		digit = (unsigned long)(*p - '0');
+		if (result > (limit - digit) / 10) {
+			return false;
+		}
+		result = result * 10 + digit;
+	}
+	*value = negative ? -(long)result : (long)result;
+	return true;
+}
+
+/**
+Appends a PHP array key to the serialized string. Keys are converted the same
+way as they are by ``PyObject_to_zval()``.
+
+*buf* (``struct serialize_buf_t *``) is the serialized string.
+
+*pykey* (``PyObject *``) is the python key.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool serialize_key(struct serialize_buf_t * buf, PyObject * pykey) {
+	PyObject * pykey_tmp = NULL; // owned
+	const char * key = NULL; // borrowed
+	Py_ssize_t keylen = 0;
+	long lkey = 0;
+	bool result;
+	
+	// Get python key string.
+	if (pykey == Py_None || pykey == Py_False) {
+		// In PHP both `null` and `false` become empty strings when casted.
+		return serialize_string(buf, "", 0);
+	} else if (PyString_Check(pykey)) {
+		key = PyString_AS_STRING(pykey);
+		keylen = PyString_GET_SIZE(pykey);
+	} else {
+		if (PyUnicode_Check(pykey)) {
+			pykey_tmp = PyUnicode_AsUTF8String(pykey);
+		} else {
+			pykey_tmp = PyObject_Str(pykey);
+		}
+		if (pykey_tmp == NULL) {
+			return false;
+		}
+		key = PyString_AS_STRING(pykey_tmp);
+		keylen = PyString_GET_SIZE(pykey_tmp);
+	}
+	
+	// Numeric strings are integer keys in PHP.
+	if (serialize_key_is_numeric(key, keylen, &lkey)) {
+		result = serialize_writef(buf, "i:%ld;", lkey);
+	} else {
+		result = serialize_string(buf, key, keylen);
+	}
+	Py_XDECREF(pykey_tmp);
+	return result;
+}
+
+/**
+Serializes a Python value in the format of PHP's ``serialize()``.
+
+*pyobj* (``PyObject *``) is the python value. Values are converted the same
+way as they are by ``PyObject_to_zval()``: dicts, sequences and iterators
+become PHP arrays.
+
+.. NOTE: PHP arrays are values so a container referenced more than once is
+   serialized each time.
+
+*max_depth* (``unsigned long``) is the maximum nesting depth, or 0 for no
+limit.
+
+Returns the serialized string (``str``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * serialize_to_string(PyObject * pyobj, unsigned long max_depth) {
+	struct serialize_buf_t buf;
+	struct serialize_frame_t frames_local[SERIALIZE_STACK_INIT];
+	struct serialize_frame_t * frames = frames_local; // owned
+	struct serialize_frame_t * f = NULL; // borrowed
+	size_t frames_size = SERIALIZE_STACK_INIT;
+	size_t depth = 0;
+	size_t i = 0;
+	PyObject * pyval = pyobj; // borrowed
+	PyObject * pykey = NULL; // borrowed
+	PyObject * pyfast = NULL; // owned
+	PyObject * pystr = NULL; // owned
+	long lval;
+	
+	buf.len = 0;
+	buf.str = PyString_FromStringAndSize(NULL, SERIALIZE_INIT_SIZE);
+	if (buf.str == NULL) {
+		return NULL;
+	}
+	
+	for (;;) {
+		// Serialize the python value.
+		if (pyval == Py_None) {
+			if (!serialize_write(&buf, "N;", 2)) {
+				goto serialize_error; // Clean up.
+			}
+		} else if (PyBool_Check(pyval)) {
+			if (!serialize_write(&buf, pyval == Py_True ? "b:1;" : "b:0;", 4)) {
+				goto serialize_error; // Clean up.
+			}
+		} else if (PyInt_Check(pyval) || PyLong_Check(pyval)) {
+			lval = PyInt_AsLong(pyval);
+			if (lval == -1 && PyErr_Occurred() != NULL) {
+				goto serialize_error; // Clean up.
+			}
+			if (!serialize_writef(&buf, "i:%ld;", lval)) {
+				goto serialize_error; // Clean up.
+			}
+		} else if (PyFloat_Check(pyval)) {
+			if (!serialize_double(&buf, PyFloat_AS_DOUBLE(pyval))) {
+				goto serialize_error; // Clean up.
+			}
+		} else if (PyString_Check(pyval)) {
+			if (!serialize_string(&buf, PyString_AS_STRING(pyval), PyString_GET_SIZE(pyval))) {
+				goto serialize_error; // Clean up.
+			}
+		} else if (PyUnicode_Check(pyval)) {
+			// Encode python unicode string as utf-8.
+			pystr = PyUnicode_AsUTF8String(pyval);
+			if (pystr == NULL) {
+				goto serialize_error; // Clean up.
+			}
+			if (!serialize_string(&buf, PyString_AS_STRING(pystr), PyString_GET_SIZE(pystr))) {
+				goto serialize_error; // Clean up.
+			}
+			Py_CLEAR(pystr);
+		} else if (PyDict_Check(pyval) || PySequence_Check(pyval) || PyIter_Check(pyval)) {
+			// Start serializing the container as a php array.
+			if (!serialize_depth_check(depth, max_depth)) {
+				goto serialize_error; // Clean up.
+			}
+			if (depth == frames_size && !serialize_stack_grow((void **)&frames, frames_local, &frames_size, sizeof(*frames))) {
+				goto serialize_error; // Clean up.
+			}
+			if (PyDict_Check(pyval)) {
+				if (!serialize_writef(&buf, "a:%" PY_FORMAT_SIZE_T "d:{", PyDict_Size(pyval))) {
+					goto serialize_error; // Clean up.
+				}
+			} else {
+				pyfast = PySequence_Fast(pyval, "");
+				if (pyfast == NULL) {
+					// Override exception.
+					PyErr_Format(PyExc_TypeError, "Python type:%s cannot be serialized.", Py_TYPE(pyval)->tp_name);
+					goto serialize_error; // Clean up.
+				}
+				if (!serialize_writef(&buf, "a:%" PY_FORMAT_SIZE_T "d:{", PySequence_Fast_GET_SIZE(pyfast))) {
+					goto serialize_error; // Clean up.
+				}
+			}
+			f = &frames[depth++];
+			f->pyobj = pyval;
+			f->pyfast = pyfast;
+			f->pos = 0;
+			pyfast = NULL; // Frame steals reference to sequence.
+		} else {
+			// Python object not supported.
+			PyErr_Format(PyExc_TypeError, "Python type:%s cannot be serialized.", Py_TYPE(pyval)->tp_name);
+			goto serialize_error; // Clean up.
+		}
+		
+		// Find the next value, finishing the containers which are done.
+		pyval = NULL;
+		while (depth > 0 && pyval == NULL) {
+			f = &frames[depth - 1];
+			if (f->pyfast == NULL) {
+				if (PyDict_Next(f->pyobj, &f->pos, &pykey, &pyval)) {
+					if (!serialize_key(&buf, pykey)) {
+						goto serialize_error; // Clean up.
+					}
+					continue;
+				}
+			} else if (f->pos < PySequence_Fast_GET_SIZE(f->pyfast)) {
+				if (!serialize_writef(&buf, "i:%" PY_FORMAT_SIZE_T "d;", f->pos)) {
+					goto serialize_error; // Clean up.
+				}
+				pyval = PySequence_Fast_ITEMS(f->pyfast)[f->pos];
+				f->pos += 1;
+				continue;
+			}
+			Py_CLEAR(f->pyfast);
+			--depth;
+			if (!serialize_write(&buf, "}", 1)) {
+				goto serialize_error; // Clean up.
+			}
+		}
+		if (pyval == NULL) {
+			break;
+		}
+	}
+	
+	// Clean up temporary values.
+	if (frames != frames_local) {
+		PyMem_Free(frames);
+	}
+	
+	// Return serialized string.
+	if (_PyString_Resize(&buf.str, buf.len) != 0) {
+		return NULL;
+	}
+	return buf.str;
+	
+	// Failed to serialize python value.
+	serialize_error: {
+		Py_XDECREF(pystr);
+		Py_XDECREF(pyfast);
+		for (i = 0; i < depth; ++i) {
+			Py_XDECREF(frames[i].pyfast);
+		}
+		if (frames != frames_local) {
+			PyMem_Free(frames);
+		}
+		Py_XDECREF(buf.str);
+	}
+	return NULL;
+}
+
+/**
+Raises the exception for an invalid serialized string unless one has already
+been raised.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+Returns ``false``.
+*/
+static bool unserialize_error(struct unserialize_t * u) {
+	if (PyErr_Occurred() == NULL) {
+		PyErr_Format(PyExc_ValueError, "Invalid serialized PHP value at offset:%" PY_FORMAT_SIZE_T "d.", (Py_ssize_t)(u->p - u->start));
+	}
+	return false;
+}
+
+/**
+Reads the specified string from the serialized string.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+*str* (``const char *``) is the expected string.
+
+*len* (``Py_ssize_t``) is the length of *str*.
+
+Returns ``true`` if it was read; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool unserialize_expect(struct unserialize_t * u, const char * str, Py_ssize_t len) {
+	if (u->end - u->p < len || memcmp(u->p, str, (size_t)len) != 0) {
+		return unserialize_error(u);
+	}
+	u->p += len;
+	return true;
+}
+
+/**
+Reads an integer followed by the specified terminator from the serialized
+string.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+*term* (``char``) is the terminator (e.g., ``;`` or ``:``).
+
+*value* (``long *``) will be set to the integer.
+
+Returns ``true`` if it was read; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool unserialize_long(struct unserialize_t * u, char term, long * value) {
+	bool negative = false;
+	unsigned long limit;
+	unsigned long result = 0;
+	unsigned long digit;
+	const char * digits = NULL; // borrowed
+	
+	if (u->p < u->end && (*u->p == '-' || *u->p == '+')) {
+		negative = *u->p == '-';
+		++u->p;
+	}
+	limit = negative ? (unsigned long)LONG_MAX + 1 : (unsigned long)LONG_MAX;
+	digits = u->p;
+	while (u->p < u->end && '0' <= *u->p && *u->p <= '9') {
+		digit = (unsigned long)(*u->p - '0');
+		if (result > (limit - digit) / 10) {
+			PyErr_Format(PyExc_OverflowError, "Serialized PHP integer at offset:%" PY_FORMAT_SIZE_T "d is too large.", (Py_ssize_t)(digits - u->start));
+			return false;
+		}
+		result = result * 10 + digit;
+		++u->p;
+	}
+	if (u->p == digits || u->p == u->end || *u->p != term) {
+		return unserialize_error(u);
+	}
+	++u->p;
+	*value = negative ? (long)(0 - result) : (long)result;
+	return true;
+}
+
+/**
+Reads a length followed by the specified terminator from the serialized
+string, and makes sure that many bytes remain.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+*term* (``char``) is the terminator (e.g., ``:``).
+
+*minsize* (``Py_ssize_t``) is the minimum number of bytes each unit of the
+length takes in the serialized string.
+
+*len* (``Py_ssize_t *``) will be set to the length.
+
+Returns ``true`` if it was read; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool unserialize_length(struct unserialize_t * u, char term, Py_ssize_t minsize, Py_ssize_t * len) {
+	long value;
+	
+	if (!unserialize_long(u, term, &value)) {
+		return false;
+	}
+	// .. NOTE: Checking the length against the remaining bytes keeps invalid
+	//    lengths from allocating large lists and dicts.
+	if (value < 0 || (u->end - u->p) / minsize < value) {
+		u->p -= 1;
+		return unserialize_error(u);
+	}
+	*len = (Py_ssize_t)value;
+	return true;
+}
+
+/**
+Reads a quoted string (e.g., ``5:"value"``) from the serialized string.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+*str* (``const char **``) will be set to the string.
+
+*len* (``Py_ssize_t *``) will be set to the length of *str*.
+
+Returns ``true`` if it was read; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool unserialize_quoted(struct unserialize_t * u, const char ** str, Py_ssize_t * len) {
+	if (!unserialize_length(u, ':', 1, len) || !unserialize_expect(u, "\"", 1)) {
+		return false;
+	}
+	if (u->end - u->p < *len) {
+		return unserialize_error(u);
+	}
+	*str = u->p;
+	u->p += *len;
+	return unserialize_expect(u, "\"", 1);
+}
+
+/**
+Reads an array key (``i:`` or ``s:``) from the serialized string.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+Returns the new Python key (``int`` or ``str``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * unserialize_key(struct unserialize_t * u) {
+	const char * str = NULL; // borrowed
+	Py_ssize_t len = 0;
+	long value = 0;
+	
+	if (u->end - u->p >= 2 && memcmp(u->p, "i:", 2) == 0) {
+		u->p += 2;
+		if (!unserialize_long(u, ';', &value)) {
+			return NULL;
+		}
+		return PyInt_FromLong(value);
+	} else if (u->end - u->p >= 2 && memcmp(u->p, "s:", 2) == 0) {
+		u->p += 2;
+		if (!unserialize_quoted(u, &str, &len) || !unserialize_expect(u, ";", 1)) {
+			return NULL;
+		}
+		return PyString_FromStringAndSize(str, len);
+	}
+	unserialize_error(u);
+	return NULL;
+}
+
+/**
+Reads a scalar value (``N;``, ``b:``, ``i:``, ``d:`` or ``s:``) from the
+serialized string.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+Returns the new Python value (``PyObject *``).
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * unserialize_scalar(struct unserialize_t * u) {
+	// .. NOTE: PHP writes doubles with up to ``serialize_precision`` digits.
+	char tmp[512];
+	const char * str = NULL; // borrowed
+	char * endp = NULL; // borrowed
+	Py_ssize_t len = 0;
+	long value = 0;
+	double dvalue = 0;
+	
+	if (u->end - u->p >= 2 && memcmp(u->p, "N;", 2) == 0) {
+		u->p += 2;
+		Py_RETURN_NONE;
+	} else if (u->end - u->p < 2 || u->p[1] != ':') {
+		unserialize_error(u);
+		return NULL;
+	}
+	
+	switch (*u->p) {
+		case 'b':
+			u->p += 2;
+			if (!unserialize_long(u, ';', &value)) {
+				return NULL;
+			}
+			return PyBool_FromLong(value);
+		
+		case 'i':
+			u->p += 2;
+			if (!unserialize_long(u, ';', &value)) {
+				return NULL;
+			}
+			return PyInt_FromLong(value);
+		
+		case 'd':
+			// Copy the double so it is terminated by a NULL byte.
+			u->p += 2;
+			str = u->p;
+			while (u->p < u->end && *u->p != ';') {
+				++u->p;
+			}
+			len = u->p - str;
+			if (u->p == u->end || len == 0 || len >= (Py_ssize_t)sizeof(tmp)) {
+				unserialize_error(u);
+				return NULL;
+			}
+			memcpy(tmp, str, (size_t)len);
+			tmp[len] = '\0';
+			dvalue = PyOS_string_to_double(tmp, &endp, NULL);
+			if (dvalue == -1.0 && PyErr_Occurred() != NULL) {
+				PyErr_Clear();
+				u->p = str;
+				unserialize_error(u);
+				return NULL;
+			}
+			if (endp != tmp + len) {
+				u->p = str;
+				unserialize_error(u);
+				return NULL;
+			}
+			++u->p;
+			return PyFloat_FromDouble(dvalue);
+		
+		case 's':
+			u->p += 2;
+			if (!unserialize_quoted(u, &str, &len) || !unserialize_expect(u, ";", 1)) {
+				return NULL;
+			}
+			return PyString_FromStringAndSize(str, len);
+		
+		default:
+			break;
+	}
+	unserialize_error(u);
+	return NULL;
+}
+
+/**
+Changes the frame unserializing a PHP array from a Python list to a Python
+dict. The values already read are moved from the list into the dict.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+*f* (``struct unserialize_frame_t *``) is the frame.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool unserialize_frame_to_dict(struct unserialize_t * u, struct unserialize_frame_t * f) {
+	PyObject * pykey = NULL; // owned
+	PyObject * pyval = NULL; // borrowed
+	Py_ssize_t i;
+	
+	f->pydict = _PyDict_NewPresized(f->len);
+	if (f->pydict == NULL) {
+		return false;
+	}
+	
+	// Move the values already read from the python list into the python dict.
+	for (i = 0; i < f->len; ++i) {
+		pyval = PyList_GET_ITEM(f->pylist, i);
+		if (pyval != NULL) {
+			pykey = PyInt_FromSsize_t(i);
+			if (pykey == NULL) {
+				return false;
+			}
+			if (PyDict_SetItem(f->pydict, pykey, pyval) != 0) {
+				Py_DECREF(pykey);
+				return false;
+			}
+			Py_DECREF(pykey);
+		}
+	}
+	
+	// Replace the python list in the values read.
+	Py_INCREF(f->pydict);
+	if (PyList_SetItem(u->vars, f->var, f->pydict) != 0) {
+		return false;
+	}
+	
+	// Release the python list.
+	// .. NOTE: A back-reference could have referenced the python list before
+	//    it became a dict. In that case the unset indices are filled with None
+	//    so that the list remains valid.
+	if (Py_REFCNT(f->pylist) > 1) {
+		for (i = 0; i < f->len; ++i) {
+			if (PyList_GET_ITEM(f->pylist, i) == NULL) {
+				Py_INCREF(Py_None);
+				PyList_SET_ITEM(f->pylist, i, Py_None);
+			}
+		}
+	}
+	Py_CLEAR(f->pylist);
+	return true;
+}
+
+/**
+Sets the value of the next element of the frame unserializing a PHP array or
+object.
+
+*u* (``struct unserialize_t *``) is the serialized string.
+
+*f* (``struct unserialize_frame_t *``) is the frame.
+
+*pyval* (``PyObject *``) is the python value.
+
+.. NOTE: This reference is stolen.
+
+Returns ``true`` on success; otherwise, ``false`` with a Python exception
+raised.
+*/
+static bool unserialize_frame_set(struct unserialize_t * u, struct unserialize_frame_t * f, PyObject * pyval) {
+	long index = -1;
+	int result = 0;
+	
+	// Only public properties of objects are kept. The names of protected and
+	// private properties are mangled with a leading NULL byte.
+	if (f->is_object && PyString_Check(f->pykey) && PyString_GET_SIZE(f->pykey) > 0 && PyString_AS_STRING(f->pykey)[0] == '\0') {
+		Py_DECREF(pyval);
+		Py_CLEAR(f->pykey);
+		f->remaining -= 1;
+		return true;
+	}
+	
+	// Change to a dict at the first key that is not an unset list index.
+	if (f->pydict == NULL) {
+		if (PyInt_CheckExact(f->pykey)) {
+			index = PyInt_AS_LONG(f->pykey);
+		}
+		if (index < 0 || index >= f->len || PyList_GET_ITEM(f->pylist, index) != NULL) {
+			if (!unserialize_frame_to_dict(u, f)) {
+				Py_DECREF(pyval);
+				return false;
+			}
+		}
+	}
+	
+	// Set new python value in list or dict.
+	if (f->pydict == NULL) {
+		PyList_SET_ITEM(f->pylist, index, pyval);
+	} else {
+		result = PyDict_SetItem(f->pydict, f->pykey, pyval);
+		Py_DECREF(pyval);
+		if (result != 0) {
+			return false;
+		}
+	}
+	Py_CLEAR(f->pykey);
+	f->remaining -= 1;
+	return true;
+}
+
+/**
+Unserializes a Python value from the format of PHP's ``serialize()``.
+
+*data* (``const char *``) is the serialized string.
+
+*len* (``Py_ssize_t``) is the length of *data*.
+
+*max_depth* (``unsigned long``) is the maximum nesting depth, or 0 for no
+limit.
+
+Returns the new Python value (``PyObject *``). PHP arrays are converted the
+same way as they are by ``zval_to_PyObject()``: to a list if their keys are
+exactly the indices 0 through n-1; otherwise, to a dict. PHP objects are
+converted to a dict of their public properties.
+
+.. NOTE: Back-references (``R:`` and ``r:``) are resolved to the same Python
+   value. Bytes following the serialized value are ignored as they are by
+   PHP.
+
+.. NOTE: If the return value is ``NULL``, a Python exception has been raised.
+*/
+static PyObject * unserialize_from_string(const char * data, Py_ssize_t len, unsigned long max_depth) {
+	struct unserialize_t u;
+	struct unserialize_frame_t frames_local[SERIALIZE_STACK_INIT];
+	struct unserialize_frame_t * frames = frames_local; // owned
+	struct unserialize_frame_t * f = NULL; // borrowed
+	size_t frames_size = SERIALIZE_STACK_INIT;
+	size_t depth = 0;
+	size_t i = 0;
+	const char * name = NULL; // borrowed
+	Py_ssize_t namelen = 0;
+	Py_ssize_t count = 0;
+	long ref = 0;
+	char type;
+	PyObject * pyval = NULL; // owned
+	
+	u.start = data;
+	u.end = data + len;
+	u.p = data;
+	u.vars = PyList_New(0);
+	if (u.vars == NULL) {
+		return NULL;
+	}
+	
+	for (;;) {
+		if (depth > 0) {
+			f = &frames[depth - 1];
+			if (f->remaining == 0) {
+				// Finish the array or object.
+				if (!unserialize_expect(&u, "}", 1)) {
+					goto unserialize_error; // Clean up.
+				}
+				pyval = f->pydict != NULL ? f->pydict : f->pylist;
+				f->pydict = NULL;
+				f->pylist = NULL;
+				--depth;
+			
+			} else if (f->pykey == NULL) {
+				// Read the key of the next element.
+				f->pykey = unserialize_key(&u);
+				if (f->pykey == NULL) {
+					goto unserialize_error; // Clean up.
+				}
+				continue;
+			}
+		}
+		
+		if (pyval == NULL) {
+			type = u.p < u.end ? *u.p : '\0';
+			if (type == 'R' || type == 'r') {
+				// Resolve back-reference to a value already read.
+				// .. NOTE: Object references (``r:``) are counted as values read
+				//    while references (``R:``) are not.
+				if (!unserialize_expect(&u, type == 'R' ? "R:" : "r:", 2) || !unserialize_long(&u, ';', &ref)) {
+					goto unserialize_error; // Clean up.
+				}
+				if (ref < 1 || ref > PyList_GET_SIZE(u.vars)) {
+					u.p -= 1;
+					unserialize_error(&u);
+					goto unserialize_error; // Clean up.
+				}
+				pyval = PyList_GET_ITEM(u.vars, ref - 1);
+				Py_INCREF(pyval);
+				if (type == 'r' && PyList_Append(u.vars, pyval) != 0) {
+					goto unserialize_error; // Clean up.
+				}
+			
+			} else if (type == 'a' || type == 'O') {
+				// Start reading the array or object.
+				if (type == 'a') {
+					if (!unserialize_expect(&u, "a:", 2)) {
+						goto unserialize_error; // Clean up.
+					}
+				} else {
+					// .. NOTE: The class name is not used.
+					if (!unserialize_expect(&u, "O:", 2) || !unserialize_quoted(&u, &name, &namelen) || !unserialize_expect(&u, ":", 1)) {
+						goto unserialize_error; // Clean up.
+					}
+				}
+				// .. NOTE: Each element takes at least 6 bytes (e.g., ``i:0;N;``).
+				if (!unserialize_length(&u, ':', 6, &count) || !unserialize_expect(&u, "{", 1)) {
+					goto unserialize_error; // Clean up.
+				}
+				if (!serialize_depth_check(depth, max_depth)) {
+					goto unserialize_error; // Clean up.
+				}
+				if (depth == frames_size && !serialize_stack_grow((void **)&frames, frames_local, &frames_size, sizeof(*frames))) {
+					goto unserialize_error; // Clean up.
+				}
+				f = &frames[depth];
+				f->pylist = NULL;
+				f->pydict = NULL;
+				f->pykey = NULL;
+				f->len = count;
+				f->remaining = count;
+				f->var = PyList_GET_SIZE(u.vars);
+				f->is_object = type == 'O';
+				if (f->is_object) {
+					f->pydict = _PyDict_NewPresized(count);
+				} else {
+					// Speculatively create python list.
+					f->pylist = PyList_New(count);
+				}
+				if (f->pydict == NULL && f->pylist == NULL) {
+					goto unserialize_error; // Clean up.
+				}
+				++depth;
+				if (PyList_Append(u.vars, f->pydict != NULL ? f->pydict : f->pylist) != 0) {
+					goto unserialize_error; // Clean up.
+				}
+				continue;
+			
+			} else {
+				pyval = unserialize_scalar(&u);
+				if (pyval == NULL) {
+					goto unserialize_error; // Clean up.
+				}
+				if (PyList_Append(u.vars, pyval) != 0) {
+					goto unserialize_error; // Clean up.
+				}
+			}
+		}
+		
+		// Return the top-level value, or set it in its parent.
+		if (depth == 0) {
+			break;
+		}
+		f = &frames[depth - 1];
+		if (!unserialize_frame_set(&u, f, pyval)) {
+			pyval = NULL; // Frame stole reference to python value.
+			goto unserialize_error; // Clean up.
+		}
+		pyval = NULL; // Frame steals reference to python value.
+	}
+	
+	// Clean up temporary values.
+	Py_DECREF(u.vars);
+	if (frames != frames_local) {
+		PyMem_Free(frames);
+	}
+	
+	// Return new python value.
+	return pyval;
+	
+	// Failed to unserialize python value.
+	unserialize_error: {
+		Py_XDECREF(pyval);
+		for (i = 0; i < depth; ++i) {
+			Py_XDECREF(frames[i].pylist);
+			Py_XDECREF(frames[i].pydict);
+			Py_XDECREF(frames[i].pykey);
+		}
+		Py_DECREF(u.vars);
+		if (frames != frames_local) {
+			PyMem_Free(frames);
+		}
+	}
+	return NULL;
+}
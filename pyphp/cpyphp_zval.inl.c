@@ -197,6 +197,36 @@ static zval * zval_from_string(const char * value, int length) {
 	return zv;
 }
 
+/**
+Returns a new PHP variable which takes ownership of the specified string.
+
+*value* (``char *``) is the string. This must have been allocated with
+``emalloc()`` and be terminated by a NULL byte.
+
+.. NOTE: On success, *value* is owned by the returned PHP string. On failure,
+   you are still responsible for freeing it.
+
+*length* (``int``) is the length of the string.
+
+Returns the new PHP string (``zval *``).
+*/
+static zval * zval_from_estring(char * value, int length) {
+	zval * zv = NULL; // owned
+	
+	if (value == NULL || length < 0) {
+		return NULL;
+	}
+	
+	// Initialize zval.
+	MAKE_STD_ZVAL(zv);
+	if (zv != NULL) {
+		Z_TYPE_P(zv) = IS_STRING;
+		Z_STRVAL_P(zv) = value;
+		Z_STRLEN_P(zv) = length;
+	}
+	return zv;
+}
+
 /**
 Determines whether the PHP array is a list.
 
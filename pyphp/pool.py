@@ -0,0 +1,478 @@
+"""
+This module provides pools of PHP interpreters and worker processes.
+"""
+
+import contextlib
+import ctypes
+import ctypes.util
+import exceptions
+import multiprocessing
+import os
+import cPickle as pickle
+import Queue
+import struct
+import sys
+import threading
+import traceback
+
+from . import cpyphp
+
+class WorkerError(cpyphp.PyphpException):
+	"""
+	The ``WorkerError`` exception is raised when a worker process of a
+	``ProcessPool`` fails.
+	"""
+
+class InterpreterPool(object):
+	"""
+	The ``InterpreterPool`` class is a thread-safe pool of PHP interpreters
+	(``cpyphp.Interpreter``). Each thread using the pool takes an idle
+	interpreter so that separate threads execute PHP at the same time.
+
+	.. NOTE: PHP must be thread-safe (ZTS).
+	"""
+
+	def __init__(self, size, setup=None):
+		"""
+		Initializes the ``InterpreterPool`` instance.
+
+		*size* (``int``) is the number of interpreters in the pool.
+
+		*setup* (**callable**) optionally is called with each interpreter
+		(``cpyphp.Interpreter``) after it is started (e.g., to set callbacks
+		or options).
+		"""
+		if size < 1:
+			raise ValueError("size:%r must be at least 1." % size)
+
+		# PHP must be initialized before other interpreters are started.
+		cpyphp.init()
+
+		self._idle = Queue.Queue()
+		self._interps = []
+		for _ in xrange(size):
+			interp = cpyphp.Interpreter()
+			interp.init()
+			if setup is not None:
+				setup(interp)
+			self._interps.append(interp)
+			self._idle.put(interp)
+
+	@contextlib.contextmanager
+	def interpreter(self, timeout=None):
+		"""
+		Returns a context manager that takes an idle interpreter from the pool
+		for the duration of its block.
+
+		*timeout* (``float``) optionally is the number of seconds to wait for an
+		idle interpreter. Default is ``None`` to wait indefinitely.
+
+		Raises ``Queue.Empty`` if no interpreter became idle within *timeout*.
+		"""
+		interp = self._idle.get(True, timeout)
+		try:
+			yield interp
+		finally:
+			self._idle.put(interp)
+
+	def call_function(self, name, *args):
+		"""
+		Calls the specified PHP function on an idle interpreter (see
+		``cpyphp.call_function()``).
+		"""
+		with self.interpreter() as interp:
+			return interp.call_function(name, *args)
+
+	def exec_file(self, file, json=False, track_changes=False):
+		"""
+		Executes the specified PHP script on an idle interpreter (see
+		``cpyphp.exec_file()``).
+		"""
+		with self.interpreter() as interp:
+			return interp.exec_file(file, json, track_changes)
+
+	def exec_inline(self, string, name=None, json=False, track_changes=False):
+		"""
+		Executes the specified PHP inline string/script on an idle interpreter
+		(see ``cpyphp.exec_inline()``).
+		"""
+		with self.interpreter() as interp:
+			return interp.exec_inline(string, name, json, track_changes)
+
+	def shutdown(self):
+		"""
+		Shuts-down every interpreter in the pool.
+		"""
+		for interp in self._interps:
+			interp.shutdown()
+
+	@property
+	def size(self):
+		"""
+		*size* (``int``) is the number of interpreters in the pool.
+		"""
+		return len(self._interps)
+
+
+class ProcessPool(object):
+	"""
+	The ``ProcessPool`` class is a pool of pre-forked worker processes. PHP is
+	initialized and warmed up (e.g., a framework is loaded) once in the
+	parent process which then forks the workers. The workers inherit the
+	warmed PHP runtime copy-on-write instead of each warming up PHP.
+
+	Requests and results are sent between the parent and workers over pipes
+	as pickled Python values. The pool is thread-safe: separate threads use
+	separate workers at the same time.
+
+	.. NOTE: Every worker handles its requests within the persistent PHP
+	   request the warmup script was executed in (see
+	   ``cpyphp.begin_request()``). Globals changed by one request are seen by
+	   the next request the same worker handles. Use *max_requests* to limit
+	   this.
+
+	.. NOTE: The parent process must not use PHP once the pool is created
+	   because the pool forks replacement workers from it.
+
+	.. NOTE: This requires ``os.fork()`` (i.e., not Windows).
+	"""
+
+	def __init__(self, size=None, warmup=None, max_requests=None, cpus=None):
+		"""
+		Initializes the ``ProcessPool`` instance.
+
+		*size* (``int``) optionally is the number of worker processes. Default
+		is ``None`` for the number of CPUs.
+
+		*warmup* (**string**) optionally is the PHP script to execute before the
+		workers are forked.
+
+		*max_requests* (``int``) optionally is the number of requests a worker
+		handles before it is replaced by a newly forked worker. Default is
+		``None`` for no limit. A worker is always replaced after a PHP fatal
+		error because PHP is restarted which discards the warmed state.
+
+		*cpus* (**sequence** of ``int``) optionally are the CPUs to pin the
+		workers to: worker *i* is pinned to ``cpus[i % len(cpus)]``. Default is
+		``None`` to not pin workers. This is only supported on Linux.
+		"""
+		if not hasattr(os, 'fork'):
+			raise NotImplementedError("ProcessPool requires os.fork().")
+		if size is None:
+			size = multiprocessing.cpu_count()
+		if size < 1:
+			raise ValueError("size:%r must be at least 1." % size)
+		if max_requests is not None and max_requests < 1:
+			raise ValueError("max_requests:%r must be at least 1." % max_requests)
+		if cpus is not None:
+			cpus = list(cpus)
+			if not cpus:
+				raise ValueError("cpus:%r cannot be empty." % cpus)
+			if not sys.platform.startswith('linux'):
+				raise NotImplementedError("CPU pinning is only supported on Linux.")
+
+		self._cpus = cpus
+		self._max_requests = max_requests
+		self._idle = Queue.Queue()
+		self._lock = threading.Lock()
+		self._workers = []
+
+		# Warmup PHP within a persistent request so that the warmed state is
+		# kept by the workers.
+		cpyphp.init()
+		cpyphp.begin_request()
+		try:
+			if warmup is not None:
+				cpyphp.exec_file(warmup)
+
+			for index in xrange(size):
+				self._idle.put(self._spawn(index))
+		except BaseException:
+			# Stop the workers already forked and end the persistent request so
+			# that the parent is not left inside it.
+			exc_info = sys.exc_info()
+			with self._lock:
+				workers, self._workers = self._workers, []
+			for worker in workers:
+				worker.stop()
+			cpyphp.end_request()
+			raise exc_info[0], exc_info[1], exc_info[2]
+
+	def __enter__(self):
+		return self
+
+	def __exit__(self, exc_type, exc_value, exc_tb):
+		self.shutdown()
+
+	def _call(self, method, args):
+		"""
+		Calls the specified ``cpyphp`` method on an idle worker.
+
+		*method* (``str``) is the name of the method.
+
+		*args* (``tuple``) is the arguments to pass to the method.
+
+		Returns the result of the method.
+		"""
+		worker = self._idle.get()
+		recycle = True
+		try:
+			_send(worker.request_fd, (method, args))
+			reply = _recv(worker.result_fd)
+			if reply is None:
+				raise WorkerError("PHP worker process:%d exited unexpectedly." % worker.pid)
+			worker.requests += 1
+			ok, value = reply
+			recycle = (not ok and value[0] == 'PhpFatalError') or (self._max_requests is not None and worker.requests >= self._max_requests)
+		finally:
+			if recycle:
+				worker = self._replace(worker)
+			self._idle.put(worker)
+		if not ok:
+			_raise(value)
+		return value
+
+	def _replace(self, worker):
+		"""
+		Replaces the specified worker with a newly forked worker.
+
+		*worker* (``_Worker``) is the worker to replace.
+
+		Returns the new worker (``_Worker``).
+		"""
+		with self._lock:
+			self._workers.remove(worker)
+		worker.stop()
+		return self._spawn(worker.index)
+
+	def _spawn(self, index):
+		"""
+		Forks a worker.
+
+		*index* (``int``) is the index of the worker.
+
+		Returns the worker (``_Worker``).
+		"""
+		with self._lock:
+			request_r, request_w = os.pipe()
+			result_r, result_w = os.pipe()
+			pid = os.fork()
+			if pid == 0:
+				# Worker process.
+				status = 1
+				try:
+					os.close(request_w)
+					os.close(result_r)
+					for other in self._workers:
+						other.close()
+					if self._cpus is not None:
+						_set_cpu_affinity(self._cpus[index % len(self._cpus)])
+					_serve(request_r, result_w, self._max_requests)
+					status = 0
+				except BaseException:
+					traceback.print_exc()
+				finally:
+					os._exit(status)
+
+			os.close(request_r)
+			os.close(result_w)
+			worker = _Worker(index, pid, request_w, result_r)
+			self._workers.append(worker)
+		return worker
+
+	def call_function(self, name, *args):
+		"""
+		Calls the specified PHP function in a worker (see
+		``cpyphp.call_function()``).
+		"""
+		return self._call('call_function', (name,) + args)
+
+	def exec_file(self, file, json=False, track_changes=False):
+		"""
+		Executes the specified PHP script in a worker (see
+		``cpyphp.exec_file()``).
+		"""
+		return self._call('exec_file', (file, json, track_changes))
+
+	def exec_inline(self, string, name=None, json=False, track_changes=False):
+		"""
+		Executes the specified PHP inline string/script in a worker (see
+		``cpyphp.exec_inline()``).
+		"""
+		return self._call('exec_inline', (string, name, json, track_changes))
+
+	def shutdown(self):
+		"""
+		Stops every worker and ends the persistent request of the warmup.
+		"""
+		with self._lock:
+			workers, self._workers = self._workers, []
+		for worker in workers:
+			worker.stop()
+		if workers:
+			cpyphp.end_request()
+
+	@property
+	def size(self):
+		"""
+		*size* (``int``) is the number of worker processes.
+		"""
+		return len(self._workers)
+
+
+class _Worker(object):
+	"""
+	The ``_Worker`` class is the parent's handle to a worker process of a
+	``ProcessPool``.
+	"""
+
+	def __init__(self, index, pid, request_fd, result_fd):
+		"""
+		Initializes the ``_Worker`` instance.
+
+		*index* (``int``) is the index of the worker within the pool.
+
+		*pid* (``int``) is the process ID of the worker.
+
+		*request_fd* (``int``) is the file descriptor requests are written to.
+
+		*result_fd* (``int``) is the file descriptor results are read from.
+		"""
+		self.index = index
+		self.pid = pid
+		self.request_fd = request_fd
+		self.result_fd = result_fd
+		self.requests = 0
+
+	def close(self):
+		"""
+		Closes the pipes to the worker which makes it exit.
+		"""
+		if self.request_fd is not None:
+			os.close(self.request_fd)
+			self.request_fd = None
+		if self.result_fd is not None:
+			os.close(self.result_fd)
+			self.result_fd = None
+
+	def stop(self):
+		"""
+		Closes the pipes to the worker and waits for it to exit.
+		"""
+		self.close()
+		try:
+			os.waitpid(self.pid, 0)
+		except OSError:
+			pass
+
+
+# The header of a message sent over a pipe: the length of the pickled value.
+_HEADER = struct.Struct('!I')
+
+def _raise(error):
+	"""
+	Raises the exception reported by a worker.
+
+	*error* (``tuple``) contains: the name of the exception class (``str``),
+	its arguments (``tuple``), and the formatted traceback (``str``).
+	"""
+	name, args, trace = error
+	for module in (cpyphp, exceptions):
+		cls = getattr(module, name, None)
+		if isinstance(cls, type) and issubclass(cls, BaseException):
+			raise cls(*args)
+	raise WorkerError("%s%r\n%s" % (name, args, trace))
+
+def _read(fd, size):
+	"""
+	Reads exactly the specified number of bytes from a file descriptor.
+
+	*fd* (``int``) is the file descriptor.
+
+	*size* (``int``) is the number of bytes to read.
+
+	Returns the read data (``str``), or ``None`` on EOF.
+	"""
+	chunks = []
+	while size > 0:
+		chunk = os.read(fd, size)
+		if not chunk:
+			return None
+		chunks.append(chunk)
+		size -= len(chunk)
+	return ''.join(chunks)
+
+def _recv(fd):
+	"""
+	Receives a value from a pipe.
+
+	*fd* (``int``) is the file descriptor to read from.
+
+	Returns the value, or ``None`` on EOF.
+	"""
+	header = _read(fd, _HEADER.size)
+	if header is None:
+		return None
+	data = _read(fd, _HEADER.unpack(header)[0])
+	if data is None:
+		return None
+	return pickle.loads(data)
+
+def _send(fd, value):
+	"""
+	Sends a value over a pipe.
+
+	*fd* (``int``) is the file descriptor to write to.
+
+	*value* (**mixed**) is the value to send. It must be picklable.
+	"""
+	data = pickle.dumps(value, pickle.HIGHEST_PROTOCOL)
+	data = _HEADER.pack(len(data)) + data
+	while data:
+		data = data[os.write(fd, data):]
+
+def _serve(request_fd, result_fd, max_requests):
+	"""
+	Serves requests in a worker process until the pipe is closed or
+	*max_requests* have been handled.
+
+	*request_fd* (``int``) is the file descriptor requests are read from.
+
+	*result_fd* (``int``) is the file descriptor results are written to.
+
+	*max_requests* (``int``) is the number of requests to handle, or ``None``
+	for no limit.
+	"""
+	count = 0
+	while max_requests is None or count < max_requests:
+		request = _recv(request_fd)
+		if request is None:
+			break
+		method, args = request
+		count += 1
+		try:
+			result = getattr(cpyphp, method)(*args)
+		except Exception as e:
+			_send(result_fd, (False, (e.__class__.__name__, e.args, traceback.format_exc())))
+			if isinstance(e, cpyphp.PhpFatalError):
+				# PHP was restarted which discarded the warmed state.
+				break
+		else:
+			_send(result_fd, (True, result))
+
+def _set_cpu_affinity(cpu):
+	"""
+	Pins the current process to the specified CPU.
+
+	.. NOTE: This is only supported on Linux.
+
+	*cpu* (``int``) is the CPU.
+	"""
+	libc = ctypes.CDLL(ctypes.util.find_library('c'), use_errno=True)
+	bits = 8 * ctypes.sizeof(ctypes.c_ulong)
+	# The size of ``cpu_set_t`` is fixed at 1024 CPUs.
+	mask = (ctypes.c_ulong * (1024 // bits))()
+	mask[cpu // bits] |= 1 << (cpu % bits)
+	if libc.sched_setaffinity(0, ctypes.sizeof(mask), ctypes.byref(mask)) != 0:
+		errno = ctypes.get_errno()
+		raise OSError(errno, os.strerror(errno))
@@ -23,6 +23,10 @@ arch = platform.architecture()[0]
 php_include_path = os.environ['PHP_INCLUDE_PATH']
 php_library_path = os.environ['PHP_LIBRARY_PATH']
 
+# Whether PHP was built thread-safe (ZTS). This is required to use multiple
+# interpreters (see ``pyphp.Interpreter``).
+php_zts = os.environ.get('PHP_ZTS', '0') not in ('', '0')
+
 defines = []
 sources = [
 	'pyphp/cpyphp_module.c'
@@ -52,18 +56,21 @@ if system == 'Windows':
 		('PHP_WIN32', None),
 		('_USE_32BIT_TIME_T', None)
 	]
+	# .. NOTE: ZTS is defined by "config.w32.h" when PHP was built thread-safe.
+	php_lib = 'php5ts' if php_zts else 'php5'
 	libraries += [
-		'php5',
+		php_lib,
 		'php5embed'
 	]
 	data_files['pyphp'] += [
-		os.path.join(php_library_path, 'php5.dll')
+		os.path.join(php_library_path, php_lib + '.dll')
 	]
 	
 else:
 	if system != 'Linux':
 		warnings.warn("Your system %r has not been tested. Trying Linux configuration." % system)
 		
+	# .. NOTE: ZTS is defined by "php_config.h" when PHP was built thread-safe.
 	libraries += [
 		'php5'
 	]